@@ -5,33 +5,124 @@
  * una ventana del gestor X con un par de luces predeterminadas. Además, permite rotar el modelo 
  * sobre los ejes X y Y (en coordenadas de plano de proyección), así como desplazar la cámara por el mundo.
  * 
- * Requiere de las bibliotecas de desarrollo de X11 y Eigen 3.3.7 para funcionar.
- * Compilar con: g++ proyecto1.cpp -o proyecto1  -I/path/to/eigen/ -lX11 -O3
+ * Requiere de las bibliotecas de desarrollo de X11 (con la extensión MIT-SHM) y Eigen 3.3.7 para funcionar.
+ * Compilar con: g++ proyecto1.cpp -o proyecto1  -I/path/to/eigen/ -lX11 -lXext -pthread -O3
+ * Para compilar sin X11 (sólo modo sin ventana): g++ proyecto1.cpp -o proyecto1 -I/path/to/eigen/ -DSIN_X11 -pthread -O3
  * El programa muestra instrucciones de operación en la consola.
  * 
+ * Opciones de renderizado:
+ *   --hilos N      Número de hilos que rasterizan los mosaicos de la pantalla (por defecto, todos los núcleos).
+ *   --referencia   Usa el renderizador original de un solo hilo, cara por cara.
+ *   --diferido     Rasteriza primero un buffer de visibilidad y sombrea cada pixel visible una sola vez.
+ *   --sin-hiz      Desactiva el descarte de triángulos ocultos con el buffer de profundidad jerárquico.
+ *   --frente-atras Dibuja los meshlets visibles del más cercano al más lejano para que el descarte oculte más caras.
+ *   --blinn        Calcula la componente especular con el modelo de Blinn-Phong en lugar del de Phong.
+ *   --isa ISA      Fuerza el kernel de rasterización: escalar, sse o avx2 (por defecto, el más ancho disponible).
+ *   --uvs-archivo  Usa las coordenadas de textura (vt) del OBJ en lugar del mapeo esférico, si todas las caras las tienen.
+ *   --sin-textura  Ignora la textura map_Kd del .mtl del OBJ y usa el patrón de checker.
+ *   --filtro F     Filtro de la textura: cercano, bilineal o trilineal (por defecto).
+ *   --textura-lineal Guarda los mipmaps de la textura por renglones en lugar de en mosaicos de 8x8 en orden de Morton.
+ *   --reordenar    Reordena al cargar las caras de cada meshlet (Tipsify) y los vértices por primer uso, para la localidad.
+ *   --ventana AxH  Tamaño inicial de la ventana (y de las imágenes sin ventana) en pixeles; por defecto, 500x500.
+ *   --escala F     Dibuja a F veces la resolución de la ventana (de 0.25 a 1) y amplía la imagen al desplegarla.
+ *   --resolucion-dinamica MS Con ventana, ajusta la escala de los frames en movimiento para que tarden cerca de MS ms.
+ *   --cache        Guarda el modelo procesado en archivo.obj.malla y lo mapea a memoria en las siguientes ejecuciones.
+ *   --sin-lod      No construye los niveles de detalle simplificados que se usan mientras se mueve la cámara o el modelo.
+ *   --sin-progresiva Lee todo el OBJ antes de abrir la ventana en lugar de dibujar las caras conforme se leen.
+ *   --fuera-nucleo MB Dibuja el modelo desde ladrillos en archivo.obj.ladrillos, con a lo más MB megabytes de ellos en memoria.
+ *   --estadisticas archivo.json Escribe los tiempos por etapa y los contadores de cada frame.
+ *   --traza archivo.json Escribe las etapas de cada hilo como eventos de Chrome (chrome://tracing o Perfetto).
+ * Cada frame imprime un resumen de tiempos por etapa y contadores. Para compilar sin instrumentación: -DSIN_INSTRUMENTACION
+ * 
+ * Benchmark: proyecto1 --benchmark [resultados.json] [--caras-max N] [opciones de renderizado]
+ *   Genera mallas sintéticas (esfera, cubo y superficie ruidosa) de 10 mil a N caras (por defecto, un millón), mide cada
+ *   etapa (lectura del OBJ, UVs, meshlets, vértices, edge functions, sombreado, frames completos y reordenamiento para
+ *   el caché de vértices, con un frame de la malla reordenada) y escribe un JSON.
+ * 
+ * Verificación: proyecto1 --verificar [directorio] [--tolerancia N] [--pixeles-max N] [--hilos N] [--isa ISA]
+ *   Renderiza mallas sintéticas en varias poses con el renderizador de referencia y con cada variante del renderizador por
+ *   mosaicos (cada kernel, diferido, sin Hi-Z, de frente hacia atrás, fuera de núcleo y en lote) y compara las imágenes pixel por
+ *   pixel. Las de referencia se guardan en el directorio (por defecto, "verificacion") y las siguientes ejecuciones se
+ *   comparan contra ellas; si una comparación falla, se guardan la imagen y sus diferencias. Termina con 1 si algo falló.
+ * 
+ * Modo sin ventana: proyecto1 archivo.obj --sin-ventana guion.txt [--salida prefijo] [--formato png|ppm] [--lote]
+ * El guion tiene un comando por línea ('#' inicia un comentario):
+ *   camara X Y Z       Coloca la cámara en la posición (X, Y, Z).
+ *   mover DX DY DZ     Desplaza la cámara.
+ *   rotar EJE GRADOS   Rota el modelo sobre el eje x o y.
+ *   detalle MODO       Nivel de detalle de los siguientes frames: completo, auto (el que se usa en movimiento) o un número.
+ *   frame [archivo]    Renderiza un frame y lo guarda (por defecto en prefijo_NNNN.formato).
+ *   giro N             Renderiza N frames girando el modelo 360 / N grados sobre el eje y entre cada uno.
+ * Con --lote, los frames del guion se renderizan juntos como un lote de vistas: la etapa de vértices se comparte entre
+ * las vistas de cada grupo y cada hilo dibuja vistas completas. Se reportan las vistas por segundo.
+ * 
  * La implementación está basada en este tutorial de Scratchapixel 2.0:
  * https://www.scratchapixel.com/lessons/3d-basic-rendering/rasterization-practical-implementation
  */
 
 #include <iostream>     //Entrada y salida estándar.
+#ifndef SIN_X11
 #include <X11/Xlib.h>   //Gestor de ventanas.
+#include <X11/Xutil.h>  //Creación de imágenes (XImage).
+#include <X11/extensions/XShm.h>    //Extensión de memoria compartida MIT-SHM.
+#include <sys/ipc.h>    //Segmentos de memoria compartida para MIT-SHM.
+#include <sys/shm.h>
 #ifdef Success          //Había conflicto entre macros de Eigen y X11.
     #undef Success
 #endif
+#endif
 #include <Eigen/Dense>  //Para álgebra lineal.
 #include <fstream>      //Manejo de archivos.
 #include <vector>       //Vectores.
+#include <cstdint>      //Enteros de tamaño fijo para los pixeles.
+#include <cstring>      //memset para limpiar el framebuffer.
+#include <sstream>      //Lectura del guion del modo sin ventana.
+#include <chrono>       //Medición del tiempo de renderizado.
+#include <thread>       //Hilos del rasterizador por mosaicos.
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>        //Colas de mosaicos de cada hilo.
+#include <list>         //Orden de uso de los ladrillos del modelo fuera de núcleo.
+#include <atomic>       //Contadores compartidos entre los hilos del rasterizador.
+#include <memory>       //Bloque compartido de memoria de la malla.
+#include <algorithm>    //Ordenamiento de las caras para formar los meshlets.
+#include <array>        //Caras de las mallas simplificadas.
+#include <charconv>     //Conversión de números del OBJ sin reservar memoria (from_chars).
+#include <sys/mman.h>   //Mapeo del archivo OBJ a memoria.
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>  //Intrínsecos SSE y AVX2 del kernel de rasterización.
+#define KERNEL_SIMD
+#endif
 
 //Variables globales para facilitar la escritura del código.        
+#ifndef SIN_X11
 Display* display;   //Apuntador a la estructura de Display.
 Window win;         //ID de la ventana.
 GC gc;              //Contexto gráfico.
 XEvent event;       //Para obtener eventos de teclado.
-Colormap cm;        //Para hacer mapeos entre valores de color y pixeles.
+Visual *visual;     //Visual de la ventana (debe ser TrueColor).
+int profundidadVen; //Profundidad de color de la ventana en bits.
+bool usarShm;       //Indica si se despliegan los frames con la extensión MIT-SHM.
+#endif
+int despRojo = 16, despVerde = 8, despAzul = 0;  //Desplazamientos de cada canal dentro de un pixel empaquetado.
 int altoVen = 500;  //Altura de la ventana en pixeles.
 int anchoVen = 500; //Anchura de la ventana en pixeles.
 int planoCercano = 1;   //Profundidad del plano cercano.
 int planoLejano = 1000; //Profundidad del plano lejano.
+const int tamMosaico = 32;  //Lado en pixeles de los mosaicos en los que se divide la pantalla al rasterizar.
+int numHilos = 1;           //Número de hilos que rasterizan mosaicos.
+bool usarReferencia = false;//Indica si se usa el renderizador original de un solo hilo.
+bool usarDiferido = false;  //Indica si el renderizador por mosaicos sombrea en una segunda pasada (buffer de visibilidad).
+const int tamBloqueHiZ = 8; //Lado en pixeles de los bloques del buffer de profundidad jerárquico (divide a tamMosaico).
+const float margenHiZ = 1e-3f;  //Margen relativo de la profundidad más cercana de un triángulo, por el redondeo del kernel.
+bool usarHiZ = true;        //Indica si se descartan triángulos ocultos con el buffer de profundidad jerárquico.
+bool ordenarFrenteAtras = false;//Indica si los meshlets visibles se dibujan del más cercano al más lejano.
+bool usarBlinn = false;     //Indica si la componente especular usa el modelo de Blinn-Phong en lugar del de Phong.
+bool usarReordenamiento = false;//Indica si al construir los meshlets se reordenan caras y vértices para el caché de vértices.
 
 //Representación de un color en coordenadas normalizadas.
 struct Color {
@@ -40,14 +131,596 @@ struct Color {
     float B;
 };
 
-//Representación de una cara (triángulo) del modelo.
-struct Cara {
-    Eigen::Vector4f vertice[3];     //Los tres vértices que componen la cara.
-    Eigen::Vector2f coord_tex[3];   //Coordenadas de textura en cada vértice.
-    Eigen::Vector4f normal[3];      //Normal en cada vértice.
-    Eigen::Vector3f vertDisp[3];    //Vértice en coordenadas de dispositivo (con profundidad).
+//Buffer de color en memoria donde se compone un frame antes de desplegarlo.
+struct Framebuffer {
+    uint32_t *pixeles;      //Pixeles empaquetados en el formato TrueColor de la ventana.
+#ifndef SIN_X11
+    XImage *imagen;         //Imagen de X11 que comparte la memoria de los pixeles.
+    XShmSegmentInfo shm;    //Segmento de memoria compartida (sólo si se usa MIT-SHM).
+#endif
+};
+
+//Se usan dos framebuffers: uno se despliega mientras en el otro se dibuja el siguiente frame.
+Framebuffer framebuffers[2];
+
+//Destino de render: el buffer de profundidad y el de color en los que se dibuja el frame. Cada uno es un solo bloque
+//alineado a 64 bytes y guardado por renglones (pixel (x, y) en y * paso + x), con "paso" redondeado a 16 pixeles para
+//que cada renglón empiece en una línea de caché. Se dibuja a la resolución interna, que es la de la ventana por la
+//escala de resolución; al terminar el frame, el color se copia (o se amplía) al framebuffer trasero.
+struct DestinoRender {
+    int ancho = 0, alto = 0;        //Resolución interna en pixeles.
+    int paso = 0;                   //Pixeles de cada renglón de los dos buffers.
+    float escala = 1;               //Fracción de la resolución de la ventana.
+    float aspecto = 1;              //Alto entre ancho de la ventana: la ventana cubre el campo de visión vertical.
+    size_t capacidad = 0;           //Pixeles reservados en cada buffer (no se vuelven a reservar si caben).
+    float *profundidad = nullptr;
+    uint32_t *color = nullptr;
+};
+DestinoRender destino;
+const float escalaMinima = 0.25f;   //Escala más baja de la resolución dinámica (y de --escala).
+float escalaResolucion = 1;         //Escala de resolución pedida (--escala); es la de los frames sin movimiento.
+bool resolucionDinamica = false;    //Indica si la escala de los frames en movimiento se ajusta a objetivoFrame.
+float objetivoFrame = 33;           //Tiempo en ms que busca la resolución dinámica para los frames en movimiento.
+const int carasPorMeshlet = 64;  //Caras de cada meshlet.
+const int tamCacheVertices = 32;    //Entradas del caché FIFO de vértices transformados que simula el reordenamiento.
+const int lineasCacheVertices = 64; //Líneas de 64 bytes (4 KB) del caché FIFO con el que se mide la lectura de un arreglo de vértices.
+const int resolucionesDetalle[] = {256, 128, 64, 32, 16};   //Celdas sobre el eje más largo del modelo en cada nivel de detalle.
+const float errorDetalle = 2.0f;        //Error en pixeles que se tolera en los niveles de detalle que se usan en movimiento.
+const int esperaDetalle = 250;          //Milisegundos sin entradas tras los que se vuelve a renderizar con todo el detalle.
+const size_t bytesLote = 4 << 20;       //Bytes del OBJ que lee el lector de la carga progresiva en cada lote.
+const size_t lotesEnCola = 4;           //Lotes leídos que pueden esperar en la cola antes de que el lector se detenga.
+const int intervaloCarga = 50;          //Milisegundos entre las revisiones de la cola de lotes durante la carga progresiva.
+const int esperaParcial = 250;          //Milisegundos mínimos entre los frames que muestran la malla parcial.
+const uint32_t carasPorLadrillo = 1 << 15;  //Caras que se buscan juntar en cada ladrillo del modelo fuera de núcleo.
+const int bitsCubetaLadrillo = 7;       //Bits por eje del código de Morton con el que se reparten las caras en ladrillos.
+const int repeticionesBenchmark = 3;    //Repeticiones mínimas de cada medición del benchmark.
+const double tiempoBenchmark = 0.25;    //Segundos mínimos que se mide cada etapa del benchmark.
+const int carasBufferLadrillo = 64;     //Caras que se juntan por ladrillo antes de escribirlas al ordenar el archivo.
+const int bitsMosaicoTextura = 3;       //Los mosaicos de la textura son de 8x8 texeles (sus texeles van en orden de Morton).
+const int lineasCacheTextura = 512;     //Líneas de 64 bytes del caché simulado con el que se cuentan los fallos de textura.
+const int bitsTablaInflado = 10;        //Bits de la tabla directa de los códigos de Huffman cortos del lector de PNG.
+const size_t bytesVerticesLote = 256 << 20;    //Memoria máxima para los vértices transformados de cada grupo de vistas del lote.
+const int vistasPorHilo = 2;            //Vistas de cada grupo del lote por hilo del pool (las demás esperan al siguiente grupo).
+const size_t verticesBloqueLote = 1024; //Vértices que se transforman para todas las vistas de un grupo antes de pasar a los siguientes.
+int frameTrasero = 0;   //Índice del framebuffer en el que se está dibujando.
+
+//Nivel de la cadena de mipmaps de la textura. Los texeles se guardan en mosaicos de 8x8, por renglones de mosaicos, y
+//dentro de cada mosaico en orden de Morton (Z): los 2x2 texeles que lee el filtro bilineal casi siempre quedan en la
+//misma línea de caché, y un mosaico completo ocupa 4 líneas sin importar en qué dirección se recorra la textura.
+struct NivelTextura {
+    int ancho, alto;
+    int mosaicosX;          //Mosaicos por renglón de mosaicos.
+    size_t inicio;          //Primer texel del nivel en el arreglo de la textura.
+};
+
+//Textura difusa del modelo (map_Kd de su material) con todos sus niveles de mipmap, de la imagen original al de 1x1.
+//Cada texel es RGBA de 8 bits por canal, con el rojo en el byte más bajo.
+struct Textura {
+    std::vector<NivelTextura> niveles;  //Vacío si el modelo no tiene textura: se usa el checker.
+    std::vector<uint32_t> texeles;
+    bool lineal = false;                //Cada nivel está guardado por renglones, sin mosaicos (para comparar).
+};
+Textura textura;
+enum FiltroTextura {FILTRO_CERCANO, FILTRO_BILINEAL, FILTRO_TRILINEAL};
+FiltroTextura filtroTextura = FILTRO_TRILINEAL; //Filtro con el que se muestrea la textura.
+const int ladoMaximoTextura = 16384;            //Lado más grande que se acepta en una textura.
+
+//Código de Huffman de DEFLATE para el lector de PNG: cuántos códigos hay de cada longitud, los símbolos en el orden de
+//sus códigos canónicos y una tabla directa, indexada con los siguientes bitsTablaInflado bits, para los códigos cortos.
+struct HuffmanInflado {
+    uint16_t conteo[16];
+    uint16_t simbolos[288];
+    uint16_t rapida[1 << bitsTablaInflado];     //Símbolo << 4 | longitud del código (0 si el código es más largo).
+};
+
+//Lector de los bits de un flujo DEFLATE, del bit menos significativo de cada byte al más significativo. Al terminarse
+//los datos se rellena con ceros; si se llega a usar el relleno, el flujo estaba truncado y se marca "agotado".
+struct LectorBits {
+    const uint8_t *datos;
+    size_t n, pos = 0;
+    uint64_t bits = 0;
+    int disponibles = 0, relleno = 0;
+    bool agotado = false;
+
+    LectorBits(const uint8_t *datos, size_t n) : datos(datos), n(n) {}
+    void llenar() {
+        while (disponibles <= 56) {
+            uint64_t byte = 0;
+            if (pos < n) {
+                byte = datos[pos++];
+            }
+            else {
+                relleno += 8;
+            }
+            bits |= byte << disponibles;
+            disponibles += 8;
+        }
+    }
+    void consumir(int k) {
+        bits >>= k;
+        disponibles -= k;
+        agotado |= disponibles < relleno;
+    }
+    uint32_t tomar(int k) {
+        llenar();
+        uint32_t valor = uint32_t(bits & ((uint64_t(1) << k) - 1));
+        consumir(k);
+        return valor;
+    }
+    int decodificar(const HuffmanInflado &);
+};
+
+//Malla indexada tal como la arma el lector del OBJ. Cada vértice (combinación única de posición, textura y normal
+//del OBJ) se guarda una sola vez, con un arreglo por componente; cada cara (triángulo) son tres índices a esos vértices.
+struct MallaOBJ {
+    std::vector<float> px, py, pz;      //Posición de cada vértice (la coordenada homogénea siempre es 1).
+    std::vector<float> nx, ny, nz, nw;  //Normal de cada vértice, normalizada con su coordenada homogénea como en el OBJ original.
+    std::vector<float> u, v;            //Coordenadas de textura de cada vértice.
+    std::vector<uint32_t> indices;      //Tres índices de vértice por cara.
+    bool uvsArchivo = false;            //Indica si todas las caras del OBJ traían coordenadas de textura (vt).
+};
+
+//Cabecera del bloque de memoria de una malla. El mismo bloque (cabecera y arreglos alineados a 64 bytes) es el que
+//se escribe en el caché binario junto al OBJ, así que un caché se puede mapear a memoria y usar sin copiarlo.
+const char magiaCache[8] = {'M', 'A', 'L', 'L', 'A', 'O', 'B', 'J'};
+const uint32_t versionCache = 2;
+enum {ARREGLO_PX, ARREGLO_PY, ARREGLO_PZ, ARREGLO_NX, ARREGLO_NY, ARREGLO_NZ, ARREGLO_NW, ARREGLO_U, ARREGLO_V, ARREGLO_INDICES,
+      ARREGLO_MESHLETS, ARREGLO_NODOS, NUM_ARREGLOS};
+struct CabeceraMalla {
+    char magia[8];
+    uint32_t version;
+    uint32_t numVertices, numCaras;
+    uint32_t numMeshlets, numNodos;
+    uint32_t uvsArchivo;            //1 si todas las caras del OBJ traían coordenadas de textura.
+    uint32_t uvsEsfericas;          //1 si las UVs guardadas son las del mapeo esférico de generarUVs.
+    uint32_t reordenada;            //1 si las caras y los vértices se reordenaron para el caché de vértices (--reordenar).
+    uint64_t tamanoFuente;          //Tamaño del OBJ del que se generó el caché.
+    int64_t modificacionFuente;     //Fecha de modificación del OBJ, en nanosegundos.
+    uint64_t sumaFuente;            //Suma de verificación del contenido del OBJ.
+    float minimo[3], maximo[3];     //Caja alineada a los ejes que engloba al modelo.
+    uint64_t desplazamiento[NUM_ARREGLOS];  //Inicio de cada arreglo desde el principio del bloque.
+    uint64_t tamano;                //Tamaño total del bloque.
+};
+
+//Esfera que engloba a un grupo de caras y cono que engloba a sus normales (geométricas, del producto cruz).
+struct LimitesMeshlet {
+    float centro[3], radio;
+    float eje[3], cosCono;      //Eje unitario y coseno de la apertura del cono (-1 si el cono no sirve para descartar).
+};
+
+//Meshlet: grupo de hasta carasPorMeshlet caras consecutivas de la malla, cercanas en el espacio.
+struct Meshlet {
+    uint32_t primeraCara, numCaras;
+    LimitesMeshlet limites;
+};
+
+//Medición de la localidad del orden de las caras: vértices transformados por cara (ACMR) con un caché FIFO de
+//tamCacheVertices vértices, como el post-transformación de una GPU, y líneas de 64 bytes por cara que se leen de un
+//arreglo de floats por vértice (como xDisp) con un caché FIFO de lineasCacheVertices líneas.
+struct MedicionCacheVertices {
+    double acmr, lineasPorCara;
+};
+
+//Nodo del BVH de meshlets. Engloba a los meshlets [primerMeshlet, primerMeshlet + numMeshlets); las hojas tienen uno solo.
+//Los nodos están en preorden y "siguiente" es el primer nodo después de todo el subárbol.
+struct NodoBVH {
+    LimitesMeshlet limites;
+    uint32_t primerMeshlet, numMeshlets;
+    uint32_t siguiente, reservado;
+};
+
+struct CadenaDetalle;
+
+//Malla indexada que usa el renderizador. Sus arreglos apuntan a un solo bloque de memoria, que puede ser propio o
+//las páginas del caché mapeado a memoria; "bloque" libera la memoria o quita el mapeo cuando ya nadie usa la malla.
+struct Malla {
+    float *px = nullptr, *py = nullptr, *pz = nullptr;                  //Posición de cada vértice (la coordenada homogénea siempre es 1).
+    float *nx = nullptr, *ny = nullptr, *nz = nullptr, *nw = nullptr;   //Normal de cada vértice, con su coordenada homogénea.
+    float *u = nullptr, *v = nullptr;                                   //Coordenadas de textura de cada vértice.
+    uint32_t *indices = nullptr;                                        //Tres índices de vértice por cara.
+    Meshlet *meshlets = nullptr;                                        //Meshlets en los que se dividen las caras.
+    NodoBVH *nodos = nullptr;                                           //BVH sobre los meshlets.
+    uint32_t vertices = 0, caras = 0;
+    uint32_t numMeshlets = 0, numNodos = 0;
+    bool uvsArchivo = false;            //Indica si todas las caras del OBJ traían coordenadas de textura (vt).
+    std::shared_ptr<void> bloque;       //Bloque con la cabecera y los arreglos.
+    size_t tamanoBloque = 0;
+    std::shared_ptr<CadenaDetalle> detalle; //Niveles de detalle simplificados (nulo si no se construyeron).
+
+    size_t numVertices() const { return vertices; }
+    size_t numCaras() const { return caras; }
+    CabeceraMalla *cabecera() const { return (CabeceraMalla *) bloque.get(); }
+    Eigen::Vector4f posicion(uint32_t i) const { return Eigen::Vector4f(px[i], py[i], pz[i], 1.0f); }
+    Eigen::Vector4f normal(uint32_t i) const { return Eigen::Vector4f(nx[i], ny[i], nz[i], nw[i]); }
+    Eigen::Vector2f coordTex(uint32_t i) const { return Eigen::Vector2f(u[i], v[i]); }
+};
+
+//Versión simplificada de una malla. tamCelda es el lado de las celdas en las que se agruparon sus vértices, que acota
+//cuánto se aleja la superficie simplificada de la original.
+struct NivelDetalle {
+    Malla malla;
+    float tamCelda;
+};
+
+//Cadena de niveles de detalle de una malla, del más fino al más burdo. Se construye en un hilo aparte después de cargar
+//el modelo; el renderizador sólo ve los niveles que ya están terminados.
+struct CadenaDetalle {
+    std::mutex mutex;
+    std::condition_variable terminada;  //Avisa que ya se construyeron todos los niveles.
+    std::vector<std::shared_ptr<const NivelDetalle>> niveles;
+    bool completa = false;
+    std::atomic<bool> cancelar{false};  //Pide al hilo constructor que termine antes (al salir del programa).
+    std::thread constructor;
+};
+
+//Esquina de una cara del OBJ: índices (base 0) de posición, coordenada de textura y normal.
+//Los índices negativos se guardan relativos al inicio de su fragmento hasta que se conoce el desplazamiento de éste.
+struct EsquinaOBJ {
+    int32_t v, t, n;
+    uint8_t banderas;   //Combinación de las banderas ESQUINA_*.
+};
+enum {
+    ESQUINA_V_RELATIVA = 1,     //El índice de posición es relativo al fragmento.
+    ESQUINA_T_RELATIVA = 2,     //El índice de textura es relativo al fragmento.
+    ESQUINA_N_RELATIVA = 4,     //El índice de normal es relativo al fragmento.
+    ESQUINA_CON_T = 8,          //La esquina tiene coordenada de textura.
+};
+
+//Datos leídos de un fragmento del OBJ (un rango de líneas completas). Cada hilo lee un fragmento.
+struct FragmentoOBJ {
+    std::vector<float> posiciones;      //Tres floats por línea "v".
+    std::vector<float> normales;        //Tres floats por línea "vn".
+    std::vector<float> coordTex;        //Dos floats por línea "vt".
+    std::vector<EsquinaOBJ> esquinas;   //Tres esquinas por triángulo.
+    size_t carasSinNormal = 0;          //Caras que se ignoraron por no tener normales.
+};
+
+//Deduplicación de los vértices del OBJ: cada posición tiene una lista ligada con los vértices de la malla que la usan
+//(casi siempre uno solo), así que no hace falta una tabla hash. Guarda los atributos del archivo que ya se leyeron, así
+//que las caras se pueden agregar por partes (la carga progresiva las agrega lote por lote).
+const uint32_t NINGUNO = UINT32_MAX;    //Marca de fin de las listas de vértices con la misma posición.
+struct DeduplicacionOBJ {
+    std::vector<float> posiciones, normales, coordTex;  //Atributos (v, vn, vt) leídos del OBJ.
+    std::vector<uint32_t> primero;      //Último vértice de la malla agregado con cada posición.
+    std::vector<uint32_t> siguiente;    //Siguiente vértice de la lista de su posición.
+    std::vector<int32_t> claveT, claveN;//Índices de textura y normal de cada vértice.
+    bool todasConUV = true;             //Todas las esquinas agregadas traían coordenada de textura.
+};
+
+//Carga progresiva del OBJ: un hilo lector lee el archivo de principio a fin en lotes de líneas completas y los deja en
+//una cola acotada; el hilo de renderizado toma los lotes, agrega sus caras a la malla y dibuja lo que ya se leyó.
+//Si la cola se llena, el lector espera a que el renderizador la vacíe.
+struct CargaProgresiva {
+    std::string nombre;                 //Archivo OBJ.
+    bool usarCache, uvsArchivo;         //Opciones con las que se termina el modelo.
+    bool usarDetalle;                   //Construir los niveles de detalle al terminar la carga.
+    const char *datos = nullptr;        //Archivo mapeado a memoria (lo libera el lector al terminar).
+    size_t tamano = 0;
+    std::chrono::steady_clock::time_point inicio;
+    std::thread lector;
+    std::atomic<bool> cancelar{false};  //Pide al lector que termine antes (al salir del programa).
+
+    //Cola de lotes, compartida con el lector.
+    std::mutex mutex;
+    std::condition_variable hayEspacio; //Avisa al lector que se liberó un lugar en la cola.
+    std::deque<FragmentoOBJ> lotes;     //Lotes con los índices relativos ya resueltos, en el orden del archivo.
+    size_t bytesLeidos = 0;             //Bytes del archivo que ya están en algún lote.
+    bool terminada = false;             //El lector ya dejó en la cola su último lote.
+
+    //Estado del renderizador, que es el único que lo toca.
+    DeduplicacionOBJ dedup;
+    MallaOBJ malla;                     //Caras que ya se tomaron de la cola.
+    size_t carasSinNormal = 0;
+    Eigen::Vector3f minimo = Eigen::Vector3f::Constant(INFINITY), maximo = Eigen::Vector3f::Constant(-INFINITY); //Caja de las posiciones leídas.
+    bool todoTomado = false;            //Ya se tomó el último lote.
+    double fraccion = 0;                //Fracción del archivo que se había leído al tomar los lotes.
+};
+
+//Archivo de ladrillos del modelo fuera de núcleo (archivo.obj.ladrillos): las caras del modelo se reparten por su
+//posición en ladrillos de unas carasPorLadrillo caras, y cada ladrillo se guarda como una malla completa con el mismo
+//bloque que el caché binario (vértices propios, meshlets y BVH), alineado a 4096 bytes. El archivo empieza con esta
+//cabecera seguida del directorio de ladrillos.
+const char magiaLadrillos[8] = {'L', 'A', 'D', 'R', 'I', 'L', 'L', 'O'};
+const uint32_t versionLadrillos = 2;
+struct CabeceraLadrillos {
+    char magia[8];
+    uint32_t version;
+    uint32_t numLadrillos;
+    uint64_t numCaras;              //Caras de todo el modelo.
+    uint32_t uvsArchivo;            //1 si todas las caras del OBJ traían coordenadas de textura.
+    uint32_t uvsEsfericas;          //1 si las UVs guardadas son las del mapeo esférico (con el centroide de todo el modelo).
+    uint32_t reordenada;            //1 si los ladrillos se reordenaron para el caché de vértices (--reordenar).
+    uint32_t reservado;
+    uint64_t tamanoFuente;          //Tamaño, fecha de modificación y suma de verificación del OBJ, como en el caché.
+    int64_t modificacionFuente;
+    uint64_t sumaFuente;
+    uint64_t tamano;                //Tamaño total del archivo.
+};
+
+//Entrada del directorio del archivo de ladrillos.
+struct Ladrillo {
+    uint64_t desplazamiento, tamano;    //Bloque de la malla del ladrillo dentro del archivo.
+    uint32_t numCaras, numVertices;
+    LimitesMeshlet limites;             //Límites de la raíz del BVH del ladrillo.
+};
+
+//Cara del OBJ con sus índices ya absolutos, tal como se guarda en los archivos temporales al construir los ladrillos.
+struct CaraLadrillo {
+    int32_t v[3], t[3], n[3];           //t es -1 si la esquina no tiene coordenada de textura.
+};
+
+//Caché de ladrillos en memoria del modelo fuera de núcleo. Se mantienen a lo más "limite" bytes de ladrillos (contando
+//los que se están leyendo); cuando hace falta espacio se expulsa el que lleva más tiempo sin usarse. Un hilo de
+//precarga lee los ladrillos que se verán si la vista sigue moviéndose como en el último frame.
+struct CacheLadrillos {
+    std::string nombre;
+    int descriptor = -1;
+    CabeceraLadrillos cabecera;
+    std::vector<Ladrillo> directorio;
+    size_t limite = 0;                  //Bytes de ladrillos que se permiten en memoria.
+
+    std::mutex mutex;
+    std::condition_variable cargado;    //Avisa que terminó de leerse un ladrillo.
+    std::condition_variable hayPrecarga;//Avisa al hilo de precarga que hay ladrillos pendientes o que debe terminar.
+    std::vector<std::shared_ptr<const Malla>> residentes;   //Malla de cada ladrillo en memoria (nula si no está).
+    std::vector<uint8_t> leyendo;       //El ladrillo se está leyendo del disco.
+    std::vector<uint8_t> precargado;    //El ladrillo llegó por precarga y todavía no se usa.
+    std::vector<long> ultimoUso;        //Último frame en el que se dibujó cada ladrillo.
+    std::list<uint32_t> usoReciente;    //Ladrillos en memoria, del usado más recientemente al menos reciente.
+    std::vector<std::list<uint32_t>::iterator> posicionUso;
+    size_t bytesResidentes = 0;         //Bytes de los ladrillos en memoria y de los que se están leyendo.
+    long frame = 0;                     //Frames dibujados.
+    std::deque<uint32_t> pendientes;    //Ladrillos que se van a precargar.
+    bool terminar = false;
+    std::thread precargador;
+    Eigen::Matrix4f vistaAnterior;      //Matriz modelo-vista del frame anterior (para predecir la siguiente).
+    bool hayVistaAnterior = false;
+
+    long aciertos = 0, fallos = 0, expulsiones = 0, precargas = 0, precargasUsadas = 0;
+};
+CacheLadrillos *ladrillos = nullptr;    //Modelo fuera de núcleo (nulo si el modelo completo está en memoria).
+
+//Mediciones de una etapa del benchmark sobre una malla sintética.
+struct ResultadoBenchmark {
+    std::string etapa, malla;
+    std::string unidad;             //Qué procesa la etapa (bytes, vértices, caras o pixeles).
+    size_t caras;                   //Caras de la malla.
+    double elementos;               //Elementos (en "unidad") que se procesan en cada repetición.
+    std::vector<double> tiempos;    //Segundos de cada repetición.
+};
+
+//Tamaño que ocupaba cada cara cuando se copiaban sus tres posiciones, UVs, normales y vértices de dispositivo.
+const size_t bytesCaraSinIndices = 3 * (2 * sizeof(Eigen::Vector4f) + sizeof(Eigen::Vector2f) + sizeof(Eigen::Vector3f));
+
+//Cara ya proyectada a coordenadas de dispositivo junto con el cuadrilátero de pantalla que la engloba.
+//Sólo existe mientras se renderiza un frame.
+struct TrianguloPantalla {
+    uint32_t cara;                  //Índice de la cara en la malla.
+    Eigen::Vector3f vertDisp[3];    //Vértices en coordenadas de dispositivo (con el inverso de la profundidad).
+    Eigen::Vector2f vertProy[3];    //Vértices en coordenadas de cámara divididas entre la profundidad (x / -z, y / -z).
+    int xi, yi, xf, yf;
+    float zMin;                     //Profundidad del vértice más cercano.
+    int32_t recorte = -1;           //Índice en "recortes" si el triángulo salió de recortar la cara; -1 si no.
+};
+
+//Entrada del buffer de visibilidad: el último fragmento que pasó la prueba de profundidad en un pixel, con sus
+//coordenadas baricéntricas y su profundidad tal como las calculó el kernel, para sombrearlo igual que en un solo paso.
+struct Fragmento {
+    const TrianguloPantalla *triangulo; //Triángulo visible en el pixel (nulo si no hay ninguno).
+    float w0, w1, w2, z;
+};
+
+//Normales y coordenadas de textura de los vértices de un triángulo que se recortó en el plano cercano o lejano.
+//Esos vértices ya no son vértices de la malla, así que sus atributos se interpolan de los de la cara original.
+struct VerticesRecortados {
+    Eigen::Vector4f normal[3];
+    Eigen::Vector2f coordTex[3];
+};
+
+//Resultado de probar la esfera y el cono de un grupo de caras contra la cámara.
+enum { DESCARTE_NINGUNO, DESCARTE_FRUSTUM, DESCARTE_CONO };
+
+//Bits del código de recorte de un vértice: planos de la pirámide de visión de los que queda fuera.
+enum {
+    FUERA_IZQUIERDA = 1,
+    FUERA_DERECHA = 2,
+    FUERA_ABAJO = 4,
+    FUERA_ARRIBA = 8,
+    FUERA_CERCANO = 16,
+    FUERA_LEJANO = 32,
+};
+
+//Contadores de las etapas de vértices, BVH, descarte y recorte del último frame. Estas etapas corren en un solo hilo
+//(o, la de vértices, se cuenta completa), así que sus contadores no dependen de la instrumentación.
+struct EstadisticasRecorte {
+    long vertices = 0;          //Vértices transformados en la etapa de vértices.
+    long transformacionesEvitadas = 0;  //Transformaciones que se habrían hecho transformando los tres vértices de cada cara.
+    long meshlets = 0;          //Meshlets de las mallas dibujadas.
+    long meshletsFrustum = 0;   //Meshlets descartados en el BVH por quedar fuera de la pirámide de visión.
+    long meshletsCono = 0;      //Meshlets descartados en el BVH porque todas sus caras dan la espalda a la cámara.
+    long meshletsVisibles = 0;  //Meshlets que pasaron al ensamblado de triángulos.
+    long caras = 0;             //Caras que entraron a la etapa.
+    long fueraFrustum = 0;      //Caras con los tres vértices fuera de un mismo plano de la pirámide de visión.
+    long traseras = 0;          //Caras (o pedazos recortados) que dan la espalda a la cámara o no tienen área.
+    long recortadas = 0;        //Caras que cruzaban el plano cercano o lejano y se recortaron.
+    long fueraVentana = 0;      //Triángulos cuyo cuadrilátero quedó fuera de la ventana.
+    long dibujados = 0;         //Triángulos que se mandaron a rasterizar.
+};
+std::vector<VerticesRecortados> recortes;   //Atributos de los triángulos recortados del frame actual.
+EstadisticasRecorte estadisticasRecorte;    //Contadores de vértices, descarte y recorte del último frame.
+std::vector<Fragmento> bufferVisibilidad;   //Buffer de visibilidad del modo diferido, por renglones como el destino.
+Eigen::Matrix4f transformacionNormales = Eigen::Matrix4f::Identity();   //Transformación de las normales del frame actual.
+std::atomic<bool> cancelarFrame(false);     //Se activa si llega una entrada nueva mientras se renderiza: el frame ya no sirve.
+
+//Instrumentación del renderizador: contadores y temporizadores de etapa por hilo. Cada hilo sólo escribe en su entrada
+//de contadoresHilos (alineada a una línea de caché), así que el camino crítico no usa atómicos; al terminar el frame se
+//suman todas. Al compilar con -DSIN_INSTRUMENTACION, CONTAR y MEDIR_ETAPA no generan código.
+enum Contador {
+    CONTADOR_RASTERIZADOS,      //Pares triángulo-mosaico que se mandaron al kernel de rasterización.
+    CONTADOR_OCULTOS_HIZ,       //Pares triángulo-mosaico descartados completos por el buffer de profundidad jerárquico.
+    CONTADOR_BLOQUES_HIZ,       //Bloques que se quitaron del cuadrilátero de triángulos que sí se dibujaron.
+    CONTADOR_RECALCULOS_HIZ,    //Cotas de bloques sucios que se recalcularon.
+    CONTADOR_PIXELES_PROBADOS,  //Pixeles de los cuadriláteros en los que se evaluaron las edge functions.
+    CONTADOR_PROFUNDIDAD,       //Fragmentos que pasaron la prueba de profundidad.
+    CONTADOR_SOMBREADOS,        //Fragmentos sombreados.
+    CONTADOR_TEXELES,           //Texeles leídos por el filtro de la textura.
+    CONTADOR_FALLOS_TEXTURA,    //Texeles cuya línea de caché no estaba en el caché simulado del hilo.
+    NUM_CONTADORES
+};
+const char *nombresContadores[NUM_CONTADORES] = {"rasterizados", "ocultos_hiz", "bloques_hiz", "recalculos_hiz",
+                                                 "pixeles_probados", "profundidad", "sombreados", "texeles", "fallos_textura"};
+enum Etapa {ETAPA_VERTICES, ETAPA_BVH, ETAPA_BINNING, ETAPA_MOSAICOS, ETAPA_RASTERIZADO, ETAPA_SOMBREADO, NUM_ETAPAS};
+const char *nombresEtapas[NUM_ETAPAS] = {"vertices", "bvh", "binning", "mosaicos", "rasterizado", "sombreado"};
+struct EventoTraza {
+    int etapa;
+    int64_t inicio, duracion;   //Microsegundos desde que inició el programa.
+};
+struct alignas(64) ContadoresHilo {
+    long contadores[NUM_CONTADORES] = {};
+    double segundos[NUM_ETAPAS] = {};   //Tiempo que pasó el hilo en cada etapa durante el frame.
+    std::vector<EventoTraza> eventos;   //Etapas del frame para la traza (sólo si se pidió --traza).
+    uintptr_t lineasTextura[lineasCacheTextura] = {};   //Caché simulado de texturas: línea guardada en cada entrada.
+};
+std::vector<ContadoresHilo> contadoresHilos(1); //Una entrada por hilo del pool; el hilo que renderiza es el 0.
+thread_local int hiloActual = 0;                //Hilo del pool que está ejecutando (0 fuera del pool).
+const std::chrono::steady_clock::time_point inicioPrograma = std::chrono::steady_clock::now();
+std::ofstream archivoEstadisticas;  //Estadísticas de cada frame en JSON (--estadisticas).
+std::ofstream archivoTraza;         //Traza de eventos en el formato de Chrome (--traza).
+long numFrame = 0;                  //Frames terminados.
+
+#ifndef SIN_INSTRUMENTACION
+//Mide el tiempo desde su creación hasta el final de su bloque y lo suma a la etapa en los contadores del hilo.
+struct TemporizadorEtapa {
+    int etapa;
+    std::chrono::steady_clock::time_point inicio;
+
+    TemporizadorEtapa(int etapa) : etapa(etapa), inicio(std::chrono::steady_clock::now()) {}
+    ~TemporizadorEtapa() {
+        auto fin = std::chrono::steady_clock::now();
+        ContadoresHilo &hilo = contadoresHilos[hiloActual];
+        hilo.segundos[etapa] += std::chrono::duration<double>(fin - inicio).count();
+        if (archivoTraza.is_open()) {
+            hilo.eventos.push_back({etapa, std::chrono::duration_cast<std::chrono::microseconds>(inicio - inicioPrograma).count(),
+                                    std::chrono::duration_cast<std::chrono::microseconds>(fin - inicio).count()});
+        }
+    }
+};
+
+//Se cuenta la lectura de un texel y, si su línea de caché no estaba en el caché simulado del hilo (de correspondencia
+//directa, con lineasCacheTextura líneas de 64 bytes), un fallo. Así se compara el tráfico de memoria de la textura.
+inline void contarTexel(const void *texel) {
+    ContadoresHilo &hilo = contadoresHilos[hiloActual];
+    uintptr_t linea = uintptr_t(texel) >> 6;
+    uintptr_t &entrada = hilo.lineasTextura[linea % lineasCacheTextura];
+    hilo.contadores[CONTADOR_TEXELES]++;
+    if (entrada != linea) {
+        entrada = linea;
+        hilo.contadores[CONTADOR_FALLOS_TEXTURA]++;
+    }
+}
+#define CONTAR(contador, n) (contadoresHilos[hiloActual].contadores[contador] += (n))
+#define MEDIR_ETAPA(etapa) TemporizadorEtapa temporizador(etapa)
+#define CONTAR_TEXEL(texel) contarTexel(texel)
+#else
+#define CONTAR(contador, n) ((void) 0)
+#define MEDIR_ETAPA(etapa) ((void) 0)
+#define CONTAR_TEXEL(texel) ((void) 0)
+#endif
+
+//Buffer de profundidad jerárquico: una cota de la profundidad más lejana de cada bloque de tamBloqueHiZ x tamBloqueHiZ
+//pixeles del buffer de profundidad y de cada mosaico. La profundidad de un pixel sólo disminuye, así que una cota vieja
+//sigue siendo válida; cada bloque acumula los pixeles de los cuadriláteros que se rasterizaron sobre él y su cota se
+//recalcula cuando hace falta para descartar un triángulo y ya se rasterizó al menos el área del bloque.
+struct PiramideProfundidad {
+    int bloquesX = 0, bloquesY = 0;
+    std::vector<float> maxBloque;   //Cota de la profundidad más lejana de cada bloque, por renglones.
+    std::vector<uint16_t> sucio;    //Pixeles rasterizados en el bloque desde que se calculó su cota (saturado).
+    std::vector<float> maxMosaico;  //Máximo de las cotas de los bloques de cada mosaico.
+};
+PiramideProfundidad piramide;
+
+//Contadores del descarte con el buffer de profundidad jerárquico del último frame.
+struct EstadisticasHiZ {
+    long triangulos = 0;        //Pares triángulo-mosaico que se descartaron completos.
+    long bloques = 0;           //Bloques que se quitaron del cuadrilátero de triángulos que sí se dibujaron.
+    long recalculos = 0;        //Cotas de bloques sucios que se recalcularon.
+};
+
+//Buffer post-transformación: resultado de la etapa de vértices para cada vértice único de la malla.
+//Se calcula una vez por frame; el ensamblado de triángulos y la rasterización sólo leen de aquí.
+struct VerticesTransformados {
+    std::vector<float> xDisp, yDisp;    //Posición en coordenadas de dispositivo.
+    std::vector<float> invZ;            //Inverso de la profundidad en coordenadas de cámara (1 / -z).
+    std::vector<float> xProy, yProy;    //Posición en coordenadas de cámara dividida entre la profundidad.
+    std::vector<uint8_t> codigo;        //Código de recorte (bits FUERA_*) de cada vértice.
+    long transformacionesEvitadas = 0;  //Transformaciones de vértices que se ahorraron en el último frame.
+};
+
+//Vista de un lote (--lote): se dibuja completa en un solo hilo del pool, con su propio buffer de pixeles. Mientras un
+//hilo dibuja una vista, "vistaHilo" apunta a ella y el ensamblado y el sombreado usan sus recortes, estadísticas y
+//transformación de normales en lugar de los globales del frame.
+struct VistaLote {
+    Eigen::Matrix4f modeloVista;                //Matriz de la cámara por la del modelo.
+    Eigen::Matrix4f transformacionNormales;
+    std::string nombre;                         //Archivo en el que se guarda la imagen.
+    VerticesTransformados vertices;             //Etapa de vértices (se calcula junto con la de las demás vistas del grupo).
+    std::vector<VerticesRecortados> recortes;
+    EstadisticasRecorte estadisticas;
+    std::vector<uint32_t> pixeles;
+};
+thread_local VistaLote *vistaHilo = nullptr;    //Vista del lote que dibuja el hilo (nula fuera del lote).
+
+//Cola de mosaicos pendientes de un hilo. Cuando un hilo vacía la suya, roba mosaicos del final de las demás.
+struct ColaMosaicos {
+    std::mutex mutex;
+    std::deque<int> mosaicos;
+};
+
+//Pool de hilos persistentes que ejecutan la misma tarea en paralelo (el hilo principal es el hilo 0).
+struct PoolHilos {
+    std::vector<std::thread> hilos;
+    std::mutex mutex;
+    std::condition_variable hayTrabajo;     //Avisa a los hilos que hay una tarea nueva.
+    std::condition_variable terminoTrabajo; //Avisa al hilo principal que todos terminaron.
+    std::function<void(int)> tarea;         //Tarea actual; recibe el número de hilo.
+    long generacion = 0;                    //Número de tareas lanzadas (para detectar una nueva).
+    int pendientes = 0;                     //Hilos que no han terminado la tarea actual.
+    bool terminar = false;
+} pool;
+
+//Conjuntos de instrucciones para los que hay un kernel de rasterización.
+enum ISA { ISA_ESCALAR, ISA_SSE, ISA_AVX2 };
+const char *nombresISA[] = {"escalar", "sse", "avx2"};
+
+//Configuración del renderizador que la verificación compara contra el renderizador de referencia.
+struct VarianteVerificacion {
+    std::string nombre;
+    ISA isa;                        //Kernel de rasterización.
+    bool diferido, hiZ, frenteAtras;
+    bool fueraNucleo;               //Dibujar la malla desde su archivo de ladrillos.
+    bool lote;                      //Dibujar todas las poses juntas con renderizarVistas.
 };
 
+#ifndef SIN_X11
+//Estado de la vista que pide el hilo de eventos y dibuja el hilo de renderizado. Todas las entradas que llegan mientras
+//se renderiza un frame se combinan en este único estado objetivo.
+struct EstadoVista {
+    std::mutex mutex;
+    std::condition_variable cambio;     //Avisa al hilo de renderizado que el estado cambió.
+    Eigen::Matrix4f camara;             //Cámara objetivo.
+    Eigen::Matrix4f transformacion;     //Matriz del modelo objetivo.
+    long version = 0;                   //Número de cambios del estado (el hilo de renderizado dibuja la última versión).
+    long entradas = 0;                  //Entradas de teclado aplicadas al estado.
+    bool entradaPendiente = false;      //Hay entradas que todavía no se empiezan a renderizar.
+    std::chrono::steady_clock::time_point primeraEntrada;  //Momento de la más antigua de esas entradas.
+    bool redesplegar = false;           //Se descubrió la ventana y hay que volver a desplegar el último frame.
+    int anchoVentana, altoVentana;      //Tamaño de la ventana (cambia cuando el usuario la redimensiona).
+    float escala;                       //Escala de resolución de los frames sin movimiento.
+    bool resolucionDinamica;            //Ajustar la escala de los frames en movimiento a objetivoFrame.
+    bool terminar = false;
+} estadoVista;
+#endif
+
 //Representación de una luz.
 struct Luz {
     float Ka;           //Coeficiente ambiental.
@@ -60,37 +733,343 @@ struct Luz {
     Eigen::Vector4f posicion;   //Posición de la luz.
 };
 
+//Luces del sombreado empaquetadas por componente (SoA), con una entrada por luz en cada arreglo. Se arman una vez por
+//frame en prepararSombreado, con los coeficientes ya multiplicados por los colores y la luz ambiental de todas sumada.
+struct LucesSombreado {
+    int num = 0;
+    std::vector<float> x, y, z, w;                          //Posición.
+    std::vector<float> difusoR, difusoG, difusoB;           //Kd * CDifuso.
+    std::vector<float> especularR, especularG, especularB;  //Ke * CEspecular.
+    std::vector<float> brillantez;                          //Exponente especular (por 4 con Blinn-Phong).
+    std::vector<int> exponente;                             //El mismo exponente, si es entero.
+    Eigen::Vector3f ambiental;                              //Suma de Ka * CAmbiental.
+};
+LucesSombreado lucesSombreado;
+
+//Cómo se calcula la componente especular en una variante del sombreado: no se calcula (ninguna luz la tiene), con
+//multiplicaciones (todos los exponentes son enteros) o con std::pow.
+enum { ESPECULAR_NINGUNO, ESPECULAR_ENTERO, ESPECULAR_REAL };
+using SombreadorPixel = Color (*)(const Eigen::Vector4f &, const Eigen::Vector4f &, const Eigen::Vector2f &, float);
+
 //Prototipos de funciones.
-std::vector <Cara> OBJaModelo(std::string);
-Eigen::Vector4f leerVec3DeCadena(std::string);
-Cara obtenerPropiedadesCara(const std::string &, const std::vector<Eigen::Vector4f> &, const std::vector<Eigen::Vector4f> &);
-void generarUVs(std::vector<Cara> &);
+Malla cargarModelo(const std::string &, bool, bool);
+MallaOBJ OBJaModelo(std::string);
+void leerFragmentoOBJ(const char *, const char *, FragmentoOBJ &);
+bool leerEsquinaOBJ(const char *&, const char *, const FragmentoOBJ &, EsquinaOBJ &);
+void agregarAtributos(FragmentoOBJ &, DeduplicacionOBJ &);
+void resolverRelativos(FragmentoOBJ &, int32_t, int32_t, int32_t);
+bool agregarEsquinas(const std::vector<EsquinaOBJ> &, DeduplicacionOBJ &, MallaOBJ &);
+size_t bytesMalla(const Malla &);
+Eigen::Vector4f centroideCaras(const Malla &);
+void generarUVs(Malla &, const Eigen::Vector4f &);
+bool leerCache(const std::string &, bool, Malla &);
+Malla terminarModelo(const MallaOBJ &, const std::string &, bool, bool);
+std::unique_ptr<CargaProgresiva> iniciarCargaProgresiva(const std::string &, bool, bool, bool);
+void leerOBJPorLotes(CargaProgresiva *);
+size_t tomarLotes(CargaProgresiva &);
+Malla mallaParcial(const CargaProgresiva &);
+Malla terminarCargaProgresiva(CargaProgresiva &);
+void detenerCargaProgresiva(CargaProgresiva &);
+Malla empaquetarMalla(const MallaOBJ &);
+size_t bytesArreglo(const CabeceraMalla &, int);
+void asignarArreglos(Malla &);
+void construirMeshlets(Malla &);
+void reordenarMalla(Malla &);
+MedicionCacheVertices medirCacheVertices(const Malla &);
+uint32_t construirNodoBVH(const std::vector<Meshlet> &, std::vector<NodoBVH> &, uint32_t, uint32_t);
+LimitesMeshlet unirLimites(const LimitesMeshlet &, const LimitesMeshlet &);
+void seleccionarMeshlets(const Malla &, const Eigen::Matrix4f &, std::vector<uint32_t> &);
+int probarLimites(const LimitesMeshlet &, const Eigen::Matrix4f &);
+void ordenarMeshlets(const Malla &, const Eigen::Matrix4f &, std::vector<uint32_t> &);
+void iniciarNivelesDetalle(Malla &);
+void esperarNivelesDetalle(const Malla &);
+void detenerNivelesDetalle(const Malla &);
+Malla simplificarMalla(const Malla &, float, const std::atomic<bool> &);
+const Malla &elegirNivelDetalle(const Malla &, const Eigen::Matrix4f &, int, std::shared_ptr<const NivelDetalle> &);
+uint64_t sumaArchivo(const std::string &);
+bool abrirCache(const std::string &, const std::string &, const struct stat &, bool, Malla &);
+CacheLadrillos *abrirLadrillos(const std::string &, bool, size_t);
+bool validarLadrillos(CacheLadrillos &, const std::string &, const struct stat &, bool);
+bool construirLadrillos(const std::string &, const std::string &, const struct stat &, bool);
+std::shared_ptr<const Malla> obtenerLadrillo(CacheLadrillos &, uint32_t);
+std::shared_ptr<const Malla> leerLadrillo(CacheLadrillos &, uint32_t);
+bool reservarLadrillo(CacheLadrillos &, uint32_t, bool);
+void guardarLadrillo(CacheLadrillos &, uint32_t, const std::shared_ptr<const Malla> &);
+void hiloPrecarga(CacheLadrillos *);
+void cerrarLadrillos(CacheLadrillos *);
+void escribirCache(const std::string &, const std::string &, const struct stat &, const Malla &);
 void configurarVentana();
-void transformarModelo(std::vector<Cara> &, Eigen::Matrix4f);
-void renderizar(const std::vector<Cara>&, const std::vector<Luz>&, Eigen::Matrix4f, float **);
+bool renderizar(const Malla &, const std::vector<Luz>&, Eigen::Matrix4f, Eigen::Matrix4f, float *);
+bool renderizarReferencia(const Malla &, Eigen::Matrix4f, float *);
+bool renderizarMosaicos(const Malla &, Eigen::Matrix4f, float *, bool);
+bool renderizarLadrillos(CacheLadrillos &, const Eigen::Matrix4f &, float *);
+void renderizarVistas(const Malla &, const std::vector<Luz> &, std::vector<VistaLote> &);
+void dibujarVista(const Malla &, VistaLote &, float *);
+void iniciarFrame();
+void reportarFrame(std::chrono::steady_clock::time_point, std::chrono::steady_clock::time_point);
+bool abrirInstrumentacion(const std::string &, const std::string &);
+void cerrarInstrumentacion();
+#ifndef SIN_X11
+void hiloRenderizado(Malla &, const std::vector<Luz> &, CargaProgresiva *);
+void pedirCambio(const std::function<void(EstadoVista &)> &, bool = true);
+#endif
+bool proyectarCara(const Malla &, uint32_t, Eigen::Matrix4f, TrianguloPantalla &);
+void procesarVertices(const Malla &, const Eigen::Matrix4f &, VerticesTransformados &);
+void procesarVerticesLote(const Malla &, std::vector<VistaLote> &, size_t, size_t);
+inline void transformarVertice(const Malla &, const Eigen::Matrix4f &, uint32_t, VerticesTransformados &);
+int ensamblarTriangulo(const Malla &, const VerticesTransformados &, const Eigen::Matrix4f &, uint32_t, TrianguloPantalla *);
+int recortarCara(const Malla &, const Eigen::Matrix4f &, uint32_t, TrianguloPantalla *);
+uint8_t codigoRecorte(const Eigen::Vector4f &);
+bool calcularCuadrilatero(TrianguloPantalla &);
+void limpiarHiZ(int, int, int, int, int);
+void prepararHiZ(int);
+bool probarHiZ(const TrianguloPantalla &, int, float *, int &, int &, int &, int &, EstadisticasHiZ &);
+void marcarHiZ(int, int, int, int);
+void iniciarPool(int);
+void trabajadorPool(int);
+void ejecutarEnParalelo(const std::function<void(int)> &);
+void detenerPool();
 Eigen::Vector3f verticeADispositivo(Eigen::Vector4f, Eigen::Matrix4f);
-void dibujarMasCercano(Cara, const std::vector<Luz>&, Eigen::Matrix4f, float **, int, int, int, int);
+void dibujarMasCercano(const Malla &, const TrianguloPantalla &, float *, int, int, int, int);
+void sombrearFragmento(const Malla &, const TrianguloPantalla &, int, int, float, float, float, float);
+inline void escribirFragmento(const Malla &, const TrianguloPantalla &, int, int, float, float, float, float);
+void sombrearMosaico(const Malla &, int, int, int, int);
+ISA seleccionarISA(ISA);
+void rasterizarCaraEscalar(const Malla &, const TrianguloPantalla &, float *, int, int, int, int);
+void rasterizarCaraSSE(const Malla &, const TrianguloPantalla &, float *, int, int, int, int);
+void rasterizarCaraAVX2(const Malla &, const TrianguloPantalla &, float *, int, int, int, int);
 float edgeFunction(Eigen::Vector3f, Eigen::Vector3f, Eigen::Vector3f);
-Color obtenerColorPixel(Cara, const std::vector<Luz> &, Eigen::Vector4f, Eigen::Vector4f, Eigen::Vector2f);
+void prepararSombreado(const std::vector<Luz> &);
+template <int NumLuces> SombreadorPixel varianteSombreadoLuces(int, bool, bool);
+template <int NumLuces, int Especular> SombreadorPixel varianteSombreado(bool, bool);
+template <int NumLuces, int Especular, bool ConTextura, bool Blinn>
+Color obtenerColorPixel(const Eigen::Vector4f &, const Eigen::Vector4f &, const Eigen::Vector2f &, float);
+inline float potenciaEntera(float, int);
+Eigen::Vector3f muestrearTextura(Eigen::Vector2f, float);
+Eigen::Vector3f muestrearBilineal(const NivelTextura &, float, float);
+uint32_t leerTexel(const NivelTextura &, int, int);
+size_t direccionTexel(const NivelTextura &, int, int);
 void dibujarPuntoColor(int, int, float, float, float);
-void limpiarVentana();
+void crearFramebuffers();
+void destruirFramebuffers();
+void limpiarFramebuffer();
+void presentarFrame();
+void *reservarPlano(size_t);
+void ajustarDestino(float);
+void liberarDestino();
+void resolverDestino();
+void escalarImagen(const uint32_t *, int, int, int, uint32_t *, int, int);
+Eigen::Matrix4f matrizRotacion(char, float);
+int ejecutarGuion(Malla &, const std::vector<Luz> &, Eigen::Matrix4f, const std::string &, const std::string &, const std::string &, bool);
+bool guardarImagen(const std::string &, const std::string &, const uint32_t * = nullptr);
+bool cargarTexturaModelo(const std::string &, bool);
+bool decodificarImagen(const std::string &, int &, int &, std::vector<uint32_t> &);
+bool dimensionesTextura(int, int);
+bool decodificarPNG(const std::vector<uint8_t> &, int &, int &, std::vector<uint32_t> &);
+bool inflar(const uint8_t *, size_t, std::vector<uint8_t> &, size_t);
+bool construirHuffman(HuffmanInflado &, const uint8_t *, int);
+void construirMipmaps(const std::vector<uint32_t> &, int, int, bool);
+std::string generarOBJSintetico(const std::string &, int);
+float ruidoSuperficie(const Eigen::Vector3f &);
+void medirEtapa(std::vector<ResultadoBenchmark> &, const std::string &, const std::string &, size_t, double, const std::string &,
+                const std::function<void()> &, const std::function<void()> &);
+int ejecutarBenchmark(const std::vector<Luz> &, Eigen::Matrix4f, const std::string &, size_t, const std::string &);
+bool escribirResultados(const std::string &, const std::vector<ResultadoBenchmark> &, const std::string &);
+int ejecutarVerificacion(const std::vector<Luz> &, Eigen::Matrix4f, const std::string &, int, long, ISA);
+bool leerPPM(const std::string &, std::vector<uint32_t> &);
+long compararImagenes(const uint32_t *, const uint32_t *, int, int &, uint32_t *);
+
+//Kernel de rasterización elegido al iniciar según el conjunto de instrucciones del procesador.
+void (*rasterizarCara)(const Malla &, const TrianguloPantalla &, float *, int, int, int, int) = rasterizarCaraEscalar;
+
+//Variante del sombreado elegida al iniciar cada frame según las luces, la textura y el modelo especular.
+SombreadorPixel sombreadorPixel = nullptr;
 
 /** FUNCIÓN MAIN **/
 int main(int argc, char* argv[]) {
     //Si no se ingresaron los argumentos, termina el programa.
     if (argc < 2) {
-        std::cout << "Ingresa como argumento el archivo con extensión .obj a visualizar.\n";
+        std::cout << "Ingresa como argumento el archivo con extensión .obj a visualizar (o --benchmark o --verificar).\n";
         return -1;
     }
 
-    bool continuar = true;          //Bandera que indica si continuar el programa o no.
-    bool redibujar = true;          //Bandera que indica si hay que renderizar de nuevo o no.
-    std::vector<Cara> modelo;       //Vector con las propiedades de todas las caras del modelo.
+    //El modo benchmark no recibe un OBJ: genera sus propias mallas y escribe los resultados en un archivo JSON.
+    bool benchmark = std::string(argv[1]) == "--benchmark";
+    std::string salidaBenchmark = "benchmark.json";
+    size_t carasMaximas = 1000000;  //Caras de la malla más grande del benchmark.
+    int primeraOpcion = 2;
+    if (benchmark && argc > 2 && argv[2][0] != '-') {
+        salidaBenchmark = argv[2];
+        primeraOpcion = 3;
+    }
+
+    //La verificación tampoco: compara las imágenes de cada variante del renderizador con las de referencia.
+    bool verificar = std::string(argv[1]) == "--verificar";
+    std::string directorioVerificacion = "verificacion";
+    int tolerancia = 2;             //Diferencia máxima de un canal para que un pixel se considere igual.
+    long pixelesMaximos = 10;       //Pixeles distintos que se permiten en cada comparación (empates de profundidad).
+    if (verificar && argc > 2 && argv[2][0] != '-') {
+        directorioVerificacion = argv[2];
+        primeraOpcion = 3;
+    }
+
+    //Opciones del modo sin ventana.
+    std::string guion;              //Guion de cámara y rotaciones (si no está vacío, no se abre ventana).
+    std::string prefijoSalida = "frame";//Prefijo de las imágenes generadas sin ventana.
+    std::string formatoSalida = "png";  //Formato de las imágenes generadas sin ventana.
+    bool lote = false;                  //Renderizar juntos todos los frames del guion.
+    int hilos = std::max(1u, std::thread::hardware_concurrency());  //Hilos del rasterizador.
+    ISA isaMaxima = ISA_AVX2;           //Conjunto de instrucciones más ancho que se permite usar.
+    bool uvsArchivo = false;            //Usar las coordenadas de textura del OBJ en lugar del mapeo esférico.
+    bool usarCache = false;             //Leer y escribir el caché binario del modelo.
+    bool usarDetalle = true;            //Construir los niveles de detalle que se usan en movimiento.
+    bool usarProgresiva = true;         //Con ventana, dibujar el modelo mientras se lee el OBJ.
+    size_t limiteLadrillos = 0;         //Memoria para los ladrillos del modelo fuera de núcleo (0: cargar el modelo completo).
+    std::string estadisticas, traza;    //Archivos de estadísticas por frame y de traza de etapas (vacío: no se escriben).
+    bool usarTextura = true;            //Usar la textura del material del modelo (map_Kd) si tiene una.
+    bool texturaLineal = false;         //Guardar la textura por renglones en lugar de en mosaicos.
+    for (int i = primeraOpcion; i < argc; i++) {
+        std::string opcion = argv[i];
+        if (opcion == "--sin-ventana" && i + 1 < argc) {
+            guion = argv[++i];
+        }
+        else if (opcion == "--lote") {
+            lote = true;
+        }
+        else if (opcion == "--salida" && i + 1 < argc) {
+            prefijoSalida = argv[++i];
+        }
+        else if (opcion == "--formato" && i + 1 < argc) {
+            formatoSalida = argv[++i];
+        }
+        else if (opcion == "--hilos" && i + 1 < argc) {
+            hilos = std::max(1, atoi(argv[++i]));
+        }
+        else if (opcion == "--cache") {
+            usarCache = true;
+        }
+        else if (opcion == "--sin-lod") {
+            usarDetalle = false;
+        }
+        else if (opcion == "--sin-progresiva") {
+            usarProgresiva = false;
+        }
+        else if (opcion == "--fuera-nucleo" && i + 1 < argc) {
+            limiteLadrillos = size_t(std::max(1, atoi(argv[++i]))) << 20;
+        }
+        else if (opcion == "--estadisticas" && i + 1 < argc) {
+            estadisticas = argv[++i];
+        }
+        else if (opcion == "--traza" && i + 1 < argc) {
+            traza = argv[++i];
+        }
+        else if (opcion == "--tolerancia" && i + 1 < argc) {
+            tolerancia = std::max(0, atoi(argv[++i]));
+        }
+        else if (opcion == "--pixeles-max" && i + 1 < argc) {
+            pixelesMaximos = std::max(0L, atol(argv[++i]));
+        }
+        else if (opcion == "--caras-max" && i + 1 < argc) {
+            carasMaximas = std::max(10000L, atol(argv[++i]));
+        }
+        else if (opcion == "--sin-textura") {
+            usarTextura = false;
+        }
+        else if (opcion == "--textura-lineal") {
+            texturaLineal = true;
+        }
+        else if (opcion == "--filtro" && i + 1 < argc) {
+            std::string nombre = argv[++i];
+            if (nombre != "cercano" && nombre != "bilineal" && nombre != "trilineal") {
+                std::cout << "El filtro de textura debe ser cercano, bilineal o trilineal.\n";
+                return -1;
+            }
+            filtroTextura = nombre == "cercano" ? FILTRO_CERCANO : nombre == "bilineal" ? FILTRO_BILINEAL : FILTRO_TRILINEAL;
+        }
+        else if (opcion == "--uvs-archivo") {
+            uvsArchivo = true;
+        }
+        else if (opcion == "--diferido") {
+            usarDiferido = true;
+        }
+        else if (opcion == "--sin-hiz") {
+            usarHiZ = false;
+        }
+        else if (opcion == "--blinn") {
+            usarBlinn = true;
+        }
+        else if (opcion == "--reordenar") {
+            usarReordenamiento = true;
+        }
+        else if (opcion == "--frente-atras") {
+            ordenarFrenteAtras = true;
+        }
+        else if (opcion == "--referencia") {
+            usarReferencia = true;
+        }
+        else if (opcion == "--escala" && i + 1 < argc) {
+            escalaResolucion = atof(argv[++i]);
+            if (!(escalaResolucion >= escalaMinima && escalaResolucion <= 1)) {
+                std::cout << "La escala de resolución debe estar entre " << escalaMinima << " y 1.\n";
+                return -1;
+            }
+        }
+        else if (opcion == "--resolucion-dinamica" && i + 1 < argc) {
+            resolucionDinamica = true;
+            objetivoFrame = std::max(1.0, atof(argv[++i]));
+        }
+        else if (opcion == "--ventana" && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &anchoVen, &altoVen) != 2 || anchoVen < 1 || altoVen < 1 || anchoVen > 16384 || altoVen > 16384) {
+                std::cout << "El tamaño de la ventana debe ser ANCHOxALTO (por ejemplo, 800x600).\n";
+                return -1;
+            }
+        }
+        else if (opcion == "--isa" && i + 1 < argc) {
+            std::string nombre = argv[++i];
+            if (nombre != "escalar" && nombre != "sse" && nombre != "avx2") {
+                std::cout << "El conjunto de instrucciones debe ser escalar, sse o avx2.\n";
+                return -1;
+            }
+            isaMaxima = nombre == "escalar" ? ISA_ESCALAR : nombre == "sse" ? ISA_SSE : ISA_AVX2;
+        }
+        else {
+            std::cout << "Opción desconocida: '" << opcion << "'.\n";
+            return -1;
+        }
+    }
+    if (formatoSalida != "png" && formatoSalida != "ppm") {
+        std::cout << "El formato de salida debe ser png o ppm.\n";
+        return -1;
+    }
+    if (lote && (guion.empty() || usarReferencia || limiteLadrillos > 0)) {
+        std::cout << "El modo de lote necesita un guion (--sin-ventana) y el modelo completo en memoria, sin --referencia.\n";
+        return -1;
+    }
+    if (limiteLadrillos > 0 && usarReferencia) {
+        std::cout << "El renderizador de referencia no puede dibujar el modelo fuera de núcleo.\n";
+        return -1;
+    }
+#ifdef SIN_INSTRUMENTACION
+    if (!estadisticas.empty() || !traza.empty()) {
+        std::cout << "El programa se compiló sin instrumentación: no puede escribir estadísticas ni trazas.\n";
+        return -1;
+    }
+#endif
+#ifdef SIN_X11
+    if (guion.empty() && !benchmark && !verificar) {
+        std::cout << "El programa se compiló sin X11. Usa la opción --sin-ventana.\n";
+        return -1;
+    }
+#endif
+
+    if (!abrirInstrumentacion(estadisticas, traza)) {
+        return -1;
+    }
+
+    Malla modelo;                   //Malla indexada con los vértices y las caras del modelo.
     std::vector<Luz> luces;         //Vector con las luces.
-    float **bufferProf;             //Buffer (matriz) de profundidad.
     Eigen::Matrix4f camara;         //Matriz que representa la cámara en el espacio.
-    Eigen::Matrix4f transformacion; //Matriz con las transformaciones que se aplicarán al modelo.
-    Eigen::Matrix4f noTransformacion;//Matriz que representa ninguna transformación.
+    Eigen::Matrix4f transformacion; //Matriz del modelo: acumula las rotaciones sin modificar la malla.
     
     //Inicialización de luces.
     Luz luz{1.0f, 1.0f, 1.0f, 5.0f,             //Ka, Kd, Ke, brillantez.     
@@ -114,22 +1093,67 @@ int main(int argc, char* argv[]) {
                 0.0, 0.0, 1.0, -5.0,
                 0.0, 0.0, 0.0, 1.0;
 
-    noTransformacion << 1.0, 0.0, 0.0, 0.0,
-                        0.0, 1.0, 0.0, 0.0,
-                        0.0, 0.0, 1.0, 0.0,
-                        0.0, 0.0, 0.0, 1.0;
-    transformacion = noTransformacion;
+    transformacion = Eigen::Matrix4f::Identity();
+
+    //Creación del destino de render (buffers de profundidad y de color). La verificación siempre dibuja a la resolución
+    //de la ventana, porque compara pixel por pixel.
+    ajustarDestino(verificar ? 1 : escalaResolucion);
+
+    //Se crean los hilos (que también leen el OBJ en paralelo) y se elige el kernel del rasterizador.
+    iniciarPool(hilos);
+    ISA isa = seleccionarISA(isaMaxima);
+    if (!usarReferencia) {
+        std::cout << "Rasterizando con " << numHilos << " hilo(s) y el kernel " << nombresISA[isa] << ".\n";
+    }
+    if (benchmark) {
+        int resultado = ejecutarBenchmark(luces, camara, salidaBenchmark, carasMaximas, nombresISA[isa]);
+        detenerPool();
+        cerrarInstrumentacion();
+        liberarDestino();
+        return resultado;
+    }
+    if (verificar) {
+        int resultado = ejecutarVerificacion(luces, camara, directorioVerificacion, tolerancia, pixelesMaximos, isa);
+        detenerPool();
+        cerrarInstrumentacion();
+        liberarDestino();
+        return resultado;
+    }
+
+    //Si el material del modelo tiene textura, se usa en lugar del checker, con las coordenadas de textura del OBJ.
+    if (usarTextura && cargarTexturaModelo(argv[1], texturaLineal)) {
+        uvsArchivo = true;
+    }
 
-    //Creación del buffer de profundidad. 
-    bufferProf = new float *[altoVen];
-    for (int i = 0; i < altoVen; i++) {
-        bufferProf[i] = new float[anchoVen]; 
+    //Carga del modelo (del caché binario si se pidió y sigue vigente) y generación de UVs. Con ventana y sin caché, el OBJ
+    //se lee en otro hilo mientras se abre la ventana y el hilo de renderizado dibuja las caras que van llegando.
+    //Fuera de núcleo no se carga el modelo: el renderizador lee del archivo de ladrillos sólo los que se ven.
+    std::unique_ptr<CargaProgresiva> carga;
+    if (limiteLadrillos > 0) {
+        ladrillos = abrirLadrillos(argv[1], uvsArchivo, limiteLadrillos);
+    }
+    else if (guion.empty() && usarProgresiva && !(usarCache && leerCache(argv[1], uvsArchivo, modelo))) {
+        carga = iniciarCargaProgresiva(argv[1], usarCache, uvsArchivo, usarDetalle);
+    }
+    else if (!modelo.bloque) {
+        modelo = cargarModelo(argv[1], usarCache, uvsArchivo);
     }
 
-    //Carga del modelo y generación de UVs.    
-    modelo = OBJaModelo(argv[1]);
-    generarUVs(modelo);
+    //En el modo sin ventana se ejecuta el guion y termina el programa sin tocar X11. Ahí los niveles de detalle sólo se
+    //construyen si el guion los pide.
+    if (!guion.empty()) {
+        int resultado = ejecutarGuion(modelo, luces, camara, guion, prefijoSalida, formatoSalida, lote);
+        detenerNivelesDetalle(modelo);
+        if (ladrillos != nullptr) {
+            cerrarLadrillos(ladrillos);
+        }
+        detenerPool();
+        cerrarInstrumentacion();
+        liberarDestino();
+        return resultado;
+    }
 
+#ifndef SIN_X11
     //Configuración inicial de la ventana.
     configurarVentana();
     
@@ -140,78 +1164,111 @@ int main(int argc, char* argv[]) {
     std::cout << " - Presiona la tecla E para alejar la cámara al modelo.\n";
     std::cout << " - Presiona las teclas I, J, K o L para rotar el modelo\n";
     std::cout << "   10° sobre los ejes X+, Y+, X- y Y-, respectivamente.\n";
+    std::cout << " - Presiona las teclas Z o X para bajar o subir la escala de resolución.\n";
+    std::cout << " - Presiona la tecla C para activar o desactivar la resolución dinámica.\n";
     std::cout << " - Presiona la tecla ESC para terminar el programa.\n";
     std::cout << " - Presiona cualquier otra tecla para desplegar estas instrucciones.\n";
     
-    //Bucle para capturar eventos y redibujar la pantalla
+    //Los niveles de detalle se construyen en segundo plano; mientras tanto se renderiza con la malla completa.
+    //Con la carga progresiva, el hilo de renderizado los empieza a construir cuando termina de cargar el modelo.
+    if (usarDetalle && !carga) {
+        iniciarNivelesDetalle(modelo);
+    }
+
+    //El hilo de renderizado dibuja el estado objetivo de la vista; este hilo sólo atiende los eventos de X11, así que
+    //la ventana sigue respondiendo mientras se renderiza.
+    estadoVista.camara = camara;
+    estadoVista.transformacion = transformacion;
+    estadoVista.version = 1;
+    estadoVista.anchoVentana = anchoVen;
+    estadoVista.altoVentana = altoVen;
+    estadoVista.escala = escalaResolucion;
+    estadoVista.resolucionDinamica = resolucionDinamica;
+    std::thread renderizador(hiloRenderizado, std::ref(modelo), std::cref(luces), carga.get());
+
+    //Bucle para capturar eventos y pedir cambios al hilo de renderizado.
+    bool continuar = true;          //Bandera que indica si continuar el programa o no.
     while (continuar) {
-        if (redibujar) {                                    //Si hay que renderizar nuevamente.
-            std::cout << "La cámara está en la posición (" << -camara(0, 3) << ", " << -camara(1, 3) << ", " << -camara(2, 3)<< ").\n";
-            limpiarVentana();                               //Se pinta la ventana de negro.
-            transformarModelo(modelo, transformacion);      //Se aplican transformaciones al modelo.
-            renderizar(modelo, luces, camara, bufferProf);  //Se renderiza el modelo.
-            transformacion = noTransformacion;              //Se reinicia la matriz de transformaciones.
-        }
-        redibujar = true;
-        
         //Captura y procesamiento de evento de teclado.
         XNextEvent(display, &event);
-        if (event.type == KeyPress) {
+        if (event.type == Expose) {
+            //Si se descubrió la ventana, basta con volver a desplegar el último frame.
+            if (event.xexpose.count == 0) {
+                std::lock_guard<std::mutex> lock(estadoVista.mutex);
+                estadoVista.redesplegar = true;
+                estadoVista.cambio.notify_one();
+            }
+        }
+        else if (event.type == ConfigureNotify) {
+            //La ventana se movió o cambió de tamaño; sólo el tamaño necesita un frame nuevo.
+            int ancho = event.xconfigure.width, alto = event.xconfigure.height;
+            bool cambio;
+            {
+                std::lock_guard<std::mutex> lock(estadoVista.mutex);
+                cambio = ancho != estadoVista.anchoVentana || alto != estadoVista.altoVentana;
+            }
+            if (cambio && ancho > 0 && alto > 0) {
+                pedirCambio([=](EstadoVista &e) { e.anchoVentana = ancho; e.altoVentana = alto; }, false);
+            }
+        }
+        else if (event.type == KeyPress) {
             switch (event.xkey.keycode) {    
                 case 9:     //ESC = Salir del programa.
                     continuar = false;
                     break;
                 case 24:    //Q = Mover cámara hacia afuera.
                     std::cout << "\nSe desplazó la cámara 0.5 unidades sobre el eje Z.\n";
-                    camara(2, 3) -= 0.5f; 
+                    pedirCambio([](EstadoVista &e) { e.camara(2, 3) -= 0.5f; });
                     break;
                 case 26:    //E = Mover cámara hacia el fondo.
                     std::cout << "\nSe desplazó la cámara -0.5 unidades sobre el eje Z.\n";
-                    camara(2, 3) += 0.5f;
+                    pedirCambio([](EstadoVista &e) { e.camara(2, 3) += 0.5f; });
                     break;
                 case 25:    //W = Mover cámara hacia arriba.
                     std::cout << "\nSe desplazó la cámara 0.5 unidades sobre el eje Y.\n";
-                    camara(1, 3) -= 0.5f; 
+                    pedirCambio([](EstadoVista &e) { e.camara(1, 3) -= 0.5f; });
                     break;
                 case 38:    //A = Mover cámara hacia la izquierda.
                     std::cout << "\nSe desplazó la cámara -0.5 unidades sobre el eje X.\n";
-                    camara(0, 3) += 0.5f; 
+                    pedirCambio([](EstadoVista &e) { e.camara(0, 3) += 0.5f; });
                     break;
                 case 39:    //S = Mover cámara hacia abajo.
                     std::cout << "\nSe desplazó la cámara -0.5 unidades sobre el eje Y.\n";
-                    camara(1, 3) += 0.5f; 
+                    pedirCambio([](EstadoVista &e) { e.camara(1, 3) += 0.5f; });
                     break;
                 case 40:    //D = Mover cámara hacia la derecha.
                     std::cout << "\nSe desplazó la cámara 0.5 unidades sobre el eje X.\n";
-                    camara(0, 3) -= 0.5f; 
+                    pedirCambio([](EstadoVista &e) { e.camara(0, 3) -= 0.5f; });
                     break;
                 case 31:    //I = Rotar modelo sobre X+
                     std::cout << "\nSe rotó el modelo 10° sobre el eje X+.\n";
-                    transformacion(1, 1) = cos(10*(M_PI/180));
-                    transformacion(1, 2) = sin(10*(M_PI/180)); 
-                    transformacion(2, 1) = -sin(10*(M_PI/180));
-                    transformacion(2, 2) = cos(10*(M_PI/180));
+                    pedirCambio([](EstadoVista &e) { e.transformacion = matrizRotacion('x', 10) * e.transformacion; });
                     break;
                 case 44:    //J = Rotar modelo sobre Y+
                     std::cout << "\nSe rotó el modelo 10° sobre el eje Y+.\n";
-                    transformacion(0, 0) = cos(10*(M_PI/180));
-                    transformacion(0, 2) = sin(10*(M_PI/180)); 
-                    transformacion(2, 0) = -sin(10*(M_PI/180));
-                    transformacion(2, 2) = cos(10*(M_PI/180));
+                    pedirCambio([](EstadoVista &e) { e.transformacion = matrizRotacion('y', 10) * e.transformacion; });
                     break;
                 case 45:    //K = Rotar modelo sobre X-
                     std::cout << "\nSe rotó el modelo 10° sobre el eje X-.\n";
-                    transformacion(1, 1) = cos(-10*(M_PI/180));
-                    transformacion(1, 2) = sin(-10*(M_PI/180)); 
-                    transformacion(2, 1) = -sin(-10*(M_PI/180));
-                    transformacion(2, 2) = cos(-10*(M_PI/180));
+                    pedirCambio([](EstadoVista &e) { e.transformacion = matrizRotacion('x', -10) * e.transformacion; });
                     break;
                 case 46:    //posRelLuz = Rotar modelo sobre Y-
                     std::cout << "\nSe rotó el modelo 10° sobre el eje Y-.\n";
-                    transformacion(0, 0) = cos(-10*(M_PI/180));
-                    transformacion(0, 2) = sin(-10*(M_PI/180)); 
-                    transformacion(2, 0) = -sin(-10*(M_PI/180));
-                    transformacion(2, 2) = cos(-10*(M_PI/180));
+                    pedirCambio([](EstadoVista &e) { e.transformacion = matrizRotacion('y', -10) * e.transformacion; });
+                    break;
+                case 52:    //Z = Bajar la escala de resolución.
+                case 53:    //X = Subir la escala de resolución.
+                    pedirCambio([](EstadoVista &e) {
+                        e.escala = std::min(1.0f, std::max(escalaMinima, e.escala + (event.xkey.keycode == 52 ? -0.25f : 0.25f)));
+                        std::cout << "\nLa escala de resolución ahora es " << e.escala << ".\n";
+                    }, false);
+                    break;
+                case 54:    //C = Activar o desactivar la resolución dinámica.
+                    pedirCambio([](EstadoVista &e) {
+                        e.resolucionDinamica = !e.resolucionDinamica;
+                        std::cout << "\nSe " << (e.resolucionDinamica ? "activó" : "desactivó") << " la resolución dinámica (objetivo de "
+                                  << objetivoFrame << " ms por frame).\n";
+                    }, false);
                     break;
                 default:
                     std::cout << "\nINSTRUCCIONES DE USO DEL PROGRAMA:\n"; 
@@ -221,421 +1278,5007 @@ int main(int argc, char* argv[]) {
                     std::cout << " - Presiona la tecla E para alejar la cámara al modelo.\n";
                     std::cout << " - Presiona las teclas I, J, K o L para rotar el modelo\n";
                     std::cout << "   10° sobre los ejes X+, Y+, X- y Y-, respectivamente.\n";
+                    std::cout << " - Presiona las teclas Z o X para bajar o subir la escala de resolución.\n";
+                    std::cout << " - Presiona la tecla C para activar o desactivar la resolución dinámica.\n";
                     std::cout << " - Presiona la tecla ESC para terminar el programa.\n";
                     std::cout << " - Presiona cualquier otra tecla para desplegar estas instrucciones.\n";
-                    redibujar = false;
                     break;
             }
         }
     }
 
-    //Se elimina el buffer de profundidad.
-    for (int i = 0; i < altoVen; i++) {
-        delete [] bufferProf[i];
+    //Se cancela el frame en curso y se espera al hilo de renderizado.
+    {
+        std::lock_guard<std::mutex> lock(estadoVista.mutex);
+        estadoVista.terminar = true;
+        cancelarFrame = true;
+        estadoVista.cambio.notify_one();
     }
-    delete [] bufferProf;
+    renderizador.join();
+    if (carga) {
+        detenerCargaProgresiva(*carga);
+    }
+    detenerNivelesDetalle(modelo);
+    if (ladrillos != nullptr) {
+        cerrarLadrillos(ladrillos);
+    }
+
+    detenerPool();
+    cerrarInstrumentacion();
+
+    //Se elimina el destino de render.
+    liberarDestino();
 
+    destruirFramebuffers();
     XCloseDisplay(display);
+#endif
 
     return 0;    
 }
 /* TERMINA FUNCIÓN MAIN */
 
-//Se abre el OBJ nombre_archivo y se regresa un vector con las propiedades de las caras.
-std::vector <Cara> OBJaModelo(std::string nombre_archivo) {
-    std::string linea;      //Linea leída del archivo.
-    std::vector<Eigen::Vector4f> vertices;  //Vector con los vértices leídos.
-    std::vector<Eigen::Vector2f> coord_tex; //Vector con las coordenadas UV (de textura) leídas.
-    std::vector<Eigen::Vector4f> normales;  //Vector con las normales leídas.
-    std::ifstream archivo;   //Archivo OBJ con los puntos.
-    std::vector <Cara> caras;
+//Se abre el OBJ nombre_archivo y se regresa la malla indexada del modelo.
+//El archivo se mapea a memoria y se divide en fragmentos de líneas completas que se leen en paralelo; después se
+//resuelven los índices negativos (relativos) y se deduplican los vértices en el orden en que aparecen en el archivo.
+MallaOBJ OBJaModelo(std::string nombre_archivo) {
+    MallaOBJ malla;         //Malla que se construye.
+    struct stat info;       //Información del archivo (tamaño).
+    auto inicio = std::chrono::steady_clock::now();
 
     //Apertura y validación de apertura del archivo.
-    archivo.open(nombre_archivo, std::ios::in); 
-    if (!archivo.is_open()) {
+    int descriptor = open(nombre_archivo.c_str(), O_RDONLY);
+    if (descriptor < 0 || fstat(descriptor, &info) != 0 || info.st_size == 0) {
         std::cout << "No se pudo abrir el archivo '" << nombre_archivo << "'." << std::endl;
         std::cout << "Probablemente el nombre y/o extensión es incorrecto." << std::endl;
         exit(-1);
     }
     std::cout << "Cargando el archivo '" << nombre_archivo << "'.\n";
-    
-    while (std::getline(archivo, linea)) {              //Mientras haya líneas por leer, se toma una.
-        if (linea[0] == 'v') {                          //Si la línea empieza con "v"
-            if (linea[1] == 'n') {                      //Si la línea es una normal, se obtiene su valor.
-                normales.push_back(leerVec3DeCadena(linea));
-            }
-            else if (linea[1] == ' ') {                 //Si la línea es un vértice, se obtiene su valor.
-                vertices.push_back(leerVec3DeCadena(linea));
-            }
-        }
-        else if(linea[0] == 'f') {   //Si la línea es una cara, se obtienen sus propiedades.
-            caras.push_back(obtenerPropiedadesCara(linea, vertices, normales)); 
+    size_t tamano = info.st_size;
+    const char *datos = (const char *) mmap(NULL, tamano, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (datos == MAP_FAILED) {
+        std::cout << "No se pudo mapear el archivo '" << nombre_archivo << "' a memoria." << std::endl;
+        exit(-1);
+    }
+    madvise((void *) datos, tamano, MADV_SEQUENTIAL);
+
+    //Se divide el archivo en un fragmento por hilo, moviendo cada corte al final de su línea.
+    std::vector<const char *> cortes = {datos};
+    for (int i = 1; i < numHilos; i++) {
+        const char *corte = std::max(cortes.back(), datos + tamano * i / numHilos);
+        const char *finLinea = (const char *) memchr(corte, '\n', datos + tamano - corte);
+        cortes.push_back(finLinea ? finLinea + 1 : datos + tamano);
+    }
+    cortes.push_back(datos + tamano);
+    std::vector<FragmentoOBJ> fragmentos(numHilos);
+    ejecutarEnParalelo([&](int hilo) {
+        leerFragmentoOBJ(cortes[hilo], cortes[hilo + 1], fragmentos[hilo]);
+    });
+    munmap((void *) datos, tamano);
+
+    //Se juntan los atributos de todos los fragmentos y se guarda el desplazamiento de cada fragmento.
+    DeduplicacionOBJ dedup;
+    std::vector<int32_t> despV(numHilos), despT(numHilos), despN(numHilos);
+    size_t carasSinNormal = 0;
+    for (int f = 0; f < numHilos; f++) {
+        despV[f] = dedup.posiciones.size() / 3;
+        despT[f] = dedup.coordTex.size() / 2;
+        despN[f] = dedup.normales.size() / 3;
+        agregarAtributos(fragmentos[f], dedup);
+        carasSinNormal += fragmentos[f].carasSinNormal;
+    }
+
+    //Se resuelven en paralelo los índices relativos de cada fragmento.
+    ejecutarEnParalelo([&](int f) {
+        resolverRelativos(fragmentos[f], despV[f], despT[f], despN[f]);
+    });
+
+    //Deduplicación de los vértices, en el orden de los fragmentos.
+    size_t numEsquinas = 0;
+    for (const FragmentoOBJ &fragmento : fragmentos) {
+        numEsquinas += fragmento.esquinas.size();
+    }
+    malla.indices.reserve(numEsquinas);
+    for (FragmentoOBJ &fragmento : fragmentos) {
+        if (!agregarEsquinas(fragmento.esquinas, dedup, malla)) {
+            std::cout << "El archivo '" << nombre_archivo << "' tiene una cara con índices fuera de rango." << std::endl;
+            exit(-1);
         }
+        std::vector<EsquinaOBJ>().swap(fragmento.esquinas);
     }
-    archivo.close();
-    std::cout << "El modelo se cargó con éxito.\n";
-    return caras;
-}
+    malla.uvsArchivo = dedup.todasConUV && !malla.indices.empty();
 
-//Se convierte una línea (cadena) del archivo a un punto en 3D con coordenadas homogéneas.
-//Con esto se leen vértices y normales en el OBJ.
-Eigen::Vector4f leerVec3DeCadena(std::string cadena) {
-    Eigen::Vector4f punto;  //Punto recuperado.
-    std::string numero;     //Cadena que se va a convertir a float.
-    char caracter;          //Caracter leído.
-    int coord = 0;          //Coordenada (X, Y, Z) que se está leyendo
-    
-    if (std::sscanf(cadena.c_str(), "vn %f %f %f", &punto[0], &punto[1], &punto[2]) != 3) {
-        std::sscanf(cadena.c_str(), "v %f %f %f", &punto[0], &punto[1], &punto[2]);
+    double segundos = std::chrono::duration<double>(std::chrono::steady_clock::now() - inicio).count();
+    std::cout << "El modelo se cargó con éxito: " << malla.indices.size() / 3 << " caras y " << malla.px.size() << " vértices únicos.\n";
+    std::cout << "Se leyeron " << tamano / 1e6 << " MB en " << segundos << " s (" << tamano / 1e6 / segundos << " MB/s).\n";
+    if (carasSinNormal > 0) {
+        std::cout << "Se ignoraron " << carasSinNormal << " caras sin normales.\n";
     }
-    punto[3] = 1.0f;   //Se agrega la coordenada homogénea.
+    return malla;
+}
 
-    return punto;
+//Se pasan los atributos (v, vt, vn) del fragmento a la deduplicación y se libera su memoria en el fragmento.
+void agregarAtributos(FragmentoOBJ &fragmento, DeduplicacionOBJ &dedup) {
+    dedup.posiciones.insert(dedup.posiciones.end(), fragmento.posiciones.begin(), fragmento.posiciones.end());
+    dedup.coordTex.insert(dedup.coordTex.end(), fragmento.coordTex.begin(), fragmento.coordTex.end());
+    dedup.normales.insert(dedup.normales.end(), fragmento.normales.begin(), fragmento.normales.end());
+    dedup.primero.resize(dedup.posiciones.size() / 3, NINGUNO);
+    std::vector<float>().swap(fragmento.posiciones);
+    std::vector<float>().swap(fragmento.coordTex);
+    std::vector<float>().swap(fragmento.normales);
 }
 
-//Se toma una línea (cadena) del OBJ que representa una cara, un vector de vértices, uno de UVs y uno normales
-//y se regresa una estructura con las propiedades correspondientes a esa cara.
-Cara obtenerPropiedadesCara(const std::string &cadena, const std::vector<Eigen::Vector4f> &vertices, const std::vector<Eigen::Vector4f> &normales) {
-    Cara cara;              //Contiene las propiedades de la cara obtenida.
-    int i_vert = 0;              //Índice que representa el número de vértice actual.
-    int iv = 0, it = 0, in = 0;     //Índice de la coordenada de vértice, textura y normal.
-    std::vector<int> indices;   //Vector con los índices obtenidos por cada línea.
-    std::stringstream cadena_aux(cadena);   //Cadena auxiliar para particionar la original por tokens.
-    std::string subcadena;      //Cadena obtenida de particionar cadena_aux;
+//Se convierten los índices relativos del fragmento en absolutos, sabiendo cuántas posiciones, coordenadas de textura y
+//normales hay en el archivo antes de él.
+void resolverRelativos(FragmentoOBJ &fragmento, int32_t despV, int32_t despT, int32_t despN) {
+    for (EsquinaOBJ &esquina : fragmento.esquinas) {
+        if (esquina.banderas & ESQUINA_V_RELATIVA) esquina.v += despV;
+        if (esquina.banderas & ESQUINA_T_RELATIVA) esquina.t += despT;
+        if (esquina.banderas & ESQUINA_N_RELATIVA) esquina.n += despN;
+    }
+}
 
-    getline(cadena_aux, subcadena, ' ');            //Se ignora la primer subcadena, que es la letra F.
-    while(getline(cadena_aux, subcadena, ' ')) {    //Se tokeniza la cadena por espacios, para obtener las propiedades de cada vértice.
-        if (std::sscanf(subcadena.c_str(), "%i/%i/%i", &iv, &it, &in) != 3) {
-            std::sscanf(subcadena.c_str(), "%i//%i", &iv, &in);
+//Se agregan a la malla las caras de "esquinas" (con índices ya absolutos): cada combinación nueva de posición, textura
+//y normal se vuelve un vértice de la malla. Regresa falso si alguna esquina usa un atributo que no se ha leído.
+bool agregarEsquinas(const std::vector<EsquinaOBJ> &esquinas, DeduplicacionOBJ &dedup, MallaOBJ &malla) {
+    for (const EsquinaOBJ &esquina : esquinas) {
+        int32_t t = (esquina.banderas & ESQUINA_CON_T) ? esquina.t : -1;
+        if (esquina.v < 0 || size_t(esquina.v) >= dedup.primero.size() || esquina.n < 0 || size_t(esquina.n) >= dedup.normales.size() / 3 ||
+            ((esquina.banderas & ESQUINA_CON_T) && (t < 0 || size_t(t) >= dedup.coordTex.size() / 2))) {
+            return false;
         }
+        dedup.todasConUV = dedup.todasConUV && t >= 0;
 
-        if (iv < 0) {
-            iv = vertices.size() + iv+1;
+        uint32_t vertice = dedup.primero[esquina.v];
+        while (vertice != NINGUNO && (dedup.claveT[vertice] != t || dedup.claveN[vertice] != esquina.n)) {
+            vertice = dedup.siguiente[vertice];
         }
-        if (in < 0) {
-            in = normales.size() + in+1;
+        //Si la combinación (posición, textura, normal) no se había usado, se agrega un vértice nuevo a la malla.
+        if (vertice == NINGUNO) {
+            const std::vector<float> &posiciones = dedup.posiciones, &normales = dedup.normales, &coordTex = dedup.coordTex;
+            vertice = malla.px.size();
+            Eigen::Vector4f normal = Eigen::Vector4f(normales[3*esquina.n], normales[3*esquina.n + 1], normales[3*esquina.n + 2], 1.0f).normalized();
+            malla.px.push_back(posiciones[3*esquina.v]);
+            malla.py.push_back(posiciones[3*esquina.v + 1]);
+            malla.pz.push_back(posiciones[3*esquina.v + 2]);
+            malla.nx.push_back(normal.x());
+            malla.ny.push_back(normal.y());
+            malla.nz.push_back(normal.z());
+            malla.nw.push_back(normal.w());
+            malla.u.push_back(t >= 0 ? coordTex[2*t] : 0.0f);
+            malla.v.push_back(t >= 0 ? coordTex[2*t + 1] : 0.0f);
+            dedup.claveT.push_back(t);
+            dedup.claveN.push_back(esquina.n);
+            dedup.siguiente.push_back(dedup.primero[esquina.v]);
+            dedup.primero[esquina.v] = vertice;
         }
-
-        cara.vertice[i_vert] = vertices[iv-1];
-        cara.normal[i_vert] = normales[in-1].normalized();
-        
-        i_vert ++;
-        indices.clear();  
-    } 
-    return cara;
+        malla.indices.push_back(vertice);
+    }
+    return true;
 }
 
-//Se toma el vector de caras que representa al modelo y se generan sus coordenadas de textura UV utilizando un mapeo esférico.
-void generarUVs(std::vector<Cara> &modelo) {
-    Eigen::Vector4f centroideModelo(0,0,0,0);//Centroide del modelo.
-    Eigen::Vector4f vecCentVert;             //Vector que va del centro del modelo al vértice.
-
-    //Se calcula el centroide del modelo como el promedio de todos los vértices.
-    for (int i = 0; i < modelo.size(); i++) {
-        centroideModelo += modelo[i].vertice[0];
-        centroideModelo += modelo[i].vertice[1];
-        centroideModelo += modelo[i].vertice[2];
+//Se avanza "p" sobre los espacios y tabuladores de la línea (y el retorno de carro de los archivos de Windows).
+inline void saltarEspacios(const char *&p, const char *fin) {
+    while (p < fin && (*p == ' ' || *p == '\t' || *p == '\r')) {
+        p++;
     }
-    centroideModelo /= modelo.size() * 3;
-    
-    //Se generan las UVs en cada vértice haciendo un mapeo esférico.
-    for (int i = 0; i < modelo.size(); i++) {
-        for (int j = 0; j < 3; j ++) {
-            vecCentVert = (centroideModelo - modelo[i].vertice[j]).normalized();
-            modelo[i].coord_tex[j].x() = 0.5 + atan2(vecCentVert.z(), vecCentVert.x()) / (2*M_PI);
-            modelo[i].coord_tex[j].y() = 0.5 - asin(vecCentVert.y()) / M_PI;
+}
+
+//Se leen "n" floats de la línea y se agregan a "salida". Los que falten se toman como cero.
+inline void leerFloats(const char *&p, const char *fin, int n, std::vector<float> &salida) {
+    for (int i = 0; i < n; i++) {
+        float valor = 0.0f;
+        saltarEspacios(p, fin);
+        if (p < fin && *p == '+') {     //from_chars no acepta el signo positivo.
+            p++;
         }
+        std::from_chars_result resultado = std::from_chars(p, fin, valor);
+        if (resultado.ec == std::errc()) {
+            p = resultado.ptr;
+        }
+        salida.push_back(valor);
     }
 }
 
-//Función para configurar la ventana y los eventos de teclado de X11.
-void configurarVentana() {
-    //Apertura del display.
-    display = XOpenDisplay(0);
-    if (display == NULL) {
-        std::cout << "No se pudo conectar a X server." << std::endl;
-        exit(-1);
-    }
+//Se leen las líneas del fragmento [inicio, fin) del OBJ, que empieza y termina en un límite de línea.
+void leerFragmentoOBJ(const char *inicio, const char *fin, FragmentoOBJ &fragmento) {
+    std::vector<EsquinaOBJ> poligono;   //Esquinas de la cara actual (se reutiliza entre líneas).
+    EsquinaOBJ esquina;
+    const char *p = inicio;
 
-    //Creación de la ventana.
-    win = XCreateSimpleWindow(display, DefaultRootWindow(display), 0, 0, altoVen, anchoVen, 0, WhitePixel(display, DefaultScreen(display)), BlackPixel(display, DefaultScreen(display)));
+    while (p < fin) {
+        const char *finLinea = (const char *) memchr(p, '\n', fin - p);
+        if (finLinea == NULL) {
+            finLinea = fin;
+        }
+        saltarEspacios(p, finLinea);
 
-    //Se asigna un nombre a la ventana generada.
-    XStoreName(display, win, "PROYECTO 1");
+        if (finLinea - p > 2 && p[0] == 'v') {                          //Si la línea empieza con "v"
+            if (p[1] == ' ' || p[1] == '\t') {                          //Si la línea es un vértice, se obtiene su valor.
+                p += 2;
+                leerFloats(p, finLinea, 3, fragmento.posiciones);
+            }
+            else if (p[1] == 'n' && (p[2] == ' ' || p[2] == '\t')) {    //Si la línea es una normal, se obtiene su valor.
+                p += 3;
+                leerFloats(p, finLinea, 3, fragmento.normales);
+            }
+            else if (p[1] == 't' && (p[2] == ' ' || p[2] == '\t')) {    //Si la línea es una coordenada de textura.
+                p += 3;
+                leerFloats(p, finLinea, 2, fragmento.coordTex);
+            }
+        }
+        else if (finLinea - p > 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {  //Si la línea es una cara.
+            p += 2;
+            poligono.clear();
+            bool conNormales = true;
+            while (leerEsquinaOBJ(p, finLinea, fragmento, esquina)) {
+                conNormales = conNormales && esquina.n != INT32_MIN;
+                poligono.push_back(esquina);
+            }
+            //Los polígonos de más de tres vértices se dividen en triángulos en forma de abanico.
+            if (!conNormales) {
+                fragmento.carasSinNormal++;
+            }
+            else {
+                for (size_t k = 1; k + 1 < poligono.size(); k++) {
+                    fragmento.esquinas.push_back(poligono[0]);
+                    fragmento.esquinas.push_back(poligono[k]);
+                    fragmento.esquinas.push_back(poligono[k + 1]);
+                }
+            }
+        }
+        p = finLinea + 1;
+    }
+}
 
-    //Mostrar la ventana en pantalla.
-    XMapWindow(display, win);
+//Se lee una esquina de cara con alguna de las formas v, v/vt, v//vn o v/vt/vn. Los índices negativos se
+//convierten en índices relativos al inicio del fragmento. Regresa falso cuando ya no hay más esquinas en la línea.
+bool leerEsquinaOBJ(const char *&p, const char *fin, const FragmentoOBJ &fragmento, EsquinaOBJ &esquina) {
+    int indices[3] = {0, 0, 0};     //Índices de posición, textura y normal tal como vienen en el archivo.
+    const int32_t cuenta[3] = {int32_t(fragmento.posiciones.size() / 3), int32_t(fragmento.coordTex.size() / 2),
+                               int32_t(fragmento.normales.size() / 3)};
+    int32_t *destino[3] = {&esquina.v, &esquina.t, &esquina.n};
+    const uint8_t relativa[3] = {ESQUINA_V_RELATIVA, ESQUINA_T_RELATIVA, ESQUINA_N_RELATIVA};
 
-    //Solicitar a X server que mande notificaciones de la ventana activa.
-    XSelectInput(display, win, KeyPressMask | StructureNotifyMask);    
+    saltarEspacios(p, fin);
+    std::from_chars_result resultado = std::from_chars(p, fin, indices[0]);
+    if (resultado.ec != std::errc() || indices[0] == 0) {
+        return false;
+    }
+    p = resultado.ptr;
+    for (int k = 1; k < 3 && p < fin && *p == '/'; k++) {
+        p++;
+        resultado = std::from_chars(p, fin, indices[k]);
+        if (resultado.ec == std::errc()) {
+            p = resultado.ptr;
+        }
+    }
+
+    esquina.banderas = indices[1] != 0 ? ESQUINA_CON_T : 0;
+    for (int k = 0; k < 3; k++) {
+        if (indices[k] > 0) {
+            *destino[k] = indices[k] - 1;
+        }
+        else if (indices[k] < 0) {
+            *destino[k] = cuenta[k] + indices[k];
+            esquina.banderas |= relativa[k];
+        }
+        else {
+            *destino[k] = INT32_MIN;    //El atributo no viene en el archivo.
+        }
+    }
+    //Se salta lo que quede de la esquina (por ejemplo, caracteres que no son números).
+    while (p < fin && *p != ' ' && *p != '\t' && *p != '\r') {
+        p++;
+    }
+    return true;
+}
+
+//Se regresa la memoria que ocupan los arreglos de la malla.
+size_t bytesMalla(const Malla &malla) {
+    return malla.numVertices() * 9 * sizeof(float) + malla.numCaras() * 3 * sizeof(uint32_t);
+}
+
+//Se regresa el centroide del modelo como el promedio de los vértices de todas las caras.
+Eigen::Vector4f centroideCaras(const Malla &modelo) {
+    Eigen::Vector4f centroideModelo(0,0,0,0);
+
+    for (size_t i = 0; i < 3 * modelo.numCaras(); i++) {
+        centroideModelo += modelo.posicion(modelo.indices[i]);
+    }
+    return centroideModelo / (3 * modelo.numCaras());
+}
+
+//Se toma la malla que representa al modelo y se generan las coordenadas de textura UV de sus vértices utilizando un
+//mapeo esférico alrededor de "centro" (normalmente el centroide del modelo; durante la carga progresiva, uno provisional).
+void generarUVs(Malla &modelo, const Eigen::Vector4f &centro) {
+    Eigen::Vector4f vecCentVert;             //Vector que va del centro del modelo al vértice.
+
+    //Se generan las UVs en cada vértice haciendo un mapeo esférico.
+    for (uint32_t i = 0; i < modelo.numVertices(); i++) {
+        vecCentVert = (centro - modelo.posicion(i)).normalized();
+        modelo.u[i] = 0.5 + atan2(vecCentVert.z(), vecCentVert.x()) / (2*M_PI);
+        modelo.v[i] = 0.5 - asin(vecCentVert.y()) / M_PI;
+    }
+}
+
+//Se carga el modelo del OBJ nombre_archivo y se regresa su malla lista para renderizar. Si "usarCache" es verdadero,
+//se usa el caché binario nombre_archivo.malla cuando sigue vigente o se crea uno nuevo cuando no.
+//Las UVs son las del mapeo esférico, a menos que se pidan las del archivo ("uvsArchivo") y todas las caras las tengan.
+Malla cargarModelo(const std::string &nombre_archivo, bool usarCache, bool uvsArchivo) {
+    Malla malla;
+
+    if (usarCache && leerCache(nombre_archivo, uvsArchivo, malla)) {
+        return malla;
+    }
+    return terminarModelo(OBJaModelo(nombre_archivo), nombre_archivo, usarCache, uvsArchivo);
+}
+
+//Se usa el caché binario de nombre_archivo si existe y sigue vigente. Regresa falso si hay que leer el OBJ.
+bool leerCache(const std::string &nombre_archivo, bool uvsArchivo, Malla &malla) {
+    struct stat fuente;     //Información del OBJ, que invalida el caché cuando cambia.
+    return stat(nombre_archivo.c_str(), &fuente) == 0 && abrirCache(nombre_archivo + ".malla", nombre_archivo, fuente, uvsArchivo, malla);
+}
+
+//Se convierte la malla leída del OBJ en la malla del renderizador: se empaqueta, se generan las UVs con el centroide
+//exacto, se divide en meshlets y, si "usarCache" es verdadero, se escribe el caché binario.
+Malla terminarModelo(const MallaOBJ &mallaOBJ, const std::string &nombre_archivo, bool usarCache, bool uvsArchivo) {
+    struct stat fuente;
+    Malla malla = empaquetarMalla(mallaOBJ);
+    if (!uvsArchivo || !malla.uvsArchivo) {
+        generarUVs(malla, centroideCaras(malla));
+    }
+    MedicionCacheVertices antes = usarReordenamiento ? medirCacheVertices(malla) : MedicionCacheVertices();
+    auto inicio = std::chrono::steady_clock::now();
+    construirMeshlets(malla);
+    double segundos = std::chrono::duration<double>(std::chrono::steady_clock::now() - inicio).count();
+    std::cout << "Se dividió el modelo en " << malla.numMeshlets << " meshlets de hasta " << carasPorMeshlet << " caras.\n";
+    if (usarReordenamiento) {
+        MedicionCacheVertices despues = medirCacheVertices(malla);
+        std::cout << "Reordenamiento para el caché de vértices (meshlets incluidos, " << segundos << " s): ACMR con FIFO de "
+                  << tamCacheVertices << " vértices " << antes.acmr << " -> " << despues.acmr << ", líneas de 64 bytes por cara "
+                  << antes.lineasPorCara << " -> " << despues.lineasPorCara << ".\n";
+    }
+    malla.cabecera()->uvsEsfericas = !uvsArchivo || !malla.uvsArchivo;
+    if (malla.numCaras() > 0) {
+        std::cout << "Memoria por cara: " << bytesMalla(malla) / double(malla.numCaras()) << " bytes (antes, sin índices: "
+                  << bytesCaraSinIndices << " bytes).\n";
+    }
+    if (usarCache && stat(nombre_archivo.c_str(), &fuente) == 0) {
+        escribirCache(nombre_archivo + ".malla", nombre_archivo, fuente, malla);
+    }
+    return malla;
+}
+
+//Se abre el OBJ nombre_archivo y se empieza a leer en un hilo aparte, lote por lote (ver CargaProgresiva). El resto de
+//los argumentos se usan al terminar la carga, como en cargarModelo.
+std::unique_ptr<CargaProgresiva> iniciarCargaProgresiva(const std::string &nombre_archivo, bool usarCache, bool uvsArchivo, bool usarDetalle) {
+    std::unique_ptr<CargaProgresiva> carga(new CargaProgresiva());
+    struct stat info;
+
+    int descriptor = open(nombre_archivo.c_str(), O_RDONLY);
+    if (descriptor < 0 || fstat(descriptor, &info) != 0 || info.st_size == 0) {
+        std::cout << "No se pudo abrir el archivo '" << nombre_archivo << "'." << std::endl;
+        std::cout << "Probablemente el nombre y/o extensión es incorrecto." << std::endl;
+        exit(-1);
+    }
+    std::cout << "Cargando el archivo '" << nombre_archivo << "' mientras se dibuja.\n";
+    carga->tamano = info.st_size;
+    carga->datos = (const char *) mmap(NULL, carga->tamano, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (carga->datos == MAP_FAILED) {
+        std::cout << "No se pudo mapear el archivo '" << nombre_archivo << "' a memoria." << std::endl;
+        exit(-1);
+    }
+    madvise((void *) carga->datos, carga->tamano, MADV_SEQUENTIAL);
+
+    carga->nombre = nombre_archivo;
+    carga->usarCache = usarCache;
+    carga->uvsArchivo = uvsArchivo;
+    carga->usarDetalle = usarDetalle;
+    carga->inicio = std::chrono::steady_clock::now();
+    carga->lector = std::thread(leerOBJPorLotes, carga.get());
+    return carga;
+}
+
+//Hilo lector de la carga progresiva: se lee el archivo en lotes de unos bytesLote bytes que terminan en un fin de
+//línea, se resuelven sus índices relativos con los atributos de los lotes anteriores y se dejan en la cola.
+void leerOBJPorLotes(CargaProgresiva *carga) {
+    const char *p = carga->datos, *fin = carga->datos + carga->tamano;
+    int32_t despV = 0, despT = 0, despN = 0;   //Atributos leídos en los lotes anteriores.
+
+    while (p < fin && !carga->cancelar) {
+        const char *corte = p + std::min(size_t(fin - p), bytesLote);
+        if (corte < fin) {
+            const char *finLinea = (const char *) memchr(corte, '\n', fin - corte);
+            corte = finLinea ? finLinea + 1 : fin;
+        }
+        FragmentoOBJ lote;
+        leerFragmentoOBJ(p, corte, lote);
+        resolverRelativos(lote, despV, despT, despN);
+        despV += lote.posiciones.size() / 3;
+        despT += lote.coordTex.size() / 2;
+        despN += lote.normales.size() / 3;
+        p = corte;
+
+        std::unique_lock<std::mutex> lock(carga->mutex);
+        carga->hayEspacio.wait(lock, [&] { return carga->lotes.size() < lotesEnCola || carga->cancelar; });
+        carga->lotes.push_back(std::move(lote));
+        carga->bytesLeidos = p - carga->datos;
+    }
+    munmap((void *) carga->datos, carga->tamano);
+
+    std::lock_guard<std::mutex> lock(carga->mutex);
+    carga->terminada = true;
+}
+
+//Se toman todos los lotes que esperan en la cola y se agregan sus caras a la malla de la carga. Regresa cuántas caras
+//se agregaron; carga.todoTomado indica si ya no llegarán más.
+size_t tomarLotes(CargaProgresiva &carga) {
+    std::deque<FragmentoOBJ> lotes;
+    size_t carasAntes = carga.malla.indices.size() / 3;
+    {
+        std::lock_guard<std::mutex> lock(carga.mutex);
+        lotes.swap(carga.lotes);
+        carga.todoTomado = carga.terminada;
+        carga.fraccion = double(carga.bytesLeidos) / carga.tamano;
+    }
+    carga.hayEspacio.notify_one();
+
+    for (FragmentoOBJ &lote : lotes) {
+        for (size_t i = 0; i < lote.posiciones.size(); i += 3) {
+            Eigen::Vector3f posicion(lote.posiciones[i], lote.posiciones[i + 1], lote.posiciones[i + 2]);
+            carga.minimo = carga.minimo.cwiseMin(posicion);
+            carga.maximo = carga.maximo.cwiseMax(posicion);
+        }
+        agregarAtributos(lote, carga.dedup);
+        carga.carasSinNormal += lote.carasSinNormal;
+        if (!agregarEsquinas(lote.esquinas, carga.dedup, carga.malla)) {
+            std::cout << "El archivo '" << carga.nombre << "' tiene una cara con índices fuera de rango." << std::endl;
+            exit(-1);
+        }
+    }
+    carga.malla.uvsArchivo = carga.dedup.todasConUV && !carga.malla.indices.empty();
+    return carga.malla.indices.size() / 3 - carasAntes;
+}
+
+//Se arma una malla para renderizar con las caras que ya se tomaron. Como todavía no se conoce el centroide, las UVs
+//esféricas se generan alrededor del centro de la caja de las posiciones leídas (en un OBJ las posiciones suelen venir
+//antes que las caras, así que casi siempre es la caja de todo el modelo).
+Malla mallaParcial(const CargaProgresiva &carga) {
+    Malla malla = empaquetarMalla(carga.malla);
+    if (!carga.uvsArchivo || !malla.uvsArchivo) {
+        Eigen::Vector3f centro = (carga.minimo + carga.maximo) / 2;
+        generarUVs(malla, Eigen::Vector4f(centro.x(), centro.y(), centro.z(), 1.0f));
+    }
+    construirMeshlets(malla);
+    return malla;
+}
+
+//Se termina la carga progresiva después de tomar el último lote: se espera al lector y se regresa el modelo completo,
+//con las UVs generadas con el centroide exacto.
+Malla terminarCargaProgresiva(CargaProgresiva &carga) {
+    carga.lector.join();
+    double segundos = std::chrono::duration<double>(std::chrono::steady_clock::now() - carga.inicio).count();
+    std::cout << "El modelo se cargó con éxito: " << carga.malla.indices.size() / 3 << " caras y " << carga.malla.px.size() << " vértices únicos.\n";
+    std::cout << "Se leyeron " << carga.tamano / 1e6 << " MB en " << segundos << " s (" << carga.tamano / 1e6 / segundos << " MB/s).\n";
+    if (carga.carasSinNormal > 0) {
+        std::cout << "Se ignoraron " << carga.carasSinNormal << " caras sin normales.\n";
+    }
+    Malla modelo = terminarModelo(carga.malla, carga.nombre, carga.usarCache, carga.uvsArchivo);
+    carga.malla = MallaOBJ();
+    carga.dedup = DeduplicacionOBJ();
+    return modelo;
+}
+
+//Se pide al lector que deje de leer (si no había terminado) y se espera a que salga.
+void detenerCargaProgresiva(CargaProgresiva &carga) {
+    {
+        std::lock_guard<std::mutex> lock(carga.mutex);
+        carga.cancelar = true;
+    }
+    carga.hayEspacio.notify_one();
+    if (carga.lector.joinable()) {
+        carga.lector.join();
+    }
+}
+
+//Se copia la malla del lector del OBJ a un solo bloque de memoria con la disposición del caché binario
+//(cabecera y arreglos alineados a 64 bytes) y se calcula la caja que engloba al modelo.
+Malla empaquetarMalla(const MallaOBJ &mallaOBJ) {
+    const std::vector<float> *arreglos[] = {&mallaOBJ.px, &mallaOBJ.py, &mallaOBJ.pz, &mallaOBJ.nx, &mallaOBJ.ny,
+                                            &mallaOBJ.nz, &mallaOBJ.nw, &mallaOBJ.u, &mallaOBJ.v};
+    CabeceraMalla cabecera = {};
+    Malla malla;
+
+    memcpy(cabecera.magia, magiaCache, sizeof(magiaCache));
+    cabecera.version = versionCache;
+    cabecera.numVertices = mallaOBJ.px.size();
+    cabecera.numCaras = mallaOBJ.indices.size() / 3;
+    cabecera.uvsArchivo = mallaOBJ.uvsArchivo;
+    cabecera.numMeshlets = (cabecera.numCaras + carasPorMeshlet - 1) / carasPorMeshlet;
+    cabecera.numNodos = cabecera.numMeshlets > 0 ? 2 * cabecera.numMeshlets - 1 : 0;
+    size_t posicion = sizeof(CabeceraMalla);
+    for (int a = 0; a < NUM_ARREGLOS; a++) {
+        posicion = (posicion + 63) & ~size_t(63);
+        cabecera.desplazamiento[a] = posicion;
+        posicion += bytesArreglo(cabecera, a);
+    }
+    cabecera.tamano = (posicion + 63) & ~size_t(63);
+    for (int k = 0; k < 3; k++) {
+        cabecera.minimo[k] = cabecera.numVertices > 0 ? INFINITY : 0.0f;
+        cabecera.maximo[k] = cabecera.numVertices > 0 ? -INFINITY : 0.0f;
+    }
+    for (uint32_t i = 0; i < cabecera.numVertices; i++) {
+        for (int k = 0; k < 3; k++) {
+            cabecera.minimo[k] = std::min(cabecera.minimo[k], (*arreglos[ARREGLO_PX + k])[i]);
+            cabecera.maximo[k] = std::max(cabecera.maximo[k], (*arreglos[ARREGLO_PX + k])[i]);
+        }
+    }
+
+    uint8_t *bloque = (uint8_t *) aligned_alloc(64, cabecera.tamano);
+    if (bloque == NULL) {
+        std::cout << "No hay memoria suficiente para la malla." << std::endl;
+        exit(-1);
+    }
+    memset(bloque, 0, cabecera.tamano);
+    memcpy(bloque, &cabecera, sizeof(cabecera));
+    for (int a = 0; a < ARREGLO_INDICES; a++) {
+        memcpy(bloque + cabecera.desplazamiento[a], arreglos[a]->data(), arreglos[a]->size() * sizeof(float));
+    }
+    memcpy(bloque + cabecera.desplazamiento[ARREGLO_INDICES], mallaOBJ.indices.data(), mallaOBJ.indices.size() * sizeof(uint32_t));
+
+    malla.bloque = std::shared_ptr<void>(bloque, free);
+    malla.tamanoBloque = cabecera.tamano;
+    asignarArreglos(malla);
+    return malla;
+}
+
+//Se regresa el tamaño en bytes del arreglo "a" del bloque de una malla con la cabecera dada.
+size_t bytesArreglo(const CabeceraMalla &cabecera, int a) {
+    switch (a) {
+        case ARREGLO_INDICES:
+            return size_t(cabecera.numCaras) * 3 * sizeof(uint32_t);
+        case ARREGLO_MESHLETS:
+            return size_t(cabecera.numMeshlets) * sizeof(Meshlet);
+        case ARREGLO_NODOS:
+            return size_t(cabecera.numNodos) * sizeof(NodoBVH);
+        default:
+            return size_t(cabecera.numVertices) * sizeof(float);
+    }
+}
+
+//Se apuntan los arreglos de la malla a su bloque de memoria según los desplazamientos de la cabecera.
+void asignarArreglos(Malla &malla) {
+    uint8_t *bloque = (uint8_t *) malla.bloque.get();
+    const CabeceraMalla *cabecera = malla.cabecera();
+    float **arreglos[] = {&malla.px, &malla.py, &malla.pz, &malla.nx, &malla.ny, &malla.nz, &malla.nw, &malla.u, &malla.v};
+
+    for (int a = 0; a < ARREGLO_INDICES; a++) {
+        *arreglos[a] = (float *) (bloque + cabecera->desplazamiento[a]);
+    }
+    malla.indices = (uint32_t *) (bloque + cabecera->desplazamiento[ARREGLO_INDICES]);
+    malla.meshlets = (Meshlet *) (bloque + cabecera->desplazamiento[ARREGLO_MESHLETS]);
+    malla.nodos = (NodoBVH *) (bloque + cabecera->desplazamiento[ARREGLO_NODOS]);
+    malla.vertices = cabecera->numVertices;
+    malla.caras = cabecera->numCaras;
+    malla.numMeshlets = cabecera->numMeshlets;
+    malla.numNodos = cabecera->numNodos;
+    malla.uvsArchivo = cabecera->uvsArchivo;
+}
+
+//Se calcula la suma de verificación (FNV-1a por palabras de 64 bits) del contenido de un archivo.
+uint64_t sumaArchivo(const std::string &nombre) {
+    uint64_t suma = 14695981039346656037ull;
+    struct stat info;
+    int descriptor = open(nombre.c_str(), O_RDONLY);
+    if (descriptor < 0 || fstat(descriptor, &info) != 0 || info.st_size == 0) {
+        if (descriptor >= 0) {
+            close(descriptor);
+        }
+        return suma;
+    }
+    const uint8_t *datos = (const uint8_t *) mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (datos == MAP_FAILED) {
+        return suma;
+    }
+    madvise((void *) datos, info.st_size, MADV_SEQUENTIAL);
+
+    size_t n = info.st_size, i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t palabra;
+        memcpy(&palabra, datos + i, 8);
+        suma = (suma ^ palabra) * 1099511628211ull;
+    }
+    for (; i < n; i++) {
+        suma = (suma ^ datos[i]) * 1099511628211ull;
+    }
+    munmap((void *) datos, n);
+    return suma;
+}
+
+//Se mapea a memoria el caché nombreCache y, si es válido y corresponde al OBJ nombreFuente (descrito por "fuente")
+//y al tipo de UVs pedido, se usa como bloque de la malla sin copiarlo. Si el OBJ sólo cambió de fecha, se compara su contenido.
+bool abrirCache(const std::string &nombreCache, const std::string &nombreFuente, const struct stat &fuente, bool uvsArchivo, Malla &malla) {
+    auto inicio = std::chrono::steady_clock::now();
+    struct stat info;
+    int descriptor = open(nombreCache.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        return false;
+    }
+    if (fstat(descriptor, &info) != 0 || size_t(info.st_size) < sizeof(CabeceraMalla)) {
+        close(descriptor);
+        return false;
+    }
+    //Se mapea sólo para lectura: la malla no se modifica después de cargarla, así que sus páginas son las mismas
+    //del caché de páginas del sistema y se comparten con otros procesos que abran el mismo modelo.
+    void *datos = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (datos == MAP_FAILED) {
+        return false;
+    }
+    size_t tamano = info.st_size;
+    malla.bloque = std::shared_ptr<void>(datos, [tamano](void *p) { munmap(p, tamano); });
+    malla.tamanoBloque = tamano;
+
+    //Validación de la cabecera y de los arreglos.
+    const CabeceraMalla *cabecera = malla.cabecera();
+    int64_t modificacion = int64_t(fuente.st_mtim.tv_sec) * 1000000000 + fuente.st_mtim.tv_nsec;
+    bool valido = memcmp(cabecera->magia, magiaCache, sizeof(magiaCache)) == 0 && cabecera->version == versionCache &&
+                  cabecera->tamano == tamano && cabecera->tamanoFuente == uint64_t(fuente.st_size) &&
+                  bool(cabecera->uvsEsfericas) == (!uvsArchivo || !cabecera->uvsArchivo) &&
+                  bool(cabecera->reordenada) == usarReordenamiento;
+    for (int a = 0; valido && a < NUM_ARREGLOS; a++) {
+        valido = cabecera->desplazamiento[a] % 64 == 0 && cabecera->desplazamiento[a] >= sizeof(CabeceraMalla) &&
+                 cabecera->desplazamiento[a] + bytesArreglo(*cabecera, a) <= tamano;
+    }
+    if (valido && cabecera->modificacionFuente != modificacion) {
+        valido = cabecera->sumaFuente == sumaArchivo(nombreFuente);
+        //Si el contenido no cambió, se actualiza la fecha en el caché para no volver a comparar el contenido.
+        descriptor = valido ? open(nombreCache.c_str(), O_WRONLY) : -1;
+        if (descriptor >= 0) {
+            pwrite(descriptor, &modificacion, sizeof(modificacion), offsetof(CabeceraMalla, modificacionFuente));
+            close(descriptor);
+        }
+    }
+    if (!valido) {
+        std::cout << "El caché '" << nombreCache << "' no corresponde al modelo actual; se va a regenerar.\n";
+        malla = Malla();
+        return false;
+    }
+    asignarArreglos(malla);
+    bool danado = false;
+    for (size_t i = 0; i < 3 * malla.numCaras(); i++) {
+        danado = danado || malla.indices[i] >= malla.numVertices();
+    }
+    for (uint32_t m = 0; m < malla.numMeshlets; m++) {
+        danado = danado || size_t(malla.meshlets[m].primeraCara) + malla.meshlets[m].numCaras > malla.numCaras();
+    }
+    for (uint32_t n = 0; n < malla.numNodos; n++) {
+        danado = danado || malla.nodos[n].siguiente <= n || malla.nodos[n].siguiente > malla.numNodos ||
+                 size_t(malla.nodos[n].primerMeshlet) + malla.nodos[n].numMeshlets > malla.numMeshlets;
+    }
+    if (danado) {
+        std::cout << "El caché '" << nombreCache << "' está dañado; se va a regenerar.\n";
+        malla = Malla();
+        return false;
+    }
+
+    double segundos = std::chrono::duration<double>(std::chrono::steady_clock::now() - inicio).count();
+    std::cout << "Se mapeó el caché '" << nombreCache << "': " << malla.numCaras() << " caras y " << malla.numVertices()
+              << " vértices únicos en " << segundos << " s.\n";
+    return true;
+}
+
+//Se escribe el bloque de la malla en el caché nombreCache junto con la información del OBJ nombreFuente.
+//Se escribe primero en un archivo temporal y después se renombra, para que nunca quede un caché a medias.
+void escribirCache(const std::string &nombreCache, const std::string &nombreFuente, const struct stat &fuente, const Malla &malla) {
+    CabeceraMalla cabecera = *malla.cabecera();
+    std::string temporal = nombreCache + ".tmp";
+
+    cabecera.tamanoFuente = fuente.st_size;
+    cabecera.modificacionFuente = int64_t(fuente.st_mtim.tv_sec) * 1000000000 + fuente.st_mtim.tv_nsec;
+    cabecera.sumaFuente = sumaArchivo(nombreFuente);
+
+    std::ofstream archivo(temporal, std::ios::binary);
+    archivo.write((const char *) &cabecera, sizeof(cabecera));
+    archivo.write((const char *) malla.bloque.get() + sizeof(cabecera), malla.tamanoBloque - sizeof(cabecera));
+    archivo.close();
+    if (!archivo || rename(temporal.c_str(), nombreCache.c_str()) != 0) {
+        std::cout << "No se pudo escribir el caché '" << nombreCache << "'.\n";
+        remove(temporal.c_str());
+        return;
+    }
+    std::cout << "Se escribió el caché '" << nombreCache << "' (" << malla.tamanoBloque / 1e6 << " MB).\n";
+}
+
+//Se abre el modelo fuera de núcleo del OBJ nombre_archivo: se usa su archivo de ladrillos si sigue vigente o se construye
+//uno nuevo, y se prepara el caché de ladrillos con "limite" bytes.
+CacheLadrillos *abrirLadrillos(const std::string &nombre_archivo, bool uvsArchivo, size_t limite) {
+    struct stat fuente;     //Información del OBJ, que invalida el archivo de ladrillos cuando cambia.
+    CacheLadrillos *cache = new CacheLadrillos();
+    cache->nombre = nombre_archivo + ".ladrillos";
+    cache->limite = limite;
+
+    if (stat(nombre_archivo.c_str(), &fuente) != 0) {
+        std::cout << "No se pudo abrir el archivo '" << nombre_archivo << "'." << std::endl;
+        std::cout << "Probablemente el nombre y/o extensión es incorrecto." << std::endl;
+        exit(-1);
+    }
+    if (!validarLadrillos(*cache, nombre_archivo, fuente, uvsArchivo)) {
+        if (!construirLadrillos(nombre_archivo, cache->nombre, fuente, uvsArchivo) || !validarLadrillos(*cache, nombre_archivo, fuente, uvsArchivo)) {
+            std::cout << "No se pudo construir el archivo de ladrillos '" << cache->nombre << "'." << std::endl;
+            exit(-1);
+        }
+    }
+
+    //El límite tiene que alcanzar al menos para el ladrillo más grande, que se dibuja completo.
+    size_t mayor = 0;
+    for (const Ladrillo &ladrillo : cache->directorio) {
+        mayor = std::max(mayor, size_t(ladrillo.tamano));
+    }
+    if (mayor > limite) {
+        std::cout << "El límite de memoria de --fuera-nucleo debe ser de al menos " << (mayor + (1 << 20) - 1) / (1 << 20)
+                  << " MB (el ladrillo más grande)." << std::endl;
+        exit(-1);
+    }
+
+    size_t numLadrillos = cache->directorio.size();
+    cache->residentes.resize(numLadrillos);
+    cache->leyendo.resize(numLadrillos, 0);
+    cache->precargado.resize(numLadrillos, 0);
+    cache->ultimoUso.resize(numLadrillos, -1);
+    cache->posicionUso.resize(numLadrillos);
+    cache->precargador = std::thread(hiloPrecarga, cache);
+    std::cout << "Modelo fuera de núcleo: " << cache->cabecera.numCaras << " caras en " << numLadrillos << " ladrillos ("
+              << cache->cabecera.tamano / 1e6 << " MB en disco); se usan a lo más " << limite / 1e6 << " MB en memoria.\n";
+    return cache;
+}
+
+//Se abre el archivo de ladrillos del caché y se lee su directorio si el archivo es válido y corresponde al OBJ
+//nombreFuente (descrito por "fuente") y al tipo de UVs pedido. Si el OBJ sólo cambió de fecha, se compara su contenido.
+bool validarLadrillos(CacheLadrillos &cache, const std::string &nombreFuente, const struct stat &fuente, bool uvsArchivo) {
+    struct stat info;
+    int descriptor = open(cache.nombre.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        return false;
+    }
+    CabeceraLadrillos &cabecera = cache.cabecera;
+    int64_t modificacion = int64_t(fuente.st_mtim.tv_sec) * 1000000000 + fuente.st_mtim.tv_nsec;
+    bool valido = fstat(descriptor, &info) == 0 && pread(descriptor, &cabecera, sizeof(cabecera), 0) == sizeof(cabecera) &&
+                  memcmp(cabecera.magia, magiaLadrillos, sizeof(magiaLadrillos)) == 0 && cabecera.version == versionLadrillos &&
+                  cabecera.tamano == uint64_t(info.st_size) && cabecera.tamanoFuente == uint64_t(fuente.st_size) &&
+                  bool(cabecera.uvsEsfericas) == (!uvsArchivo || !cabecera.uvsArchivo) &&
+                  bool(cabecera.reordenada) == usarReordenamiento &&
+                  sizeof(cabecera) + size_t(cabecera.numLadrillos) * sizeof(Ladrillo) <= cabecera.tamano;
+    if (valido) {
+        cache.directorio.resize(cabecera.numLadrillos);
+        size_t bytes = cache.directorio.size() * sizeof(Ladrillo);
+        valido = pread(descriptor, cache.directorio.data(), bytes, sizeof(cabecera)) == ssize_t(bytes);
+    }
+    for (size_t l = 0; valido && l < cache.directorio.size(); l++) {
+        const Ladrillo &ladrillo = cache.directorio[l];
+        valido = ladrillo.desplazamiento % 4096 == 0 && ladrillo.tamano >= sizeof(CabeceraMalla) && ladrillo.tamano % 64 == 0 &&
+                 ladrillo.desplazamiento + ladrillo.tamano <= cabecera.tamano;
+    }
+    if (valido && cabecera.modificacionFuente != modificacion) {
+        valido = cabecera.sumaFuente == sumaArchivo(nombreFuente);
+        //Si el contenido no cambió, se actualiza la fecha para no volver a comparar el contenido.
+        int escritura = valido ? open(cache.nombre.c_str(), O_WRONLY) : -1;
+        if (escritura >= 0) {
+            pwrite(escritura, &modificacion, sizeof(modificacion), offsetof(CabeceraLadrillos, modificacionFuente));
+            close(escritura);
+        }
+    }
+    if (!valido) {
+        std::cout << "El archivo de ladrillos '" << cache.nombre << "' no corresponde al modelo actual; se va a regenerar.\n";
+        cache.directorio.clear();
+        close(descriptor);
+        return false;
+    }
+    cache.descriptor = descriptor;
+    return true;
+}
+
+//Se construye el archivo de ladrillos "nombre" a partir del OBJ nombreFuente sin tener todas las caras en memoria:
+//  1. Se lee el OBJ en lotes y sus caras se escriben, con los índices ya absolutos, en un archivo temporal. En memoria
+//     sólo quedan los atributos (v, vt, vn) del OBJ.
+//  2. Se recorre el archivo de caras para validar los índices, calcular el centroide del modelo (el mismo que usa
+//     generarUVs) y contar las caras de cada cubeta del código de Morton de su centroide. Las cubetas consecutivas se
+//     juntan en ladrillos de hasta carasPorLadrillo caras (o una cubeta, si tiene más).
+//  3. Se vuelve a recorrer el archivo de caras y cada cara se copia a la zona de su ladrillo en otro archivo temporal.
+//  4. Cada ladrillo se lee, se deduplican sus vértices, se empaqueta y se divide en meshlets como un modelo completo,
+//     y su bloque se agrega al archivo de ladrillos.
+//Regresa falso si no se pudo leer el OBJ o escribir algún archivo.
+bool construirLadrillos(const std::string &nombreFuente, const std::string &nombre, const struct stat &fuente, bool uvsArchivo) {
+    const size_t carasPorLectura = 1 << 16;     //Caras que se leen a la vez de los archivos temporales.
+    const uint32_t numCubetas = 1u << (3 * bitsCubetaLadrillo);
+    auto inicio = std::chrono::steady_clock::now();
+    std::string nombreCaras = nombre + ".caras", nombreOrden = nombre + ".orden", temporal = nombre + ".tmp";
+    DeduplicacionOBJ dedup;
+    size_t carasSinNormal = 0;
+    uint64_t numCaras = 0;
+
+    std::cout << "Construyendo los ladrillos de '" << nombreFuente << "' en '" << nombre << "'.\n";
+    int descriptor = open(nombreFuente.c_str(), O_RDONLY);
+    if (descriptor < 0 || fuente.st_size == 0) {
+        if (descriptor >= 0) {
+            close(descriptor);
+        }
+        return false;
+    }
+    size_t tamano = fuente.st_size;
+    const char *datos = (const char *) mmap(NULL, tamano, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (datos == MAP_FAILED) {
+        return false;
+    }
+    madvise((void *) datos, tamano, MADV_SEQUENTIAL);
+
+    //1. Lectura del OBJ por lotes de líneas completas.
+    std::ofstream archivoCaras(nombreCaras, std::ios::binary);
+    std::vector<CaraLadrillo> caras;
+    const char *p = datos, *fin = datos + tamano;
+    int32_t despV = 0, despT = 0, despN = 0;
+    while (p < fin && archivoCaras) {
+        const char *corte = p + std::min(size_t(fin - p), bytesLote);
+        if (corte < fin) {
+            const char *finLinea = (const char *) memchr(corte, '\n', fin - corte);
+            corte = finLinea ? finLinea + 1 : fin;
+        }
+        FragmentoOBJ lote;
+        leerFragmentoOBJ(p, corte, lote);
+        resolverRelativos(lote, despV, despT, despN);
+        despV += lote.posiciones.size() / 3;
+        despT += lote.coordTex.size() / 2;
+        despN += lote.normales.size() / 3;
+        agregarAtributos(lote, dedup);
+        carasSinNormal += lote.carasSinNormal;
+        caras.resize(lote.esquinas.size() / 3);
+        for (size_t i = 0; i < caras.size(); i++) {
+            for (int k = 0; k < 3; k++) {
+                const EsquinaOBJ &esquina = lote.esquinas[3*i + k];
+                caras[i].v[k] = esquina.v;
+                caras[i].t[k] = (esquina.banderas & ESQUINA_CON_T) ? esquina.t : -1;
+                caras[i].n[k] = esquina.n;
+            }
+        }
+        archivoCaras.write((const char *) caras.data(), caras.size() * sizeof(CaraLadrillo));
+        numCaras += caras.size();
+        p = corte;
+    }
+    munmap((void *) datos, tamano);
+    archivoCaras.close();
+    if (!archivoCaras) {
+        remove(nombreCaras.c_str());
+        return false;
+    }
+
+    //2. Validación, centroide y cubetas. El centroide se acumula en el orden del archivo, como en centroideCaras.
+    const std::vector<float> &posiciones = dedup.posiciones;
+    Eigen::Vector3f minimo = Eigen::Vector3f::Constant(INFINITY), maximo = Eigen::Vector3f::Constant(-INFINITY);
+    for (size_t i = 0; i < posiciones.size(); i += 3) {
+        minimo = minimo.cwiseMin(Eigen::Vector3f(posiciones[i], posiciones[i + 1], posiciones[i + 2]));
+        maximo = maximo.cwiseMax(Eigen::Vector3f(posiciones[i], posiciones[i + 1], posiciones[i + 2]));
+    }
+    Eigen::Vector3f escala = (maximo - minimo).cwiseMax(1e-20f).cwiseInverse() * ((1 << bitsCubetaLadrillo) - 1);
+    auto cubeta = [&](const CaraLadrillo &cara) {
+        Eigen::Vector3f centroide = Eigen::Vector3f::Zero();
+        for (int k = 0; k < 3; k++) {
+            centroide += Eigen::Vector3f(posiciones[3*cara.v[k]], posiciones[3*cara.v[k] + 1], posiciones[3*cara.v[k] + 2]);
+        }
+        Eigen::Vector3f celda = (centroide / 3 - minimo).cwiseProduct(escala);
+        uint32_t codigo = 0;
+        for (int bit = bitsCubetaLadrillo - 1; bit >= 0; bit--) {
+            for (int k = 0; k < 3; k++) {
+                codigo = (codigo << 1) | ((uint32_t(celda[k]) >> bit) & 1);
+            }
+        }
+        return codigo;
+    };
+    //Se recorre el archivo de caras por partes y se llama a "procesar" con cada cara.
+    auto recorrerCaras = [&](const std::function<void(const CaraLadrillo &)> &procesar) {
+        std::ifstream archivo(nombreCaras, std::ios::binary);
+        for (uint64_t leidas = 0; leidas < numCaras; leidas += caras.size()) {
+            caras.resize(std::min<uint64_t>(carasPorLectura, numCaras - leidas));
+            archivo.read((char *) caras.data(), caras.size() * sizeof(CaraLadrillo));
+            for (const CaraLadrillo &cara : caras) {
+                procesar(cara);
+            }
+        }
+        return bool(archivo);
+    };
+    std::vector<uint32_t> carasCubeta(numCubetas, 0);
+    Eigen::Vector4f centroide(0, 0, 0, 0);
+    bool todasConUV = true;
+    bool leido = recorrerCaras([&](const CaraLadrillo &cara) {
+        for (int k = 0; k < 3; k++) {
+            if (cara.v[k] < 0 || size_t(cara.v[k]) >= posiciones.size() / 3 || cara.n[k] < 0 || size_t(cara.n[k]) >= dedup.normales.size() / 3 ||
+                cara.t[k] < -1 || (cara.t[k] >= 0 && size_t(cara.t[k]) >= dedup.coordTex.size() / 2)) {
+                std::cout << "El archivo '" << nombreFuente << "' tiene una cara con índices fuera de rango." << std::endl;
+                remove(nombreCaras.c_str());
+                exit(-1);
+            }
+            todasConUV = todasConUV && cara.t[k] >= 0;
+            centroide += Eigen::Vector4f(posiciones[3*cara.v[k]], posiciones[3*cara.v[k] + 1], posiciones[3*cara.v[k] + 2], 1.0f);
+        }
+        carasCubeta[cubeta(cara)]++;
+    });
+    centroide /= 3 * numCaras;
+    todasConUV = todasConUV && numCaras > 0;
+    bool uvsEsfericas = !uvsArchivo || !todasConUV;
+
+    //Reparto de las cubetas en ladrillos, en el orden del código de Morton.
+    std::vector<uint32_t> ladrilloCubeta(numCubetas);
+    std::vector<uint64_t> primeraCara = {0};    //Primera cara de cada ladrillo en el archivo ordenado.
+    uint64_t carasLadrillo = 0;
+    for (uint32_t c = 0; c < numCubetas; c++) {
+        if (carasLadrillo > 0 && carasLadrillo + carasCubeta[c] > carasPorLadrillo) {
+            primeraCara.push_back(primeraCara.back() + carasLadrillo);
+            carasLadrillo = 0;
+        }
+        ladrilloCubeta[c] = primeraCara.size() - 1;
+        carasLadrillo += carasCubeta[c];
+    }
+    primeraCara.push_back(numCaras);
+    uint32_t numLadrillos = numCaras > 0 ? primeraCara.size() - 1 : 0;
+    std::vector<uint32_t>().swap(carasCubeta);
+
+    //3. Se copian las caras a la zona de su ladrillo (conservando el orden del archivo dentro de cada ladrillo).
+    int orden = open(nombreOrden.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    std::vector<std::vector<CaraLadrillo>> buffers(numLadrillos);
+    std::vector<uint64_t> escritas(numLadrillos, 0);
+    bool escrito = orden >= 0;
+    auto vaciar = [&](uint32_t l) {
+        size_t bytes = buffers[l].size() * sizeof(CaraLadrillo);
+        escrito = escrito && pwrite(orden, buffers[l].data(), bytes, (primeraCara[l] + escritas[l]) * sizeof(CaraLadrillo)) == ssize_t(bytes);
+        escritas[l] += buffers[l].size();
+        buffers[l].clear();
+    };
+    leido = leido && escrito && recorrerCaras([&](const CaraLadrillo &cara) {
+        uint32_t l = ladrilloCubeta[cubeta(cara)];
+        buffers[l].push_back(cara);
+        if (buffers[l].size() == carasBufferLadrillo) {
+            vaciar(l);
+        }
+    });
+    for (uint32_t l = 0; l < numLadrillos && escrito; l++) {
+        vaciar(l);
+    }
+    std::vector<std::vector<CaraLadrillo>>().swap(buffers);
+    remove(nombreCaras.c_str());
+
+    //4. Cada ladrillo se convierte en una malla completa y se escribe alineado a 4096 bytes después del directorio.
+    CabeceraLadrillos cabecera = {};
+    std::vector<Ladrillo> directorio(numLadrillos);
+    int salida = open(temporal.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    uint64_t posicion = (sizeof(cabecera) + numLadrillos * sizeof(Ladrillo) + 4095) & ~uint64_t(4095);
+    escrito = escrito && leido && salida >= 0;
+    for (uint32_t l = 0; l < numLadrillos && escrito; l++) {
+        caras.resize(primeraCara[l + 1] - primeraCara[l]);
+        size_t bytes = caras.size() * sizeof(CaraLadrillo);
+        escrito = pread(orden, caras.data(), bytes, primeraCara[l] * sizeof(CaraLadrillo)) == ssize_t(bytes);
+
+        //Deduplicación con las listas por posición de DeduplicacionOBJ; al terminar se vacían sólo las listas usadas.
+        std::vector<EsquinaOBJ> esquinas(3 * caras.size());
+        for (size_t i = 0; i < caras.size(); i++) {
+            for (int k = 0; k < 3; k++) {
+                esquinas[3*i + k] = {caras[i].v[k], caras[i].t[k], caras[i].n[k], uint8_t(caras[i].t[k] >= 0 ? ESQUINA_CON_T : 0)};
+            }
+        }
+        MallaOBJ mallaOBJ;
+        agregarEsquinas(esquinas, dedup, mallaOBJ);
+        for (const EsquinaOBJ &esquina : esquinas) {
+            dedup.primero[esquina.v] = NINGUNO;
+        }
+        dedup.siguiente.clear();
+        dedup.claveT.clear();
+        dedup.claveN.clear();
+        mallaOBJ.uvsArchivo = todasConUV;
+
+        Malla malla = empaquetarMalla(mallaOBJ);
+        if (uvsEsfericas) {
+            generarUVs(malla, centroide);
+        }
+        construirMeshlets(malla);
+        malla.cabecera()->uvsEsfericas = uvsEsfericas;
+        directorio[l] = {posicion, malla.tamanoBloque, malla.caras, malla.vertices, malla.nodos[0].limites};
+        escrito = escrito && pwrite(salida, malla.bloque.get(), malla.tamanoBloque, posicion) == ssize_t(malla.tamanoBloque);
+        posicion = (posicion + malla.tamanoBloque + 4095) & ~uint64_t(4095);
+    }
+    if (orden >= 0) {
+        close(orden);
+    }
+    remove(nombreOrden.c_str());
+
+    memcpy(cabecera.magia, magiaLadrillos, sizeof(magiaLadrillos));
+    cabecera.version = versionLadrillos;
+    cabecera.numLadrillos = numLadrillos;
+    cabecera.numCaras = numCaras;
+    cabecera.uvsArchivo = todasConUV;
+    cabecera.uvsEsfericas = uvsEsfericas;
+    cabecera.reordenada = usarReordenamiento;
+    cabecera.tamanoFuente = fuente.st_size;
+    cabecera.modificacionFuente = int64_t(fuente.st_mtim.tv_sec) * 1000000000 + fuente.st_mtim.tv_nsec;
+    cabecera.sumaFuente = sumaArchivo(nombreFuente);
+    cabecera.tamano = posicion;
+    size_t bytesDirectorio = directorio.size() * sizeof(Ladrillo);
+    escrito = escrito && ftruncate(salida, posicion) == 0 && pwrite(salida, &cabecera, sizeof(cabecera), 0) == sizeof(cabecera) &&
+              pwrite(salida, directorio.data(), bytesDirectorio, sizeof(cabecera)) == ssize_t(bytesDirectorio);
+    if (salida >= 0) {
+        close(salida);
+    }
+    if (!escrito || rename(temporal.c_str(), nombre.c_str()) != 0) {
+        remove(temporal.c_str());
+        return false;
+    }
+
+    double segundos = std::chrono::duration<double>(std::chrono::steady_clock::now() - inicio).count();
+    std::cout << "Se construyeron " << numLadrillos << " ladrillos con " << numCaras << " caras (" << posicion / 1e6
+              << " MB) en " << segundos << " s.\n";
+    if (carasSinNormal > 0) {
+        std::cout << "Se ignoraron " << carasSinNormal << " caras sin normales.\n";
+    }
+    return true;
+}
+
+//Se regresa la malla del ladrillo l para dibujarla en el frame actual, leyéndola del disco (y expulsando los ladrillos
+//usados hace más tiempo) si no está en memoria.
+std::shared_ptr<const Malla> obtenerLadrillo(CacheLadrillos &cache, uint32_t l) {
+    std::unique_lock<std::mutex> lock(cache.mutex);
+    cache.cargado.wait(lock, [&] { return !cache.leyendo[l]; });
+    cache.ultimoUso[l] = cache.frame;
+    if (cache.residentes[l]) {
+        cache.aciertos++;
+        if (cache.precargado[l]) {
+            cache.precargasUsadas++;
+            cache.precargado[l] = 0;
+        }
+        cache.usoReciente.splice(cache.usoReciente.begin(), cache.usoReciente, cache.posicionUso[l]);
+        return cache.residentes[l];
+    }
+
+    //Si el espacio está reservado por lecturas de la precarga, se espera a que terminen.
+    cache.fallos++;
+    while (!reservarLadrillo(cache, l, false)) {
+        cache.cargado.wait(lock);
+    }
+    cache.leyendo[l] = 1;
+    lock.unlock();
+    std::shared_ptr<const Malla> malla = leerLadrillo(cache, l);
+    lock.lock();
+    guardarLadrillo(cache, l, malla);
+    return malla;
+}
+
+//Se lee del disco el bloque del ladrillo l y se regresa su malla.
+std::shared_ptr<const Malla> leerLadrillo(CacheLadrillos &cache, uint32_t l) {
+    const Ladrillo &ladrillo = cache.directorio[l];
+    std::shared_ptr<Malla> malla = std::make_shared<Malla>();
+    uint8_t *bloque = (uint8_t *) aligned_alloc(64, ladrillo.tamano);
+    if (bloque == NULL) {
+        std::cout << "No hay memoria suficiente para el ladrillo " << l << "." << std::endl;
+        exit(-1);
+    }
+    malla->bloque = std::shared_ptr<void>(bloque, free);
+    malla->tamanoBloque = ladrillo.tamano;
+
+    size_t leidos = 0;
+    while (leidos < ladrillo.tamano) {
+        ssize_t n = pread(cache.descriptor, bloque + leidos, ladrillo.tamano - leidos, ladrillo.desplazamiento + leidos);
+        if (n <= 0) {
+            break;
+        }
+        leidos += n;
+    }
+    const CabeceraMalla *cabecera = malla->cabecera();
+    if (leidos < ladrillo.tamano || memcmp(cabecera->magia, magiaCache, sizeof(magiaCache)) != 0 || cabecera->tamano != ladrillo.tamano ||
+        cabecera->numCaras != ladrillo.numCaras) {
+        std::cout << "No se pudo leer el ladrillo " << l << " de '" << cache.nombre << "'." << std::endl;
+        exit(-1);
+    }
+    asignarArreglos(*malla);
+    return malla;
+}
+
+//Se reserva espacio en el caché para leer el ladrillo l, expulsando los ladrillos usados hace más tiempo. La precarga
+//no expulsa los ladrillos que ya se dibujaron en el frame actual. Regresa falso (sin expulsar nada) si no hay forma de
+//hacer espacio. Se llama con el mutex del caché tomado.
+bool reservarLadrillo(CacheLadrillos &cache, uint32_t l, bool precarga) {
+    size_t necesario = cache.directorio[l].tamano;
+    size_t libre = cache.limite - cache.bytesResidentes;
+    std::vector<uint32_t> expulsados;
+    for (auto it = cache.usoReciente.rbegin(); it != cache.usoReciente.rend() && libre < necesario; ++it) {
+        if (!precarga || cache.ultimoUso[*it] < cache.frame) {
+            expulsados.push_back(*it);
+            libre += cache.directorio[*it].tamano;
+        }
+    }
+    if (libre < necesario) {
+        return false;
+    }
+    for (uint32_t e : expulsados) {
+        cache.residentes[e].reset();
+        cache.usoReciente.erase(cache.posicionUso[e]);
+        cache.bytesResidentes -= cache.directorio[e].tamano;
+        cache.precargado[e] = 0;
+        cache.expulsiones++;
+    }
+    cache.bytesResidentes += necesario;
+    return true;
+}
+
+//Se guarda en el caché la malla recién leída del ladrillo l como la usada más recientemente. Se llama con el mutex del
+//caché tomado.
+void guardarLadrillo(CacheLadrillos &cache, uint32_t l, const std::shared_ptr<const Malla> &malla) {
+    cache.residentes[l] = malla;
+    cache.usoReciente.push_front(l);
+    cache.posicionUso[l] = cache.usoReciente.begin();
+    cache.leyendo[l] = 0;
+    cache.cargado.notify_all();
+}
+
+//Hilo de precarga: lee los ladrillos pendientes mientras haya espacio en el caché.
+void hiloPrecarga(CacheLadrillos *cache) {
+    std::unique_lock<std::mutex> lock(cache->mutex);
+    for (;;) {
+        cache->hayPrecarga.wait(lock, [&] { return cache->terminar || !cache->pendientes.empty(); });
+        if (cache->terminar) {
+            return;
+        }
+        uint32_t l = cache->pendientes.front();
+        cache->pendientes.pop_front();
+        if (cache->residentes[l] || cache->leyendo[l] || !reservarLadrillo(*cache, l, true)) {
+            continue;
+        }
+        cache->leyendo[l] = 1;
+        lock.unlock();
+        std::shared_ptr<const Malla> malla = leerLadrillo(*cache, l);
+        lock.lock();
+        //Mientras dure el frame, el ladrillo precargado tampoco se expulsa por otra precarga.
+        cache->ultimoUso[l] = cache->frame;
+        cache->precargado[l] = 1;
+        cache->precargas++;
+        guardarLadrillo(*cache, l, malla);
+    }
+}
+
+//Se detiene el hilo de precarga, se reportan las estadísticas del caché y se cierra el archivo de ladrillos.
+void cerrarLadrillos(CacheLadrillos *cache) {
+    {
+        std::lock_guard<std::mutex> lock(cache->mutex);
+        cache->terminar = true;
+    }
+    cache->hayPrecarga.notify_one();
+    cache->precargador.join();
+    long consultas = cache->aciertos + cache->fallos;
+    std::cout << "Caché de ladrillos: " << cache->aciertos << " aciertos y " << cache->fallos << " fallos ("
+              << (consultas > 0 ? 100.0 * cache->aciertos / consultas : 0.0) << "% de aciertos), " << cache->expulsiones
+              << " expulsiones, " << cache->precargas << " ladrillos precargados (" << cache->precargasUsadas << " se usaron).\n";
+    close(cache->descriptor);
+    delete cache;
+}
+
+//Se divide la malla en meshlets: se ordenan las caras según el código de Morton de su centroide (así las caras
+//cercanas en el espacio quedan juntas), se reescriben los índices en ese orden y se agrupan de carasPorMeshlet en
+//carasPorMeshlet. Con --reordenar, reordenarMalla ordena además las caras de cada meshlet y los vértices (los meshlets
+//conservan sus caras, así que sus límites no cambian). Después se construye el BVH sobre los meshlets, que ya quedaron
+//en orden espacial.
+//Los meshlets y los nodos se escriben en el espacio que empaquetarMalla reservó para ellos en el bloque de la malla.
+void construirMeshlets(Malla &malla) {
+    size_t numCaras = malla.numCaras();
+    std::vector<Meshlet> meshlets;
+    std::vector<NodoBVH> nodos;
+    Eigen::Vector3f minimo = Eigen::Vector3f::Constant(INFINITY), maximo = Eigen::Vector3f::Constant(-INFINITY);
+    std::vector<Eigen::Vector3f> centroides(numCaras);
+    std::vector<std::pair<uint32_t, uint32_t>> orden(numCaras); //Código de Morton e índice de cada cara.
+
+    auto posicion = [&](uint32_t v) -> Eigen::Vector3f { return malla.posicion(v).head<3>(); };
+    for (size_t i = 0; i < numCaras; i++) {
+        centroides[i] = (posicion(malla.indices[3*i]) + posicion(malla.indices[3*i + 1]) + posicion(malla.indices[3*i + 2])) / 3;
+        minimo = minimo.cwiseMin(centroides[i]);
+        maximo = maximo.cwiseMax(centroides[i]);
+    }
+    Eigen::Vector3f escala = (maximo - minimo).cwiseMax(1e-20f).cwiseInverse() * 1023;
+    for (size_t i = 0; i < numCaras; i++) {
+        Eigen::Vector3f celda = (centroides[i] - minimo).cwiseProduct(escala);
+        uint32_t codigo = 0;
+        for (int bit = 9; bit >= 0; bit--) {
+            for (int k = 0; k < 3; k++) {
+                codigo = (codigo << 1) | ((uint32_t(celda[k]) >> bit) & 1);
+            }
+        }
+        orden[i] = {codigo, uint32_t(i)};
+    }
+    std::sort(orden.begin(), orden.end());
+
+    std::vector<uint32_t> indices(malla.indices, malla.indices + 3 * numCaras);
+    for (size_t i = 0; i < numCaras; i++) {
+        memcpy(&malla.indices[3*i], &indices[3 * orden[i].second], 3 * sizeof(uint32_t));
+    }
+    if (usarReordenamiento) {
+        reordenarMalla(malla);
+    }
+
+    //Esfera y cono de normales de cada meshlet.
+    for (size_t primera = 0; primera < numCaras; primera += carasPorMeshlet) {
+        Meshlet meshlet;
+        meshlet.primeraCara = primera;
+        meshlet.numCaras = std::min(numCaras - primera, size_t(carasPorMeshlet));
+
+        Eigen::Vector3f cajaMin = Eigen::Vector3f::Constant(INFINITY), cajaMax = Eigen::Vector3f::Constant(-INFINITY);
+        Eigen::Vector3f sumaNormales = Eigen::Vector3f::Zero();
+        for (size_t i = primera; i < primera + meshlet.numCaras; i++) {
+            Eigen::Vector3f p0 = posicion(malla.indices[3*i]), p1 = posicion(malla.indices[3*i + 1]), p2 = posicion(malla.indices[3*i + 2]);
+            cajaMin = cajaMin.cwiseMin(p0).cwiseMin(p1).cwiseMin(p2);
+            cajaMax = cajaMax.cwiseMax(p0).cwiseMax(p1).cwiseMax(p2);
+            Eigen::Vector3f normal = (p1 - p0).cross(p2 - p0);
+            if (normal.norm() > 0) {
+                sumaNormales += normal.normalized();
+            }
+        }
+        Eigen::Vector3f centro = (cajaMin + cajaMax) / 2;
+        float radio = 0, cosCono = -1;
+        Eigen::Vector3f eje = Eigen::Vector3f::UnitZ();
+        if (sumaNormales.norm() > 1e-6f) {
+            eje = sumaNormales.normalized();
+            cosCono = 1;
+        }
+        for (size_t i = primera; i < primera + meshlet.numCaras; i++) {
+            Eigen::Vector3f p0 = posicion(malla.indices[3*i]), p1 = posicion(malla.indices[3*i + 1]), p2 = posicion(malla.indices[3*i + 2]);
+            radio = std::max(radio, std::max((p0 - centro).norm(), std::max((p1 - centro).norm(), (p2 - centro).norm())));
+            Eigen::Vector3f normal = (p1 - p0).cross(p2 - p0);
+            if (normal.norm() > 0) {
+                cosCono = std::min(cosCono, eje.dot(normal.normalized()));
+            }
+        }
+        //Un cono de 90° o más no permite descartar nada.
+        meshlet.limites = {{centro.x(), centro.y(), centro.z()}, radio * 1.0001f, {eje.x(), eje.y(), eje.z()}, cosCono > 0.0f ? cosCono : -1.0f};
+        meshlets.push_back(meshlet);
+    }
+    if (!meshlets.empty()) {
+        construirNodoBVH(meshlets, nodos, 0, meshlets.size());
+    }
+
+    memcpy(malla.meshlets, meshlets.data(), meshlets.size() * sizeof(Meshlet));
+    memcpy(malla.nodos, nodos.data(), nodos.size() * sizeof(NodoBVH));
+}
+
+//Se reordenan las caras y los vértices de la malla para la localidad de la etapa de vértices y del ensamblado:
+//  1. Las caras de cada meshlet se ordenan con Tipsify (Sander, Nehab y Barczak, 2007): se emiten en abanico las caras
+//     vivas de un vértice y el siguiente vértice es el que sigue en el caché FIFO simulado de tamCacheVertices entradas
+//     y tiene más caras por emitir sin salirse del caché; si no hay, se regresa por la pila de vértices recientes. Como
+//     el caché se conserva de un meshlet al siguiente y los meshlets ya están en orden de Morton, esto cumple el papel
+//     del agrupamiento de Tipsify sin cambiar qué caras tiene cada meshlet (ni sus límites para el descarte).
+//  2. Los vértices se renumeran en el orden en el que las caras los usan por primera vez, así que los arreglos de
+//     vértices quedan en el mismo orden espacial que las caras y el ensamblado los lee casi en secuencia.
+void reordenarMalla(Malla &malla) {
+    size_t numCaras = malla.numCaras(), numVertices = malla.numVertices();
+    std::vector<uint32_t> indices(malla.indices, malla.indices + 3 * numCaras);
+    std::vector<long> entrada(numVertices, -tamCacheVertices - 1);  //Momento en el que el vértice entró al caché.
+    std::vector<uint32_t> local(numVertices, NINGUNO);              //Vértice local (del meshlet) de cada vértice.
+    std::vector<uint32_t> globales, vivas, inicioCaras, carasVertice, pila, vecinos;
+    std::vector<bool> emitida;
+    long tiempo = 0;
+    size_t escrita = 0;
+
+    for (size_t primera = 0; primera < numCaras; primera += carasPorMeshlet) {
+        size_t numCarasMeshlet = std::min(numCaras - primera, size_t(carasPorMeshlet));
+
+        //Vértices del meshlet, caras vivas de cada uno y lista de caras por vértice.
+        globales.clear();
+        for (size_t i = 3 * primera; i < 3 * (primera + numCarasMeshlet); i++) {
+            if (local[indices[i]] == NINGUNO) {
+                local[indices[i]] = globales.size();
+                globales.push_back(indices[i]);
+            }
+        }
+        inicioCaras.assign(globales.size() + 1, 0);
+        for (size_t i = 3 * primera; i < 3 * (primera + numCarasMeshlet); i++) {
+            inicioCaras[local[indices[i]] + 1]++;
+        }
+        for (size_t v = 0; v < globales.size(); v++) {
+            inicioCaras[v + 1] += inicioCaras[v];
+        }
+        carasVertice.resize(3 * numCarasMeshlet);
+        vivas.assign(globales.size(), 0);   //Al terminar de llenar las listas, tiene las caras de cada vértice.
+        for (size_t c = 0; c < numCarasMeshlet; c++) {
+            for (int k = 0; k < 3; k++) {
+                uint32_t v = local[indices[3 * (primera + c) + k]];
+                carasVertice[inicioCaras[v] + vivas[v]++] = c;
+            }
+        }
+
+        //Tipsify sobre las caras del meshlet, empezando por el primer vértice de la primera cara.
+        emitida.assign(numCarasMeshlet, false);
+        pila.clear();
+        uint32_t actual = 0, siguienteSinEmitir = 0;
+        while (actual != NINGUNO) {
+            vecinos.clear();
+            for (uint32_t j = inicioCaras[actual]; j < inicioCaras[actual + 1]; j++) {
+                uint32_t c = carasVertice[j];
+                if (emitida[c]) {
+                    continue;
+                }
+                emitida[c] = true;
+                for (int k = 0; k < 3; k++) {
+                    uint32_t g = indices[3 * (primera + c) + k], v = local[g];
+                    pila.push_back(v);
+                    vecinos.push_back(v);
+                    vivas[v]--;
+                    if (tiempo - entrada[g] > tamCacheVertices) {
+                        entrada[g] = tiempo++;
+                    }
+                }
+                memcpy(&malla.indices[3 * escrita++], &indices[3 * (primera + c)], 3 * sizeof(uint32_t));
+            }
+
+            //Siguiente vértice: el vecino con caras vivas que lleva más tiempo en el caché y que seguirá en él después
+            //de emitir sus caras; si ninguno cabe, cualquiera con caras vivas.
+            long mejor = -1;
+            actual = NINGUNO;
+            for (uint32_t v : vecinos) {
+                if (vivas[v] > 0) {
+                    long prioridad = 0;
+                    long edad = tiempo - entrada[globales[v]];
+                    if (edad + 2 * long(vivas[v]) <= tamCacheVertices) {
+                        prioridad = edad;
+                    }
+                    if (prioridad > mejor) {
+                        mejor = prioridad;
+                        actual = v;
+                    }
+                }
+            }
+            //Sin vecinos útiles, se regresa por la pila de vértices recientes o se toma la siguiente cara sin emitir.
+            while (actual == NINGUNO && !pila.empty()) {
+                uint32_t v = pila.back();
+                pila.pop_back();
+                if (vivas[v] > 0) {
+                    actual = v;
+                }
+            }
+            while (actual == NINGUNO && siguienteSinEmitir < numCarasMeshlet) {
+                if (!emitida[siguienteSinEmitir]) {
+                    actual = local[indices[3 * (primera + siguienteSinEmitir)]];
+                }
+                siguienteSinEmitir++;
+            }
+        }
+        for (uint32_t g : globales) {
+            local[g] = NINGUNO;
+        }
+    }
+
+    //Renumeración de los vértices por primer uso; los que ninguna cara usa quedan al final.
+    std::vector<uint32_t> nuevo(numVertices, NINGUNO);
+    uint32_t siguiente = 0;
+    for (size_t i = 0; i < 3 * numCaras; i++) {
+        if (nuevo[malla.indices[i]] == NINGUNO) {
+            nuevo[malla.indices[i]] = siguiente++;
+        }
+        malla.indices[i] = nuevo[malla.indices[i]];
+    }
+    for (size_t v = 0; v < numVertices; v++) {
+        if (nuevo[v] == NINGUNO) {
+            nuevo[v] = siguiente++;
+        }
+    }
+    float *arreglos[] = {malla.px, malla.py, malla.pz, malla.nx, malla.ny, malla.nz, malla.nw, malla.u, malla.v};
+    std::vector<float> copia(numVertices);
+    for (float *arreglo : arreglos) {
+        copia.assign(arreglo, arreglo + numVertices);
+        for (size_t v = 0; v < numVertices; v++) {
+            arreglo[nuevo[v]] = copia[v];
+        }
+    }
+    malla.cabecera()->reordenada = 1;
+}
+
+//Se mide la localidad del orden actual de las caras de la malla (ver MedicionCacheVertices).
+MedicionCacheVertices medirCacheVertices(const Malla &malla) {
+    size_t numCaras = malla.numCaras();
+    std::vector<long> entradaVertice(malla.numVertices(), -tamCacheVertices - 1);
+    std::vector<long> entradaLinea(malla.numVertices() / 16 + 1, -lineasCacheVertices - 1);
+    long fallosVertices = 0, fallosLineas = 0;
+
+    for (size_t i = 0; i < 3 * numCaras; i++) {
+        uint32_t v = malla.indices[i];
+        if (fallosVertices - entradaVertice[v] > tamCacheVertices) {
+            entradaVertice[v] = fallosVertices++;
+        }
+        if (fallosLineas - entradaLinea[v / 16] > lineasCacheVertices) {
+            entradaLinea[v / 16] = fallosLineas++;
+        }
+    }
+    return {numCaras > 0 ? double(fallosVertices) / numCaras : 0.0, numCaras > 0 ? double(fallosLineas) / numCaras : 0.0};
+}
+
+//Se construye el nodo del BVH que engloba a los meshlets [inicio, fin) y, recursivamente, a sus hijos.
+//Los nodos se guardan en preorden: el primer hijo va justo después de su padre y "siguiente" apunta al nodo que
+//sigue al subárbol, así que el recorrido no necesita pila. Regresa la posición del nodo.
+uint32_t construirNodoBVH(const std::vector<Meshlet> &meshlets, std::vector<NodoBVH> &nodos, uint32_t inicio, uint32_t fin) {
+    uint32_t nodo = nodos.size();
+    nodos.push_back(NodoBVH());
+    nodos[nodo].primerMeshlet = inicio;
+    nodos[nodo].numMeshlets = fin - inicio;
+
+    if (fin - inicio == 1) {
+        nodos[nodo].limites = meshlets[inicio].limites;
+    }
+    else {
+        uint32_t mitad = (inicio + fin) / 2;
+        uint32_t hijo1 = construirNodoBVH(meshlets, nodos, inicio, mitad);
+        uint32_t hijo2 = construirNodoBVH(meshlets, nodos, mitad, fin);
+        nodos[nodo].limites = unirLimites(nodos[hijo1].limites, nodos[hijo2].limites);
+    }
+    nodos[nodo].siguiente = nodos.size();
+    return nodo;
+}
+
+//Se regresan los límites (esfera y cono de normales) que engloban a los límites a y b.
+LimitesMeshlet unirLimites(const LimitesMeshlet &a, const LimitesMeshlet &b) {
+    Eigen::Vector3f centroA(a.centro), centroB(b.centro), ejeA(a.eje), ejeB(b.eje);
+    LimitesMeshlet union_;
+
+    //Esfera mínima que contiene a las dos esferas.
+    float distancia = (centroB - centroA).norm();
+    Eigen::Vector3f centro;
+    float radio;
+    if (distancia + b.radio <= a.radio) {
+        centro = centroA;
+        radio = a.radio;
+    }
+    else if (distancia + a.radio <= b.radio) {
+        centro = centroB;
+        radio = b.radio;
+    }
+    else {
+        radio = (distancia + a.radio + b.radio) / 2;
+        centro = centroA + (centroB - centroA) * ((radio - a.radio) / distancia);
+    }
+
+    //Cono que contiene a los dos conos: el eje es la bisectriz y la apertura la del cono más alejado de ella.
+    Eigen::Vector3f eje = ejeA + ejeB;
+    float cosCono = -1;
+    if (a.cosCono > 0 && b.cosCono > 0 && eje.norm() > 1e-6f) {
+        eje.normalize();
+        float angulo = std::max(std::acos(std::min(1.0f, eje.dot(ejeA))) + std::acos(a.cosCono),
+                                std::acos(std::min(1.0f, eje.dot(ejeB))) + std::acos(b.cosCono));
+        cosCono = angulo < M_PI / 2 ? std::cos(angulo) : -1.0f;
+    }
+    else {
+        eje = Eigen::Vector3f::UnitZ();
+    }
+    union_ = {{centro.x(), centro.y(), centro.z()}, radio * 1.0001f, {eje.x(), eje.y(), eje.z()}, cosCono};
+    return union_;
+}
+
+//Se recorre el BVH de la malla y se guardan en "visibles" los meshlets que pueden verse desde la cámara. Un subárbol
+//se descarta completo si su esfera queda fuera de un plano de la pirámide de visión (o de los planos cercano y lejano)
+//o si su cono de normales indica que todas sus caras dan la espalda a la cámara.
+void seleccionarMeshlets(const Malla &modelo, const Eigen::Matrix4f &camara, std::vector<uint32_t> &visibles) {
+    EstadisticasRecorte &estadisticas = vistaHilo != nullptr ? vistaHilo->estadisticas : estadisticasRecorte;
+    visibles.clear();
+    uint32_t i = 0;
+    while (i < modelo.numNodos) {
+        const NodoBVH &nodo = modelo.nodos[i];
+        int descarte = probarLimites(nodo.limites, camara);
+        if (descarte != DESCARTE_NINGUNO) {
+            (descarte == DESCARTE_FRUSTUM ? estadisticas.meshletsFrustum : estadisticas.meshletsCono) += nodo.numMeshlets;
+            i = nodo.siguiente;
+            continue;
+        }
+
+        if (nodo.numMeshlets == 1) {
+            visibles.push_back(nodo.primerMeshlet);
+            i = nodo.siguiente;
+        }
+        else {
+            i++;
+        }
+    }
+}
+
+//Se prueban la esfera y el cono de normales de "limites" contra la cámara. Regresa DESCARTE_FRUSTUM si la esfera queda
+//fuera de un plano de la pirámide de visión (o de los planos cercano y lejano), DESCARTE_CONO si todas las caras dan la
+//espalda a la cámara y DESCARTE_NINGUNO si alguna puede verse.
+int probarLimites(const LimitesMeshlet &limites, const Eigen::Matrix4f &camara) {
+    //Planos laterales en coordenadas de cámara (normal unitaria hacia afuera): -w <= 2 * planoCercano * aspecto * x <= w
+    //y -w <= 2 * planoCercano * y <= w, con w = -z.
+    float n = 2 * planoCercano, norma = std::sqrt(n * n + 1);
+    float nx = n * destino.aspecto, normaX = std::sqrt(nx * nx + 1);
+    const Eigen::Vector3f planos[4] = {Eigen::Vector3f(-nx, 0, 1) / normaX, Eigen::Vector3f(nx, 0, 1) / normaX,
+                                       Eigen::Vector3f(0, -n, 1) / norma, Eigen::Vector3f(0, n, 1) / norma};
+    Eigen::Vector3f centro = (camara * Eigen::Vector4f(limites.centro[0], limites.centro[1], limites.centro[2], 1)).head<3>();
+    float radio = limites.radio;
+
+    //Prueba contra la pirámide de visión.
+    bool fuera = -centro.z() + radio < planoCercano || -centro.z() - radio > planoLejano;
+    for (int p = 0; p < 4 && !fuera; p++) {
+        fuera = planos[p].dot(centro) > radio;
+    }
+    if (fuera) {
+        return DESCARTE_FRUSTUM;
+    }
+
+    //Prueba del cono: todas las caras dan la espalda a la cámara (que está en el origen) si, para cualquier
+    //normal del cono y cualquier punto de la esfera, la normal apunta en dirección contraria a la cámara.
+    if (limites.cosCono > 0) {
+        Eigen::Vector3f eje = camara.topLeftCorner<3, 3>() * Eigen::Vector3f(limites.eje[0], limites.eje[1], limites.eje[2]);
+        float a = eje.dot(centro);
+        float b = std::sqrt(std::max(0.0f, centro.squaredNorm() - a * a));
+        float senoCono = std::sqrt(1 - limites.cosCono * limites.cosCono);
+        if (a * limites.cosCono - b * senoCono > radio) {
+            return DESCARTE_CONO;
+        }
+    }
+    return DESCARTE_NINGUNO;
+}
+
+//Se ordenan los meshlets visibles por la profundidad del centro de su esfera, del más cercano al más lejano, para que
+//las caras cercanas se dibujen primero y el buffer de profundidad jerárquico oculte más caras lejanas. El orden cambia
+//qué cara gana cuando dos tienen exactamente la misma profundidad en un pixel.
+void ordenarMeshlets(const Malla &modelo, const Eigen::Matrix4f &camara, std::vector<uint32_t> &visibles) {
+    std::vector<std::pair<float, uint32_t>> profundidades(visibles.size());
+    for (size_t i = 0; i < visibles.size(); i++) {
+        const float *centro = modelo.meshlets[visibles[i]].limites.centro;
+        profundidades[i] = {-camara.row(2).dot(Eigen::Vector4f(centro[0], centro[1], centro[2], 1)), visibles[i]};
+    }
+    std::stable_sort(profundidades.begin(), profundidades.end(),
+                     [](const std::pair<float, uint32_t> &a, const std::pair<float, uint32_t> &b) { return a.first < b.first; });
+    for (size_t i = 0; i < visibles.size(); i++) {
+        visibles[i] = profundidades[i].second;
+    }
+}
+
+//Se lanza el hilo que construye la cadena de niveles de detalle de la malla. Cada nivel se simplifica a partir de la
+//malla completa con celdas del doble de tamaño que el anterior, y sólo se guarda si tiene a lo más la mitad de caras.
+void iniciarNivelesDetalle(Malla &malla) {
+    if (malla.detalle || malla.numCaras() == 0) {
+        return;
+    }
+    malla.detalle = std::make_shared<CadenaDetalle>();
+    Malla fuente = malla;
+    fuente.detalle.reset();
+    CadenaDetalle *cadena = malla.detalle.get();
+    cadena->constructor = std::thread([fuente, cadena] {
+        auto inicio = std::chrono::steady_clock::now();
+        const CabeceraMalla *cabecera = fuente.cabecera();
+        float lado = std::max(cabecera->maximo[0] - cabecera->minimo[0],
+                              std::max(cabecera->maximo[1] - cabecera->minimo[1], cabecera->maximo[2] - cabecera->minimo[2]));
+        uint32_t carasAnteriores = fuente.numCaras();
+        for (int resolucion : resolucionesDetalle) {
+            auto nivel = std::make_shared<NivelDetalle>();
+            nivel->tamCelda = lado / resolucion;
+            nivel->malla = simplificarMalla(fuente, nivel->tamCelda, cadena->cancelar);
+            if (cadena->cancelar) {
+                break;
+            }
+            if (nivel->malla.numCaras() == 0 || nivel->malla.numCaras() > carasAnteriores / 2) {
+                continue;
+            }
+            carasAnteriores = nivel->malla.numCaras();
+            std::lock_guard<std::mutex> lock(cadena->mutex);
+            cadena->niveles.push_back(nivel);
+        }
+
+        std::lock_guard<std::mutex> lock(cadena->mutex);
+        if (!cadena->cancelar) {
+            std::cout << "Se construyeron " << cadena->niveles.size() << " niveles de detalle en "
+                      << std::chrono::duration<double>(std::chrono::steady_clock::now() - inicio).count() << " s (";
+            for (size_t i = 0; i < cadena->niveles.size(); i++) {
+                std::cout << (i > 0 ? ", " : "") << cadena->niveles[i]->malla.numCaras();
+            }
+            std::cout << " caras).\n";
+        }
+        cadena->completa = true;
+        cadena->terminada.notify_all();
+    });
+}
+
+//Se espera a que termine de construirse la cadena de niveles de detalle de la malla.
+void esperarNivelesDetalle(const Malla &malla) {
+    if (malla.detalle) {
+        std::unique_lock<std::mutex> lock(malla.detalle->mutex);
+        malla.detalle->terminada.wait(lock, [&] { return malla.detalle->completa; });
+    }
+}
+
+//Se detiene (si no ha terminado) y se espera al hilo que construye los niveles de detalle de la malla.
+void detenerNivelesDetalle(const Malla &malla) {
+    if (malla.detalle && malla.detalle->constructor.joinable()) {
+        malla.detalle->cancelar = true;
+        malla.detalle->constructor.join();
+    }
+}
+
+//Se construye una versión simplificada de la malla "fuente" agrupando sus vértices en celdas de lado tamCelda (vertex
+//clustering con métricas de error cuádricas, como en Lindstrom, 2000). Cada celda se vuelve un solo vértice, colocado
+//donde minimiza la suma ponderada por área de las distancias al cuadrado a los planos de las caras que tocan la celda;
+//sus normales y UVs son el promedio de las de los vértices originales. Las caras con dos vértices en la misma celda
+//desaparecen y las repetidas se dejan una sola vez. Regresa una malla vacía si se activa "cancelar".
+Malla simplificarMalla(const Malla &fuente, float tamCelda, const std::atomic<bool> &cancelar) {
+    //Cuádrica de una celda (matriz simétrica de 4x4 guardada como su triángulo superior) y sumas de sus atributos.
+    struct Grupo {
+        double q[10];
+        double posicion[3], normal[4], coordTex[2];
+        uint32_t vertices;
+    };
+    const CabeceraMalla *cabecera = fuente.cabecera();
+    size_t n = fuente.numVertices();
+    uint64_t celdas[3];
+    for (int k = 0; k < 3; k++) {
+        celdas[k] = uint64_t((cabecera->maximo[k] - cabecera->minimo[k]) / tamCelda) + 1;
+    }
+
+    //Se agrupan los vértices por celda; los grupos quedan en el orden de sus celdas.
+    std::vector<uint64_t> claves(n);
+    for (size_t i = 0; i < n; i++) {
+        float p[3] = {fuente.px[i], fuente.py[i], fuente.pz[i]};
+        uint64_t c[3];
+        for (int k = 0; k < 3; k++) {
+            c[k] = std::min(celdas[k] - 1, uint64_t(std::max(0.0f, (p[k] - cabecera->minimo[k]) / tamCelda)));
+        }
+        claves[i] = (c[0] * celdas[1] + c[1]) * celdas[2] + c[2];
+    }
+    std::vector<uint64_t> unicas = claves;
+    std::sort(unicas.begin(), unicas.end());
+    unicas.erase(std::unique(unicas.begin(), unicas.end()), unicas.end());
+    std::vector<uint32_t> grupo(n);
+    std::vector<Grupo> grupos(unicas.size(), Grupo());
+    for (size_t i = 0; i < n; i++) {
+        grupo[i] = std::lower_bound(unicas.begin(), unicas.end(), claves[i]) - unicas.begin();
+        Grupo &g = grupos[grupo[i]];
+        Eigen::Vector4f normal = fuente.normal(i);
+        g.posicion[0] += fuente.px[i];
+        g.posicion[1] += fuente.py[i];
+        g.posicion[2] += fuente.pz[i];
+        for (int k = 0; k < 4; k++) {
+            g.normal[k] += normal[k];
+        }
+        g.coordTex[0] += fuente.u[i];
+        g.coordTex[1] += fuente.v[i];
+        g.vertices++;
+    }
+    if (cancelar) {
+        return Malla();
+    }
+
+    //Cuádrica del plano de cada cara, ponderada por su área, sumada a las celdas de sus tres vértices.
+    for (size_t i = 0; i < fuente.numCaras(); i++) {
+        const uint32_t *indices = &fuente.indices[3*i];
+        Eigen::Vector3d a(fuente.px[indices[0]], fuente.py[indices[0]], fuente.pz[indices[0]]);
+        Eigen::Vector3d b(fuente.px[indices[1]], fuente.py[indices[1]], fuente.pz[indices[1]]);
+        Eigen::Vector3d c(fuente.px[indices[2]], fuente.py[indices[2]], fuente.pz[indices[2]]);
+        Eigen::Vector3d normal = (b - a).cross(c - a);
+        double doble = normal.norm();   //El doble del área de la cara.
+        if (!(doble > 0)) {
+            continue;
+        }
+        normal /= doble;
+        double plano[4] = {normal.x(), normal.y(), normal.z(), -normal.dot(a)};
+        double q[10];
+        for (int f = 0, e = 0; f < 4; f++) {
+            for (int k = f; k < 4; k++) {
+                q[e++] = doble / 2 * plano[f] * plano[k];
+            }
+        }
+        for (int k = 0; k < 3; k++) {
+            Grupo &g = grupos[grupo[indices[k]]];
+            for (int e = 0; e < 10; e++) {
+                g.q[e] += q[e];
+            }
+        }
+    }
+
+    //Vértice de cada celda: el mínimo de su cuádrica si el sistema está bien condicionado y no se aleja de la celda;
+    //si no, el promedio de sus vértices.
+    MallaOBJ simplificada;
+    simplificada.uvsArchivo = fuente.uvsArchivo;
+    for (const Grupo &g : grupos) {
+        Eigen::Vector3d promedio = Eigen::Vector3d(g.posicion[0], g.posicion[1], g.posicion[2]) / g.vertices;
+        Eigen::Matrix3d A;
+        A << g.q[0], g.q[1], g.q[2],
+             g.q[1], g.q[4], g.q[5],
+             g.q[2], g.q[5], g.q[7];
+        Eigen::Vector3d posicion = promedio;
+        Eigen::FullPivLU<Eigen::Matrix3d> lu(A);
+        lu.setThreshold(1e-6);
+        if (lu.rank() == 3) {
+            Eigen::Vector3d minimo = lu.solve(-Eigen::Vector3d(g.q[3], g.q[6], g.q[8]));
+            if ((minimo - promedio).norm() <= tamCelda) {
+                posicion = minimo;
+            }
+        }
+        Eigen::Vector4d normal = Eigen::Vector4d(g.normal[0], g.normal[1], g.normal[2], g.normal[3]).normalized();
+        simplificada.px.push_back(posicion.x());
+        simplificada.py.push_back(posicion.y());
+        simplificada.pz.push_back(posicion.z());
+        simplificada.nx.push_back(normal.x());
+        simplificada.ny.push_back(normal.y());
+        simplificada.nz.push_back(normal.z());
+        simplificada.nw.push_back(normal.w());
+        simplificada.u.push_back(g.coordTex[0] / g.vertices);
+        simplificada.v.push_back(g.coordTex[1] / g.vertices);
+    }
+
+    //Caras entre celdas distintas, rotadas para empezar en su menor índice (sin cambiar su orientación) y sin repetir.
+    std::vector<std::array<uint32_t, 3>> caras;
+    for (size_t i = 0; i < fuente.numCaras(); i++) {
+        std::array<uint32_t, 3> cara = {grupo[fuente.indices[3*i]], grupo[fuente.indices[3*i + 1]], grupo[fuente.indices[3*i + 2]]};
+        if (cara[0] == cara[1] || cara[1] == cara[2] || cara[2] == cara[0]) {
+            continue;
+        }
+        std::rotate(cara.begin(), std::min_element(cara.begin(), cara.end()), cara.end());
+        caras.push_back(cara);
+    }
+    std::sort(caras.begin(), caras.end());
+    caras.erase(std::unique(caras.begin(), caras.end()), caras.end());
+    for (const std::array<uint32_t, 3> &cara : caras) {
+        simplificada.indices.insert(simplificada.indices.end(), cara.begin(), cara.end());
+    }
+    if (cancelar) {
+        return Malla();
+    }
+
+    Malla malla = empaquetarMalla(simplificada);
+    construirMeshlets(malla);
+    malla.cabecera()->uvsEsfericas = cabecera->uvsEsfericas;
+    return malla;
+}
+
+//Se elige la malla con la que se renderiza un frame con la matriz modelo-vista dada. "nivel" es 0 para la malla
+//completa, k > 0 para el k-ésimo nivel simplificado (o el más burdo que haya) y -1 para el que se usa en movimiento:
+//el más burdo cuyas celdas, proyectadas a la distancia del centro del modelo, miden a lo más errorDetalle pixeles.
+//El tamaño proyectado de una celda es su fracción del radio del modelo por el radio proyectado del modelo en pantalla.
+//"retenido" mantiene vivo el nivel elegido mientras se renderiza.
+const Malla &elegirNivelDetalle(const Malla &modelo, const Eigen::Matrix4f &modeloVista, int nivel, std::shared_ptr<const NivelDetalle> &retenido) {
+    retenido.reset();
+    if (nivel == 0 || !modelo.detalle) {
+        return modelo;
+    }
+    std::vector<std::shared_ptr<const NivelDetalle>> niveles;
+    {
+        std::lock_guard<std::mutex> lock(modelo.detalle->mutex);
+        niveles = modelo.detalle->niveles;
+    }
+    if (niveles.empty()) {
+        return modelo;
+    }
+
+    if (nivel > 0) {
+        retenido = niveles[std::min<size_t>(nivel, niveles.size()) - 1];
+    }
+    else {
+        const CabeceraMalla *cabecera = modelo.cabecera();
+        Eigen::Vector3f minimo(cabecera->minimo[0], cabecera->minimo[1], cabecera->minimo[2]);
+        Eigen::Vector3f maximo(cabecera->maximo[0], cabecera->maximo[1], cabecera->maximo[2]);
+        Eigen::Vector3f centro = (minimo + maximo) / 2;
+        float radio = (maximo - minimo).norm() / 2;
+        float distancia = std::max(float(planoCercano), -(modeloVista * Eigen::Vector4f(centro.x(), centro.y(), centro.z(), 1)).z());
+        float radioPantalla = radio * planoCercano * destino.alto / distancia;
+        for (const std::shared_ptr<const NivelDetalle> &candidato : niveles) {
+            if (candidato->tamCelda / radio * radioPantalla <= errorDetalle) {
+                retenido = candidato;
+            }
+        }
+        if (!retenido) {
+            return modelo;
+        }
+    }
+    std::cout << "Nivel de detalle: " << retenido->malla.numCaras() << " de " << modelo.numCaras() << " caras.\n";
+    return retenido->malla;
+}
+
+#ifndef SIN_X11
+//Función para configurar la ventana y los eventos de teclado de X11.
+void configurarVentana() {
+    //Apertura del display. El hilo de renderizado despliega los frames mientras este hilo espera eventos.
+    XInitThreads();
+    display = XOpenDisplay(0);
+    if (display == NULL) {
+        std::cout << "No se pudo conectar a X server." << std::endl;
+        exit(-1);
+    }
+
+    //Creación de la ventana.
+    win = XCreateSimpleWindow(display, DefaultRootWindow(display), 0, 0, anchoVen, altoVen, 0, WhitePixel(display, DefaultScreen(display)), BlackPixel(display, DefaultScreen(display)));
+
+    //Se asigna un nombre a la ventana generada.
+    XStoreName(display, win, "PROYECTO 1");
+
+    //Mostrar la ventana en pantalla.
+    XMapWindow(display, win);
+
+    //Solicitar a X server que mande notificaciones de la ventana activa.
+    XSelectInput(display, win, KeyPressMask | StructureNotifyMask | ExposureMask);    
+
+    //Se verifica que la ventana sea TrueColor para poder escribir los pixeles directamente.
+    visual = DefaultVisual(display, DefaultScreen(display));
+    profundidadVen = DefaultDepth(display, DefaultScreen(display));
+    if (visual->c_class != TrueColor) {
+        std::cout << "El display no es TrueColor." << std::endl;
+        exit(-1);
+    }
+    despRojo = __builtin_ctzl(visual->red_mask);
+    despVerde = __builtin_ctzl(visual->green_mask);
+    despAzul = __builtin_ctzl(visual->blue_mask);
+
+    //Crear el contexto gráfico con valores por defecto (0, 0).
+    gc = XCreateGC(display, win, 0, 0);
+
+    //Se espera el evento MapNotify para poder empezar el dibujo.
+    for(;;) {
+        XEvent e;
+	    XNextEvent(display, &e);
+	    if (e.type == MapNotify)
+		    break;
+    }
+
+    //Se crean los framebuffers en los que se compondrán los frames.
+    crearFramebuffers();
+
+    return;
+}
+
+//Manejador de errores de X11 que sólo registra que ocurrió un error (para detectar si MIT-SHM falla).
+bool errorShm = false;
+int manejarErrorShm(Display *, XErrorEvent *) {
+    errorShm = true;
+    return 0;
+}
+
+//Se crean los dos framebuffers del tamaño de la ventana, usando memoria compartida con el servidor si es posible.
+void crearFramebuffers() {
+    usarShm = XShmQueryExtension(display);
+    
+    for (int i = 0; i < 2; i++) {
+        Framebuffer &fb = framebuffers[i];
+        
+        if (usarShm) {
+            //Se crea la imagen y un segmento de memoria compartida para sus pixeles.
+            fb.imagen = XShmCreateImage(display, visual, profundidadVen, ZPixmap, NULL, &fb.shm, anchoVen, altoVen);
+            fb.shm.shmid = shmget(IPC_PRIVATE, fb.imagen->bytes_per_line * fb.imagen->height, IPC_CREAT | 0600);
+            fb.shm.shmaddr = fb.shm.shmid < 0 ? (char *) -1 : (char *) shmat(fb.shm.shmid, 0, 0);
+            fb.shm.readOnly = False;
+
+            //Si se llegó al límite de memoria compartida del sistema, también se regresa a XPutImage.
+            bool sinSegmento = fb.shm.shmaddr == (char *) -1;
+            if (!sinSegmento) {
+                fb.imagen->data = fb.shm.shmaddr;
+
+                //Si el servidor es remoto, XShmAttach falla y se regresa a XPutImage.
+                errorShm = false;
+                XErrorHandler anterior = XSetErrorHandler(manejarErrorShm);
+                XShmAttach(display, &fb.shm);
+                XSync(display, False);
+                XSetErrorHandler(anterior);
+            }
+            if (fb.shm.shmid >= 0) {
+                shmctl(fb.shm.shmid, IPC_RMID, 0);  //El segmento se libera cuando ambos lados se desconecten.
+            }
+            
+            if (sinSegmento || errorShm) {
+                if (!sinSegmento) {
+                    shmdt(fb.shm.shmaddr);
+                }
+                fb.imagen->data = NULL;
+                XDestroyImage(fb.imagen);
+                if (i == 1) {
+                    //Si falló el segundo, también se libera el primero.
+                    XShmDetach(display, &framebuffers[0].shm);
+                    shmdt(framebuffers[0].shm.shmaddr);
+                    framebuffers[0].imagen->data = NULL;
+                    XDestroyImage(framebuffers[0].imagen);
+                }
+                usarShm = false;
+                i = -1; //Se reinicia la creación sin MIT-SHM.
+                continue;
+            }
+        }
+        else {
+            //Sin MIT-SHM se crea una imagen normal cuyos pixeles se envían con XPutImage.
+            char *datos = (char *) malloc(anchoVen * altoVen * sizeof(uint32_t));
+            fb.imagen = XCreateImage(display, visual, profundidadVen, ZPixmap, 0, datos, anchoVen, altoVen, 32, 0);
+        }
+
+        //El framebuffer escribe pixeles de 32 bits directamente en la imagen.
+        if (fb.imagen->bits_per_pixel != 32) {
+            std::cout << "El display no usa pixeles de 32 bits." << std::endl;
+            exit(-1);
+        }
+        fb.pixeles = (uint32_t *) fb.imagen->data;
+    }
+    frameTrasero = 0;
+}
+
+//Se liberan los framebuffers y, en su caso, los segmentos de memoria compartida.
+void destruirFramebuffers() {
+    for (int i = 0; i < 2; i++) {
+        if (usarShm) {
+            XShmDetach(display, &framebuffers[i].shm);
+            shmdt(framebuffers[i].shm.shmaddr);
+            framebuffers[i].imagen->data = NULL;
+        }
+        XDestroyImage(framebuffers[i].imagen);  //Sin MIT-SHM, también libera los pixeles.
+    }
+}
+#endif
+
+//Se toma el modelo, las luces, la cámara, la matriz del modelo, el buffer de proyección y se realiza el proceso de
+//renderizado con el renderizador seleccionado. La malla nunca se modifica: la matriz del modelo se combina con la de
+//la cámara en una matriz modelo-vista que sólo se aplica en la etapa de vértices, y las normales se transforman al
+//sombrear con la inversa transpuesta de su parte lineal. Regresa falso si el frame se canceló (cancelarFrame) antes de terminar.
+//Cada frame terminado se pasa del destino de render al framebuffer trasero y se reporta con reportarFrame.
+bool renderizar(const Malla &modelo, const std::vector<Luz> &luces, Eigen::Matrix4f camara, Eigen::Matrix4f transformacion, float *bufferProf) {
+    Eigen::Matrix4f modeloVista = camara * transformacion;
+    auto inicio = std::chrono::steady_clock::now();
+    bool terminado;
+
+    //La cámara sólo se traslada, así que las normales quedan en el mismo espacio que las luces.
+    transformacionNormales = Eigen::Matrix4f::Identity();
+    transformacionNormales.topLeftCorner<3, 3>() = modeloVista.topLeftCorner<3, 3>().inverse().transpose();
+    prepararSombreado(luces);
+    iniciarFrame();
+    if (usarReferencia) {
+        terminado = renderizarReferencia(modelo, modeloVista, bufferProf);
+    }
+    else if (ladrillos != nullptr) {
+        terminado = renderizarLadrillos(*ladrillos, modeloVista, bufferProf);
+    }
+    else {
+        terminado = renderizarMosaicos(modelo, modeloVista, bufferProf, false);
+    }
+    if (terminado) {
+        resolverDestino();
+        reportarFrame(inicio, std::chrono::steady_clock::now());
+    }
+    return terminado;
+}
+
+//Se reinician los contadores de todos los hilos y las estadísticas de descarte antes de renderizar un frame.
+void iniciarFrame() {
+    for (ContadoresHilo &hilo : contadoresHilos) {
+        std::fill(hilo.contadores, hilo.contadores + NUM_CONTADORES, 0);
+        std::fill(hilo.segundos, hilo.segundos + NUM_ETAPAS, 0.0);
+        std::fill(hilo.lineasTextura, hilo.lineasTextura + lineasCacheTextura, 0);
+        hilo.eventos.clear();
+    }
+    estadisticasRecorte = EstadisticasRecorte();
+}
+
+//Se suman los contadores de los hilos y se imprime el resumen del frame que duró de "inicio" a "fin". Si se pidió, el
+//frame también se agrega al archivo de estadísticas y sus etapas, a la traza. Las etapas de vértices, BVH, binning y
+//mosaicos corren en el hilo 0 y su tiempo es de reloj; el rasterizado y el sombreado se suman entre todos los hilos.
+void reportarFrame(std::chrono::steady_clock::time_point inicio, std::chrono::steady_clock::time_point fin) {
+    const EstadisticasRecorte &recorte = estadisticasRecorte;
+    long contadores[NUM_CONTADORES] = {};
+    double segundos[NUM_ETAPAS] = {};
+    double milisegundos = std::chrono::duration<double, std::milli>(fin - inicio).count();
+
+    for (const ContadoresHilo &hilo : contadoresHilos) {
+        for (int c = 0; c < NUM_CONTADORES; c++) {
+            contadores[c] += hilo.contadores[c];
+        }
+        for (int e = 0; e < NUM_ETAPAS; e++) {
+            segundos[e] += hilo.segundos[e];
+        }
+    }
+    numFrame++;
+
+    std::cout << "Frame " << numFrame << ": " << milisegundos << " ms";
+#ifndef SIN_INSTRUMENTACION
+    if (!usarReferencia) {
+        std::cout << " (vértices " << segundos[ETAPA_VERTICES] * 1e3 << ", BVH " << segundos[ETAPA_BVH] * 1e3 << ", binning "
+                  << segundos[ETAPA_BINNING] * 1e3 << ", mosaicos " << segundos[ETAPA_MOSAICOS] * 1e3 << " ms; rasterizado "
+                  << segundos[ETAPA_RASTERIZADO] * 1e3 << " y sombreado " << segundos[ETAPA_SOMBREADO] * 1e3 << " ms sumando los hilos)";
+    }
+#endif
+    std::cout << ".\n";
+    if (!usarReferencia) {
+        std::cout << "  " << recorte.vertices << " vértices (" << recorte.transformacionesEvitadas << " transformaciones evitadas); "
+                  << recorte.meshletsVisibles << " de " << recorte.meshlets << " meshlets visibles (" << recorte.meshletsFrustum
+                  << " fuera del frustum, " << recorte.meshletsCono << " por su cono de normales); ";
+    }
+    else {
+        std::cout << "  ";
+    }
+    std::cout << recorte.caras << " caras revisadas, " << recorte.fueraFrustum << " fuera del frustum, " << recorte.traseras << " traseras, "
+              << recorte.recortadas << " recortadas, " << recorte.fueraVentana << " fuera de la ventana; " << recorte.dibujados
+              << " triángulos a rasterizar.\n";
+#ifndef SIN_INSTRUMENTACION
+    std::cout << "  " << contadores[CONTADOR_RASTERIZADOS] << " rasterizados";
+    if (usarHiZ && !usarReferencia) {
+        std::cout << " (Hi-Z: " << contadores[CONTADOR_OCULTOS_HIZ] << " ocultos, " << contadores[CONTADOR_BLOQUES_HIZ] << " bloques de "
+                  << tamBloqueHiZ << "x" << tamBloqueHiZ << " evitados, " << contadores[CONTADOR_RECALCULOS_HIZ] << " recalculados)";
+    }
+    std::cout << "; " << contadores[CONTADOR_PIXELES_PROBADOS] << " pixeles probados, " << contadores[CONTADOR_PROFUNDIDAD]
+              << " pasaron la prueba de profundidad, " << contadores[CONTADOR_SOMBREADOS] << " sombreados (sobredibujado de "
+              << contadores[CONTADOR_PROFUNDIDAD] / std::max(1.0, double(contadores[CONTADOR_SOMBREADOS])) << ")";
+    if (!textura.niveles.empty()) {
+        std::cout << "; " << contadores[CONTADOR_TEXELES] << " texeles leídos, " << contadores[CONTADOR_FALLOS_TEXTURA]
+                  << " fallos en un caché simulado de " << lineasCacheTextura * 64 / 1024 << " KB";
+    }
+    std::cout << ".\n";
+#endif
+
+    if (archivoEstadisticas.is_open()) {
+        archivoEstadisticas << (numFrame > 1 ? ",\n" : "") << "  {\"frame\": " << numFrame << ", \"ms\": " << milisegundos
+                            << ", \"etapas_ms\": {";
+        for (int e = 0; e < NUM_ETAPAS; e++) {
+            archivoEstadisticas << (e > 0 ? ", " : "") << "\"" << nombresEtapas[e] << "\": " << segundos[e] * 1e3;
+        }
+        archivoEstadisticas << "}, \"contadores\": {";
+        for (int c = 0; c < NUM_CONTADORES; c++) {
+            archivoEstadisticas << (c > 0 ? ", " : "") << "\"" << nombresContadores[c] << "\": " << contadores[c];
+        }
+        archivoEstadisticas << "}, \"descarte\": {\"vertices\": " << recorte.vertices << ", \"transformaciones_evitadas\": "
+                            << recorte.transformacionesEvitadas << ", \"meshlets\": " << recorte.meshlets << ", \"meshlets_visibles\": "
+                            << recorte.meshletsVisibles << ", \"meshlets_frustum\": " << recorte.meshletsFrustum << ", \"meshlets_cono\": "
+                            << recorte.meshletsCono << ", \"caras\": " << recorte.caras << ", \"fuera_frustum\": " << recorte.fueraFrustum
+                            << ", \"traseras\": " << recorte.traseras << ", \"recortadas\": " << recorte.recortadas << ", \"fuera_ventana\": "
+                            << recorte.fueraVentana << ", \"dibujados\": " << recorte.dibujados << "}}";
+        archivoEstadisticas.flush();
+    }
+    if (archivoTraza.is_open()) {
+        archivoTraza << ",\n{\"name\": \"frame " << numFrame << "\", \"cat\": \"frame\", \"ph\": \"X\", \"ts\": "
+                     << std::chrono::duration_cast<std::chrono::microseconds>(inicio - inicioPrograma).count() << ", \"dur\": "
+                     << std::chrono::duration_cast<std::chrono::microseconds>(fin - inicio).count() << ", \"pid\": 1, \"tid\": 0}";
+        for (size_t h = 0; h < contadoresHilos.size(); h++) {
+            for (const EventoTraza &evento : contadoresHilos[h].eventos) {
+                archivoTraza << ",\n{\"name\": \"" << nombresEtapas[evento.etapa] << "\", \"cat\": \"render\", \"ph\": \"X\", \"ts\": "
+                             << evento.inicio << ", \"dur\": " << evento.duracion << ", \"pid\": 1, \"tid\": " << h << "}";
+            }
+            contadoresHilos[h].eventos.clear();
+        }
+        archivoTraza.flush();
+    }
+}
+
+//Se abren los archivos de estadísticas por frame (JSON) y de traza (formato de eventos de Chrome, se abre en
+//chrome://tracing o en Perfetto); un nombre vacío significa que no se pidió. Regresa falso si no se pudo crear alguno.
+bool abrirInstrumentacion(const std::string &estadisticas, const std::string &traza) {
+    if (!estadisticas.empty()) {
+        archivoEstadisticas.open(estadisticas);
+        if (!archivoEstadisticas) {
+            std::cout << "No se pudo crear el archivo de estadísticas '" << estadisticas << "'." << std::endl;
+            return false;
+        }
+        archivoEstadisticas << "[\n";
+    }
+    if (!traza.empty()) {
+        archivoTraza.open(traza);
+        if (!archivoTraza) {
+            std::cout << "No se pudo crear el archivo de traza '" << traza << "'." << std::endl;
+            return false;
+        }
+        archivoTraza << "{\"traceEvents\": [\n{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"proyecto1\"}}";
+    }
+    return true;
+}
+
+//Se cierran los arreglos JSON de los archivos de estadísticas y de traza para que queden completos.
+void cerrarInstrumentacion() {
+    if (archivoEstadisticas.is_open()) {
+        archivoEstadisticas << "\n]\n";
+        archivoEstadisticas.close();
+    }
+    if (archivoTraza.is_open()) {
+        archivoTraza << "\n]}\n";
+        archivoTraza.close();
+    }
+}
+
+//Renderizador original: se rasteriza cada cara completa, una tras otra, en un solo hilo.
+bool renderizarReferencia(const Malla &modelo, Eigen::Matrix4f camara, float *bufferProf) {
+    TrianguloPantalla triangulo;
+
+    //Se rellena el buffer de profundidad con el valor del plano lejano.
+    std::fill(bufferProf, bufferProf + size_t(destino.paso) * destino.alto, float(planoLejano));
+
+    //Se analiza cada una de las caras del modelo.
+    estadisticasRecorte.caras = modelo.numCaras();
+    for (uint32_t i = 0; i < modelo.numCaras(); ++i) {
+        if (cancelarFrame.load(std::memory_order_relaxed)) {
+            return false;
+        }
+
+        //Si la cara entra en la ventana, se manda a dibujar con las coordenadas del cuadrilátero que la engloba.
+        if (proyectarCara(modelo, i, camara, triangulo)) {
+            estadisticasRecorte.dibujados++;
+            CONTAR(CONTADOR_RASTERIZADOS, 1);
+            CONTAR(CONTADOR_PIXELES_PROBADOS, (triangulo.xf - triangulo.xi + 1) * (triangulo.yf - triangulo.yi + 1));
+            dibujarMasCercano(modelo, triangulo, bufferProf, triangulo.xi, triangulo.yi, triangulo.xf, triangulo.yf);
+        }
+    }
+    return true;
+}
+
+//Renderizador por mosaicos: primero se proyectan las caras y se reparten en los mosaicos de pantalla que cubren;
+//después cada hilo rasteriza mosaicos completos, con su parte del buffer de profundidad y del framebuffer.
+//Como cada mosaico procesa sus caras en el orden del modelo, el resultado es el mismo que el del renderizador original
+//(salvo el redondeo de las edge functions incrementales del kernel de rasterización).
+//Si se activa cancelarFrame, el binning y los hilos dejan de tomar trabajo y se regresa falso.
+//Si "continuar" es verdadero, la malla se dibuja sobre el frame que dejó la llamada anterior (otro ladrillo del modelo
+//fuera de núcleo): no se limpian el buffer de profundidad ni el jerárquico. Los contadores siempre se acumulan en los
+//del frame.
+bool renderizarMosaicos(const Malla &modelo, Eigen::Matrix4f camara, float *bufferProf, bool continuar) {
+    int mosaicosX = (destino.ancho + tamMosaico - 1) / tamMosaico;  //Columnas de mosaicos.
+    int mosaicosY = (destino.alto + tamMosaico - 1) / tamMosaico;   //Filas de mosaicos.
+    int numMosaicos = mosaicosX * mosaicosY;
+    static std::vector<TrianguloPantalla> triangulos;       //Caras visibles ya proyectadas (se reusa entre frames).
+    static std::vector<std::vector<int>> bins;              //Índices de los triángulos que cubren cada mosaico.
+    static VerticesTransformados vertices;                  //Buffer post-transformación del frame.
+    static std::vector<uint32_t> meshletsVisibles;          //Meshlets que sobrevivieron al recorrido del BVH.
+    std::vector<ColaMosaicos> colas(numHilos);              //Mosaicos pendientes de cada hilo.
+    TrianguloPantalla ensamblados[3];                       //Triángulos que salen de una cara (más de uno si se recortó).
+
+    triangulos.clear();
+    triangulos.reserve(modelo.numCaras());
+    if (usarDiferido) {
+        bufferVisibilidad.resize(size_t(destino.paso) * destino.alto);
+    }
+    recortes.clear();
+    bins.resize(numMosaicos);
+    if (usarHiZ) {
+        prepararHiZ(numMosaicos);
+    }
+    for (std::vector<int> &bin : bins) {
+        bin.clear();
+    }
+
+    //Etapa de vértices: cada vértice único se transforma una sola vez.
+    {
+        MEDIR_ETAPA(ETAPA_VERTICES);
+        procesarVertices(modelo, camara, vertices);
+    }
+    estadisticasRecorte.vertices += modelo.numVertices();
+    estadisticasRecorte.transformacionesEvitadas += vertices.transformacionesEvitadas;
+
+    //Se recorre el BVH para quedarse sólo con los meshlets que pueden verse.
+    {
+        MEDIR_ETAPA(ETAPA_BVH);
+        seleccionarMeshlets(modelo, camara, meshletsVisibles);
+        if (ordenarFrenteAtras) {
+            ordenarMeshlets(modelo, camara, meshletsVisibles);
+        }
+    }
+    estadisticasRecorte.meshlets += modelo.numMeshlets;
+    estadisticasRecorte.meshletsVisibles += meshletsVisibles.size();
+
+    //Etapa de binning: se arma cada cara de los meshlets visibles (descartando y recortando) y se agrega a la lista
+    //de cada mosaico que toca su cuadrilátero.
+    {
+        MEDIR_ETAPA(ETAPA_BINNING);
+        for (size_t m = 0; m < meshletsVisibles.size(); m++) {
+            if (cancelarFrame.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            const Meshlet &meshlet = modelo.meshlets[meshletsVisibles[m]];
+            estadisticasRecorte.caras += meshlet.numCaras;
+            for (uint32_t i = meshlet.primeraCara; i < meshlet.primeraCara + meshlet.numCaras; ++i) {
+                int n = ensamblarTriangulo(modelo, vertices, camara, i, ensamblados);
+                for (int t = 0; t < n; t++) {
+                    const TrianguloPantalla &triangulo = ensamblados[t];
+                    for (int my = triangulo.yi / tamMosaico; my <= triangulo.yf / tamMosaico; my++) {
+                        for (int mx = triangulo.xi / tamMosaico; mx <= triangulo.xf / tamMosaico; mx++) {
+                            bins[my * mosaicosX + mx].push_back(triangulos.size());
+                        }
+                    }
+                    triangulos.push_back(triangulo);
+                }
+            }
+        }
+    }
+
+    //Se reparten los mosaicos en bloques contiguos, uno por hilo.
+    for (int m = 0; m < numMosaicos; m++) {
+        colas[(long) m * numHilos / numMosaicos].mosaicos.push_back(m);
+    }
+
+    //Cada hilo toma mosaicos del inicio de su cola; si se vacía, roba del final de la cola de otro hilo.
+    MEDIR_ETAPA(ETAPA_MOSAICOS);
+    ejecutarEnParalelo([&](int hilo) {
+        while (!cancelarFrame.load(std::memory_order_relaxed)) {
+            int m = -1;
+            for (int k = 0; k < numHilos && m < 0; k++) {
+                ColaMosaicos &cola = colas[(hilo + k) % numHilos];
+                std::lock_guard<std::mutex> lock(cola.mutex);
+                if (!cola.mosaicos.empty()) {
+                    if (k == 0) {
+                        m = cola.mosaicos.front();
+                        cola.mosaicos.pop_front();
+                    }
+                    else {
+                        m = cola.mosaicos.back();
+                        cola.mosaicos.pop_back();
+                    }
+                }
+            }
+            if (m < 0) {
+                return;
+            }
+
+            //Límites del mosaico en pantalla.
+            int mxi = (m % mosaicosX) * tamMosaico;
+            int myi = (m / mosaicosX) * tamMosaico;
+            int mxf = std::min(destino.ancho, mxi + tamMosaico) - 1;
+            int myf = std::min(destino.alto, myi + tamMosaico) - 1;
+
+            //Se limpia la parte del buffer de profundidad (y del de visibilidad) que le corresponde al mosaico. Al
+            //continuar un frame, el buffer de visibilidad sí se limpia: así la segunda pasada del modo diferido sólo
+            //sombrea los pixeles en los que ganó una cara de esta malla.
+            if (!continuar) {
+                for (int y = myi; y <= myf; y++) {
+                    std::fill(&bufferProf[y * destino.paso + mxi], &bufferProf[y * destino.paso + mxf] + 1, float(planoLejano));
+                }
+            }
+            if (usarDiferido) {
+                for (int y = myi; y <= myf; y++) {
+                    std::fill(&bufferVisibilidad[y * destino.paso + mxi], &bufferVisibilidad[y * destino.paso + mxf] + 1, Fragmento());
+                }
+            }
+            if (usarHiZ && !continuar) {
+                limpiarHiZ(m, mxi, myi, mxf, myf);
+            }
+
+            //Se dibuja cada triángulo del mosaico, recortando su cuadrilátero a los límites del mosaico y, con el buffer
+            //de profundidad jerárquico, a los bloques en los que puede quedar delante de lo ya dibujado.
+            //En el modo diferido, esta pasada sólo escribe profundidad y visibilidad.
+            EstadisticasHiZ hiZ;
+            {
+                MEDIR_ETAPA(ETAPA_RASTERIZADO);
+                for (int t : bins[m]) {
+                    const TrianguloPantalla &tri = triangulos[t];
+                    int xi = std::max(tri.xi, mxi), yi = std::max(tri.yi, myi);
+                    int xf = std::min(tri.xf, mxf), yf = std::min(tri.yf, myf);
+                    if (usarHiZ) {
+                        //En triángulos más chicos que un bloque, la prueba cuesta lo mismo que rasterizarlos.
+                        if ((xf - xi + 1) * (yf - yi + 1) >= tamBloqueHiZ * tamBloqueHiZ && !probarHiZ(tri, m, bufferProf, xi, yi, xf, yf, hiZ)) {
+                            hiZ.triangulos++;
+                            continue;
+                        }
+                        marcarHiZ(xi, yi, xf, yf);
+                    }
+                    CONTAR(CONTADOR_RASTERIZADOS, 1);
+                    CONTAR(CONTADOR_PIXELES_PROBADOS, (xf - xi + 1) * (yf - yi + 1));
+                    rasterizarCara(modelo, tri, bufferProf, xi, yi, xf, yf);
+                }
+            }
+            CONTAR(CONTADOR_OCULTOS_HIZ, hiZ.triangulos);
+            CONTAR(CONTADOR_BLOQUES_HIZ, hiZ.bloques);
+            CONTAR(CONTADOR_RECALCULOS_HIZ, hiZ.recalculos);
+
+            //Segunda pasada del modo diferido: se sombrea una vez cada pixel visible del mosaico.
+            if (usarDiferido) {
+                MEDIR_ETAPA(ETAPA_SOMBREADO);
+                sombrearMosaico(modelo, mxi, myi, mxf, myf);
+            }
+        }
+    });
+
+    return !cancelarFrame;
+}
+
+//Renderizador del modelo fuera de núcleo: se eligen los ladrillos cuya esfera y cono de normales pueden verse, se
+//ordenan del más cercano al más lejano y se dibujan uno tras otro en el mismo frame con el renderizador por mosaicos.
+//Sólo se lee del disco lo que no está en el caché; mientras tanto, el hilo de precarga lee los ladrillos que serían
+//visibles si la cámara repite el último movimiento. Regresa falso si el frame se canceló antes de terminar.
+bool renderizarLadrillos(CacheLadrillos &cache, const Eigen::Matrix4f &modeloVista, float *bufferProf) {
+    int mosaicosX = (destino.ancho + tamMosaico - 1) / tamMosaico;
+    int mosaicosY = (destino.alto + tamMosaico - 1) / tamMosaico;
+    std::vector<std::pair<float, uint32_t>> visibles;   //Profundidad del centro y número de cada ladrillo visible.
+    EstadisticasRecorte recorte;
+
+    for (uint32_t l = 0; l < cache.directorio.size(); l++) {
+        const LimitesMeshlet &limites = cache.directorio[l].limites;
+        int descarte = probarLimites(limites, modeloVista);
+        recorte.meshletsFrustum += descarte == DESCARTE_FRUSTUM;
+        recorte.meshletsCono += descarte == DESCARTE_CONO;
+        if (descarte == DESCARTE_NINGUNO) {
+            visibles.push_back({-modeloVista.row(2).dot(Eigen::Vector4f(limites.centro[0], limites.centro[1], limites.centro[2], 1)), l});
+        }
+    }
+    std::stable_sort(visibles.begin(), visibles.end(),
+                     [](const std::pair<float, uint32_t> &a, const std::pair<float, uint32_t> &b) { return a.first < b.first; });
+
+    //Se predice la siguiente vista repitiendo el movimiento entre la vista anterior y ésta, y se piden a la precarga
+    //los ladrillos que serían visibles en ella y no están en memoria.
+    long aciertos, fallos, expulsiones, precargas;
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        cache.frame++;
+        cache.pendientes.clear();
+        if (cache.hayVistaAnterior && !modeloVista.isApprox(cache.vistaAnterior)) {
+            Eigen::Matrix4f siguiente = modeloVista * cache.vistaAnterior.inverse() * modeloVista;
+            for (uint32_t l = 0; l < cache.directorio.size(); l++) {
+                if (!cache.residentes[l] && probarLimites(cache.directorio[l].limites, siguiente) == DESCARTE_NINGUNO) {
+                    cache.pendientes.push_back(l);
+                }
+            }
+        }
+        cache.vistaAnterior = modeloVista;
+        cache.hayVistaAnterior = true;
+        aciertos = cache.aciertos;
+        fallos = cache.fallos;
+        expulsiones = cache.expulsiones;
+        precargas = cache.precargasUsadas;
+    }
+    cache.hayPrecarga.notify_one();
+
+    //Se limpian una sola vez los buffers de profundidad; cada ladrillo se dibuja encima de los anteriores.
+    std::fill(bufferProf, bufferProf + size_t(destino.paso) * destino.alto, float(planoLejano));
+    if (usarHiZ) {
+        prepararHiZ(mosaicosX * mosaicosY);
+        std::fill(piramide.maxBloque.begin(), piramide.maxBloque.end(), planoLejano);
+        std::fill(piramide.sucio.begin(), piramide.sucio.end(), 0);
+        std::fill(piramide.maxMosaico.begin(), piramide.maxMosaico.end(), planoLejano);
+    }
+
+    for (size_t i = 0; i < visibles.size(); i++) {
+        if (cancelarFrame.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        std::shared_ptr<const Malla> malla = obtenerLadrillo(cache, visibles[i].second);
+        if (!renderizarMosaicos(*malla, modeloVista, bufferProf, true)) {
+            return false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    std::cout << "Ladrillos: " << visibles.size() << " de " << cache.directorio.size() << " visibles (" << recorte.meshletsFrustum
+              << " fuera del frustum, " << recorte.meshletsCono << " por su cono de normales); " << cache.aciertos - aciertos
+              << " aciertos, " << cache.fallos - fallos << " fallos, " << cache.expulsiones - expulsiones << " expulsiones, "
+              << cache.precargasUsadas - precargas << " precargados usados; " << cache.bytesResidentes / 1e6 << " de "
+              << cache.limite / 1e6 << " MB en memoria.\n";
+    return true;
+}
+
+//Renderizador de lotes de vistas (--lote): todas las vistas usan la misma malla y las mismas luces. Se dibujan en grupos
+//de vistasPorHilo vistas por hilo (menos si sus vértices transformados no caben en bytesVerticesLote); la etapa de
+//vértices de todo el grupo se hace en una sola pasada sobre la malla y después cada hilo del pool toma vistas completas
+//del grupo y las dibuja, con su propio buffer de profundidad, en el buffer de pixeles de cada vista. Los buffers de
+//vértices se reusan de un grupo al siguiente. Cada grupo se reporta como un frame. El modo diferido y el buffer de
+//profundidad jerárquico no se usan: sus buffers son de un solo frame.
+void renderizarVistas(const Malla &modelo, const std::vector<Luz> &luces, std::vector<VistaLote> &vistas) {
+    size_t bytesVista = std::max<size_t>(1, modelo.numVertices() * (5 * sizeof(float) + sizeof(uint8_t)));
+    size_t porGrupo = std::max<size_t>(1, std::min<size_t>(bytesVerticesLote / bytesVista, vistasPorHilo * numHilos));
+    std::vector<VerticesTransformados> reservas(porGrupo);     //Buffers de vértices que se prestan a las vistas de cada grupo.
+    std::vector<std::shared_ptr<float>> profundidades(numHilos);  //Buffer de profundidad de cada hilo, como el del destino.
+    bool diferido = usarDiferido, hiZ = usarHiZ;
+
+    for (int h = 0; h < numHilos; h++) {
+        profundidades[h] = std::shared_ptr<float>((float *) reservarPlano(size_t(destino.paso) * destino.alto * sizeof(float)), free);
+    }
+
+    usarDiferido = false;
+    usarHiZ = false;
+    prepararSombreado(luces);
+    for (size_t primera = 0; primera < vistas.size(); primera += porGrupo) {
+        size_t ultima = std::min(vistas.size(), primera + porGrupo);
+        auto inicio = std::chrono::steady_clock::now();
+        iniciarFrame();
+        for (size_t v = primera; v < ultima; v++) {
+            VistaLote &vista = vistas[v];
+            std::swap(vista.vertices, reservas[v - primera]);
+            vista.transformacionNormales = Eigen::Matrix4f::Identity();
+            vista.transformacionNormales.topLeftCorner<3, 3>() = vista.modeloVista.topLeftCorner<3, 3>().inverse().transpose();
+            vista.estadisticas = EstadisticasRecorte();
+        }
+
+        {
+            MEDIR_ETAPA(ETAPA_VERTICES);
+            procesarVerticesLote(modelo, vistas, primera, ultima);
+        }
+
+        //Cada hilo toma la siguiente vista pendiente del grupo hasta que no quede ninguna.
+        std::atomic<size_t> siguiente(primera);
+        {
+            MEDIR_ETAPA(ETAPA_MOSAICOS);
+            ejecutarEnParalelo([&](int hilo) {
+                for (size_t v = siguiente++; v < ultima; v = siguiente++) {
+                    dibujarVista(modelo, vistas[v], profundidades[hilo].get());
+                }
+            });
+        }
+
+        //Las estadísticas del grupo son la suma de las de sus vistas; los buffers de vértices pasan al siguiente grupo.
+        for (size_t v = primera; v < ultima; v++) {
+            const EstadisticasRecorte &e = vistas[v].estadisticas;
+            EstadisticasRecorte &total = estadisticasRecorte;
+            total.vertices += e.vertices;
+            total.transformacionesEvitadas += e.transformacionesEvitadas;
+            total.meshlets += e.meshlets;
+            total.meshletsFrustum += e.meshletsFrustum;
+            total.meshletsCono += e.meshletsCono;
+            total.meshletsVisibles += e.meshletsVisibles;
+            total.caras += e.caras;
+            total.fueraFrustum += e.fueraFrustum;
+            total.traseras += e.traseras;
+            total.recortadas += e.recortadas;
+            total.fueraVentana += e.fueraVentana;
+            total.dibujados += e.dibujados;
+            std::swap(vistas[v].vertices, reservas[v - primera]);
+            vistas[v].recortes = std::vector<VerticesRecortados>();
+        }
+        reportarFrame(inicio, std::chrono::steady_clock::now());
+    }
+    usarDiferido = diferido;
+    usarHiZ = hiZ;
+}
+
+//Se dibuja completa una vista del lote en el hilo actual, sobre el buffer de profundidad "bufferProf" del hilo: se
+//recorre el BVH, se ensamblan las caras de los meshlets visibles con los vértices ya transformados de la vista y cada
+//triángulo se rasteriza en todo su cuadrilátero. Como las caras se dibujan en el mismo orden, la imagen es la misma que
+//la del renderizador por mosaicos.
+void dibujarVista(const Malla &modelo, VistaLote &vista, float *bufferProf) {
+    std::vector<uint32_t> meshletsVisibles;     //Meshlets que sobrevivieron al recorrido del BVH.
+    TrianguloPantalla ensamblados[3];           //Triángulos que salen de una cara (más de uno si se recortó).
+
+    vistaHilo = &vista;
+    vista.pixeles.assign(size_t(destino.paso) * destino.alto, 0);
+    vista.recortes.clear();
+    std::fill(bufferProf, bufferProf + size_t(destino.paso) * destino.alto, float(planoLejano));
+    vista.estadisticas.vertices += modelo.numVertices();
+    vista.estadisticas.transformacionesEvitadas += vista.vertices.transformacionesEvitadas;
+
+    {
+        MEDIR_ETAPA(ETAPA_BVH);
+        seleccionarMeshlets(modelo, vista.modeloVista, meshletsVisibles);
+        if (ordenarFrenteAtras) {
+            ordenarMeshlets(modelo, vista.modeloVista, meshletsVisibles);
+        }
+    }
+    vista.estadisticas.meshlets += modelo.numMeshlets;
+    vista.estadisticas.meshletsVisibles += meshletsVisibles.size();
+
+    MEDIR_ETAPA(ETAPA_RASTERIZADO);
+    for (uint32_t m : meshletsVisibles) {
+        const Meshlet &meshlet = modelo.meshlets[m];
+        vista.estadisticas.caras += meshlet.numCaras;
+        for (uint32_t i = meshlet.primeraCara; i < meshlet.primeraCara + meshlet.numCaras; ++i) {
+            int n = ensamblarTriangulo(modelo, vista.vertices, vista.modeloVista, i, ensamblados);
+            for (int t = 0; t < n; t++) {
+                const TrianguloPantalla &tri = ensamblados[t];
+                CONTAR(CONTADOR_RASTERIZADOS, 1);
+                CONTAR(CONTADOR_PIXELES_PROBADOS, (tri.xf - tri.xi + 1) * (tri.yf - tri.yi + 1));
+                rasterizarCara(modelo, tri, bufferProf, tri.xi, tri.yi, tri.xf, tri.yf);
+            }
+        }
+    }
+    vistaHilo = nullptr;
+}
+
+//Se ajusta el tamaño del buffer de profundidad jerárquico al destino de render, que tiene numMosaicos mosaicos.
+void prepararHiZ(int numMosaicos) {
+    piramide.bloquesX = (destino.ancho + tamBloqueHiZ - 1) / tamBloqueHiZ;
+    piramide.bloquesY = (destino.alto + tamBloqueHiZ - 1) / tamBloqueHiZ;
+    piramide.maxBloque.resize(size_t(piramide.bloquesX) * piramide.bloquesY);
+    piramide.sucio.resize(piramide.maxBloque.size());
+    piramide.maxMosaico.resize(numMosaicos);
+}
+
+//Se sombrean, por renglones, los pixeles del mosaico (xi, yi)-(xf, yf) que tienen un triángulo visible en el buffer de
+//visibilidad.
+void sombrearMosaico(const Malla &modelo, int xi, int yi, int xf, int yf) {
+    for (int y = yi; y <= yf; y++) {
+        for (int x = xi; x <= xf; x++) {
+            const Fragmento &fragmento = bufferVisibilidad[y * destino.paso + x];
+            if (fragmento.triangulo != nullptr) {
+                sombrearFragmento(modelo, *fragmento.triangulo, x, y, fragmento.w0, fragmento.w1, fragmento.w2, fragmento.z);
+            }
+        }
+    }
+}
+
+//Se reinicia el buffer de profundidad jerárquico del mosaico m, que ocupa los pixeles (xi, yi)-(xf, yf), después de
+//limpiar su parte del buffer de profundidad: todos sus bloques quedan en el plano lejano.
+void limpiarHiZ(int m, int xi, int yi, int xf, int yf) {
+    for (int by = yi / tamBloqueHiZ; by <= yf / tamBloqueHiZ; by++) {
+        for (int bx = xi / tamBloqueHiZ; bx <= xf / tamBloqueHiZ; bx++) {
+            piramide.maxBloque[by * piramide.bloquesX + bx] = planoLejano;
+            piramide.sucio[by * piramide.bloquesX + bx] = 0;
+        }
+    }
+    piramide.maxMosaico[m] = planoLejano;
+}
+
+//Prueba de oclusión de un triángulo contra el buffer de profundidad jerárquico del mosaico m. El triángulo está oculto
+//en un bloque si su vértice más cercano no está delante de la cota del bloque: ningún pixel pasaría la prueba de
+//profundidad. El cuadrilátero (xi, yi)-(xf, yf), ya recortado al mosaico, se reduce a los bloques en los que el triángulo
+//puede quedar delante; regresa falso si está oculto en todos. Las cotas de los bloques sucios se recalculan sólo si
+//no alcanzan para descartar el triángulo y ya se rasterizó sobre ellos al menos el área de un bloque.
+bool probarHiZ(const TrianguloPantalla &tri, int m, float *bufferProf, int &xi, int &yi, int &xf, int &yf, EstadisticasHiZ &estadisticas) {
+    float zCercana = tri.zMin * (1 - margenHiZ);
+    if (zCercana >= piramide.maxMosaico[m]) {
+        return false;
+    }
+
+    int bxi = xi / tamBloqueHiZ, byi = yi / tamBloqueHiZ, bxf = xf / tamBloqueHiZ, byf = yf / tamBloqueHiZ;
+    int vxi = bxf + 1, vyi = byf + 1, vxf = bxi - 1, vyf = byi - 1;  //Bloques en los que el triángulo puede verse.
+    bool recalculado = false;
+    for (int by = byi; by <= byf; by++) {
+        for (int bx = bxi; bx <= bxf; bx++) {
+            int b = by * piramide.bloquesX + bx;
+            if (zCercana < piramide.maxBloque[b] && piramide.sucio[b] >= tamBloqueHiZ * tamBloqueHiZ) {
+                float maximo = 0;
+                for (int y = by * tamBloqueHiZ; y < std::min(destino.alto, (by + 1) * tamBloqueHiZ); y++) {
+                    for (int x = bx * tamBloqueHiZ; x < std::min(destino.ancho, (bx + 1) * tamBloqueHiZ); x++) {
+                        maximo = std::max(maximo, bufferProf[y * destino.paso + x]);
+                    }
+                }
+                piramide.maxBloque[b] = maximo;
+                piramide.sucio[b] = 0;
+                recalculado = true;
+                estadisticas.recalculos++;
+            }
+            if (zCercana < piramide.maxBloque[b]) {
+                vxi = std::min(vxi, bx);
+                vyi = std::min(vyi, by);
+                vxf = std::max(vxf, bx);
+                vyf = std::max(vyf, by);
+            }
+        }
+    }
+
+    //Si cambió alguna cota, se recalcula la del mosaico.
+    if (recalculado) {
+        float maximo = 0;
+        int mosaicosX = (destino.ancho + tamMosaico - 1) / tamMosaico, bloques = tamMosaico / tamBloqueHiZ;
+        int mbx = (m % mosaicosX) * bloques, mby = (m / mosaicosX) * bloques;
+        for (int by = mby; by < std::min(piramide.bloquesY, mby + bloques); by++) {
+            for (int bx = mbx; bx < std::min(piramide.bloquesX, mbx + bloques); bx++) {
+                maximo = std::max(maximo, piramide.maxBloque[by * piramide.bloquesX + bx]);
+            }
+        }
+        piramide.maxMosaico[m] = maximo;
+    }
+
+    if (vxi > vxf) {
+        return false;
+    }
+    estadisticas.bloques += (bxf - bxi + 1) * (byf - byi + 1) - (vxf - vxi + 1) * (vyf - vyi + 1);
+    xi = std::max(xi, vxi * tamBloqueHiZ);
+    yi = std::max(yi, vyi * tamBloqueHiZ);
+    xf = std::min(xf, vxf * tamBloqueHiZ + tamBloqueHiZ - 1);
+    yf = std::min(yf, vyf * tamBloqueHiZ + tamBloqueHiZ - 1);
+    return true;
+}
+
+//Se suma el área del cuadrilátero (xi, yi)-(xf, yf) a los bloques del buffer de profundidad jerárquico que toca. En
+//cuadriláteros de varios bloques se sobrestiman los pixeles de cada uno, con lo que sólo se recalculan antes.
+void marcarHiZ(int xi, int yi, int xf, int yf) {
+    int area = (xf - xi + 1) * (yf - yi + 1);
+    for (int by = yi / tamBloqueHiZ; by <= yf / tamBloqueHiZ; by++) {
+        for (int bx = xi / tamBloqueHiZ; bx <= xf / tamBloqueHiZ; bx++) {
+            uint16_t &sucio = piramide.sucio[by * piramide.bloquesX + bx];
+            sucio = std::min(0xFFFF, sucio + area);
+        }
+    }
+}
+
+//Se proyecta una cara del modelo a coordenadas de dispositivo y se obtiene el cuadrilátero de pantalla que la engloba.
+//Regresa falso si la cara queda fuera de la ventana.
+bool proyectarCara(const Malla &modelo, uint32_t i, Eigen::Matrix4f camara, TrianguloPantalla &triangulo) {
+    Eigen::Vector4f verticeCamara;
+    
+    triangulo.cara = i;
+
+    //Se obtienen los vértices de la cara en coordenadas de dispositivo y de cámara (divididas entre la profundidad).
+    for (int k = 0; k < 3; k++) {
+        triangulo.vertDisp[k] = verticeADispositivo(modelo.posicion(modelo.indices[3*i + k]), camara);
+        verticeCamara = camara * modelo.posicion(modelo.indices[3*i + k]);
+        triangulo.vertProy[k] = Eigen::Vector2f(verticeCamara.x()/-verticeCamara.z(), verticeCamara.y()/-verticeCamara.z());
+    }
+
+    //Se guarda el valor invertido de la coordenada Z para saber la profundidad de la cara.
+    triangulo.vertDisp[0].z() = 1 / triangulo.vertDisp[0].z();
+    triangulo.vertDisp[1].z() = 1 / triangulo.vertDisp[1].z();
+    triangulo.vertDisp[2].z() = 1 / triangulo.vertDisp[2].z();
+
+    return calcularCuadrilatero(triangulo);
+}
+
+//Se obtiene el cuadrilátero de pantalla que engloba los vértices de dispositivo del triángulo.
+//Regresa falso si el triángulo queda fuera de la ventana.
+bool calcularCuadrilatero(TrianguloPantalla &triangulo) {
+    float xmin, ymin, xmax, ymax;
+
+    //Se obtienen las coordenadas X y Y más lejanas de los vértices.
+    xmin = std::min(triangulo.vertDisp[0].x(), std::min(triangulo.vertDisp[1].x(), triangulo.vertDisp[2].x()));
+    ymin = std::min(triangulo.vertDisp[0].y(), std::min(triangulo.vertDisp[1].y(), triangulo.vertDisp[2].y()));
+    xmax = std::max(triangulo.vertDisp[0].x(), std::max(triangulo.vertDisp[1].x(), triangulo.vertDisp[2].x()));
+    ymax = std::max(triangulo.vertDisp[0].y(), std::max(triangulo.vertDisp[1].y(), triangulo.vertDisp[2].y()));
+    
+    //Se verifica si la cara entra en la ventana (si se va a dibujar o no)
+    if (xmin > destino.ancho - 1 || ymin > destino.alto - 1 || xmax < 0  || ymax < 0) {
+        return false;
+    }
+
+    //Se obtienen las esquinas de un cuadrilátero que engloba la cara.
+    triangulo.xi = std::max(0, int(std::floor(xmin)));
+    triangulo.yi = std::max(0, int(std::floor(ymin)));
+    triangulo.xf = std::min(destino.ancho-1, int(std::floor(xmax)));
+    triangulo.yf = std::min(destino.alto-1, int(std::floor(ymax)));
+
+    //El vértice más cercano es el de mayor inverso de la profundidad.
+    triangulo.zMin = 1 / std::max(triangulo.vertDisp[0].z(), std::max(triangulo.vertDisp[1].z(), triangulo.vertDisp[2].z()));
+    return true;
+}
+
+//Etapa de vértices: se transforma cada vértice único de la malla una sola vez a coordenadas de cámara, de proyección
+//y de dispositivo, repartiendo los vértices entre los hilos del pool.
+void procesarVertices(const Malla &modelo, const Eigen::Matrix4f &camara, VerticesTransformados &salida) {
+    size_t n = modelo.numVertices();
+    salida.xDisp.resize(n);
+    salida.yDisp.resize(n);
+    salida.invZ.resize(n);
+    salida.xProy.resize(n);
+    salida.yProy.resize(n);
+    salida.codigo.resize(n);
+
+    ejecutarEnParalelo([&](int hilo) {
+        size_t inicio = n * hilo / numHilos, fin = n * (hilo + 1) / numHilos;
+        for (size_t i = inicio; i < fin; i++) {
+            transformarVertice(modelo, camara, i, salida);
+        }
+    });
+
+    //Antes se transformaban los tres vértices de cada cara (y otra vez por cada pixel sombreado).
+    salida.transformacionesEvitadas = 3 * long(modelo.numCaras()) - long(n);
+}
+
+//Etapa de vértices de las vistas [primera, ultima) del lote, en una sola pasada sobre la malla: cada hilo toma un rango
+//de vértices y lo recorre en bloques de verticesBloqueLote, que transforma con la matriz de cada vista mientras sus
+//posiciones siguen en caché. Así la malla se lee de memoria una vez por grupo y no una vez por vista.
+void procesarVerticesLote(const Malla &modelo, std::vector<VistaLote> &vistas, size_t primera, size_t ultima) {
+    size_t n = modelo.numVertices();
+    for (size_t v = primera; v < ultima; v++) {
+        VerticesTransformados &salida = vistas[v].vertices;
+        salida.xDisp.resize(n);
+        salida.yDisp.resize(n);
+        salida.invZ.resize(n);
+        salida.xProy.resize(n);
+        salida.yProy.resize(n);
+        salida.codigo.resize(n);
+        salida.transformacionesEvitadas = 3 * long(modelo.numCaras()) - long(n);
+    }
+
+    ejecutarEnParalelo([&](int hilo) {
+        size_t inicio = n * hilo / numHilos, fin = n * (hilo + 1) / numHilos;
+        for (size_t bloque = inicio; bloque < fin; bloque += verticesBloqueLote) {
+            size_t finBloque = std::min(fin, bloque + verticesBloqueLote);
+            for (size_t v = primera; v < ultima; v++) {
+                for (size_t i = bloque; i < finBloque; i++) {
+                    transformarVertice(modelo, vistas[v].modeloVista, i, vistas[v].vertices);
+                }
+            }
+        }
+    });
+}
+
+//Se transforma el vértice i de la malla con la matriz "camara" y se guarda en el buffer post-transformación.
+//Mismas operaciones que verticeADispositivo.
+inline void transformarVertice(const Malla &modelo, const Eigen::Matrix4f &camara, uint32_t i, VerticesTransformados &salida) {
+    Eigen::Vector4f verticeCamara = camara * modelo.posicion(i);
+    float xProy = planoCercano * verticeCamara.x() / -verticeCamara.z();
+    float yProy = planoCercano * verticeCamara.y() / -verticeCamara.z();
+    salida.xDisp[i] = (2 * xProy * destino.aspecto + 1) / 2 * destino.ancho;
+    salida.yDisp[i] = (1 - 2 * yProy) / 2 * destino.alto;
+    salida.invZ[i] = 1 / -verticeCamara.z();
+    salida.xProy[i] = verticeCamara.x()/-verticeCamara.z();
+    salida.yProy[i] = verticeCamara.y()/-verticeCamara.z();
+    salida.codigo[i] = codigoRecorte(verticeCamara);
+}
+
+//Se calcula el código de recorte de un vértice en coordenadas de cámara. La cámara ve hacia -Z y la ventana cubre
+//las coordenadas de proyección entre -1/2 y 1/2 en Y (y entre -1/2 y 1/2 entre el aspecto en X), así que con w = -z
+//los planos laterales son -w <= 2 * planoCercano * aspecto * x <= w.
+uint8_t codigoRecorte(const Eigen::Vector4f &verticeCamara) {
+    float w = -verticeCamara.z();
+    float x = 2 * planoCercano * verticeCamara.x() * destino.aspecto;
+    float y = 2 * planoCercano * verticeCamara.y();
+    uint8_t codigo = 0;
+
+    codigo |= x < -w ? FUERA_IZQUIERDA : 0;
+    codigo |= x > w ? FUERA_DERECHA : 0;
+    codigo |= y < -w ? FUERA_ABAJO : 0;
+    codigo |= y > w ? FUERA_ARRIBA : 0;
+    codigo |= w < planoCercano ? FUERA_CERCANO : 0;
+    codigo |= w > planoLejano ? FUERA_LEJANO : 0;
+    return codigo;
+}
+
+//Se arman los triángulos de pantalla de la cara i a partir del buffer post-transformación y se guardan en "salida".
+//Antes de armarlos se descarta la cara si está fuera del frustum, se recorta si cruza el plano cercano o lejano
+//y se descartan los triángulos que dan la espalda a la cámara o quedan fuera de la ventana.
+//Regresa cuántos triángulos quedaron (de 0 a 3) y actualiza estadisticasRecorte (o las de la vista del lote).
+int ensamblarTriangulo(const Malla &modelo, const VerticesTransformados &vertices, const Eigen::Matrix4f &camara,
+                       uint32_t i, TrianguloPantalla *salida) {
+    const uint32_t *indices = &modelo.indices[3*i];
+    uint8_t c0 = vertices.codigo[indices[0]], c1 = vertices.codigo[indices[1]], c2 = vertices.codigo[indices[2]];
+    int n = 1;
+    EstadisticasRecorte &estadisticas = vistaHilo != nullptr ? vistaHilo->estadisticas : estadisticasRecorte;
+
+    //Si los tres vértices están fuera de un mismo plano, la cara no se ve.
+    if (c0 & c1 & c2) {
+        estadisticas.fueraFrustum++;
+        return 0;
+    }
+    if ((c0 | c1 | c2) & (FUERA_CERCANO | FUERA_LEJANO)) {
+        estadisticas.recortadas++;
+        n = recortarCara(modelo, camara, i, salida);
+    }
+    else {
+        salida[0].cara = i;
+        salida[0].recorte = -1;
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = indices[k];
+            salida[0].vertDisp[k] = Eigen::Vector3f(vertices.xDisp[v], vertices.yDisp[v], vertices.invZ[v]);
+            salida[0].vertProy[k] = Eigen::Vector2f(vertices.xProy[v], vertices.yProy[v]);
+        }
+    }
+
+    //Descarte de caras traseras: sólo los triángulos con área positiva en pantalla cubren pixeles.
+    int quedan = 0;
+    for (int t = 0; t < n; t++) {
+        if (edgeFunction(salida[t].vertDisp[0], salida[t].vertDisp[1], salida[t].vertDisp[2]) <= 0) {
+            estadisticas.traseras++;
+        }
+        else if (!calcularCuadrilatero(salida[t])) {
+            estadisticas.fueraVentana++;
+        }
+        else {
+            salida[quedan++] = salida[t];
+        }
+    }
+    estadisticas.dibujados += quedan;
+    return quedan;
+}
+
+//Se recorta la cara i contra los planos cercano y lejano en coordenadas de cámara (Sutherland-Hodgman) y el polígono
+//resultante se divide en abanico en hasta tres triángulos de pantalla. Cada vértice nuevo guarda sus coordenadas
+//baricéntricas en la cara original, con las que se interpolan su normal y su coordenada de textura.
+int recortarCara(const Malla &modelo, const Eigen::Matrix4f &camara, uint32_t i, TrianguloPantalla *salida) {
+    const uint32_t *indices = &modelo.indices[3*i];
+    Eigen::Vector4f posiciones[2][5];       //Polígono en coordenadas de cámara (entrada y salida de cada plano).
+    Eigen::Vector3f baricentricas[2][5];    //Coordenadas baricéntricas de cada vértice del polígono en la cara original.
+    std::vector<VerticesRecortados> &salidaRecortes = vistaHilo != nullptr ? vistaHilo->recortes : recortes;
+    int numVertices = 3;
+    int actual = 0;
+
+    for (int k = 0; k < 3; k++) {
+        posiciones[0][k] = camara * modelo.posicion(indices[k]);
+        baricentricas[0][k] = Eigen::Vector3f::Unit(k);
+    }
+
+    //Se recorta contra w >= planoCercano y contra w <= planoLejano, con w = -z.
+    for (int plano = 0; plano < 2 && numVertices > 0; plano++) {
+        auto distancia = [&](const Eigen::Vector4f &p) {
+            return plano == 0 ? -p.z() - planoCercano : planoLejano + p.z();
+        };
+        int siguiente = 1 - actual, numSalida = 0;
+        for (int k = 0; k < numVertices; k++) {
+            int k2 = (k + 1) % numVertices;
+            float d1 = distancia(posiciones[actual][k]), d2 = distancia(posiciones[actual][k2]);
+            if (d1 >= 0) {
+                posiciones[siguiente][numSalida] = posiciones[actual][k];
+                baricentricas[siguiente][numSalida++] = baricentricas[actual][k];
+            }
+            if ((d1 >= 0) != (d2 >= 0)) {
+                float t = d1 / (d1 - d2);
+                posiciones[siguiente][numSalida] = posiciones[actual][k] + t * (posiciones[actual][k2] - posiciones[actual][k]);
+                baricentricas[siguiente][numSalida++] = baricentricas[actual][k] + t * (baricentricas[actual][k2] - baricentricas[actual][k]);
+            }
+        }
+        numVertices = numSalida;
+        actual = siguiente;
+    }
+
+    //División en abanico del polígono recortado.
+    int n = 0;
+    for (int k = 1; k + 1 < numVertices; k++, n++) {
+        int esquinas[3] = {0, k, k + 1};
+        VerticesRecortados recorte;
+        salida[n].cara = i;
+        salida[n].recorte = salidaRecortes.size();
+        for (int e = 0; e < 3; e++) {
+            //Mismas operaciones que procesarVertices.
+            const Eigen::Vector4f &verticeCamara = posiciones[actual][esquinas[e]];
+            const Eigen::Vector3f &b = baricentricas[actual][esquinas[e]];
+            float xProy = planoCercano * verticeCamara.x() / -verticeCamara.z();
+            float yProy = planoCercano * verticeCamara.y() / -verticeCamara.z();
+            salida[n].vertDisp[e] = Eigen::Vector3f((2 * xProy * destino.aspecto + 1) / 2 * destino.ancho, (1 - 2 * yProy) / 2 * destino.alto,
+                                                    1 / -verticeCamara.z());
+            salida[n].vertProy[e] = Eigen::Vector2f(verticeCamara.x()/-verticeCamara.z(), verticeCamara.y()/-verticeCamara.z());
+            recorte.normal[e] = b[0] * modelo.normal(indices[0]) + b[1] * modelo.normal(indices[1]) + b[2] * modelo.normal(indices[2]);
+            recorte.coordTex[e] = b[0] * modelo.coordTex(indices[0]) + b[1] * modelo.coordTex(indices[1]) + b[2] * modelo.coordTex(indices[2]);
+        }
+        salidaRecortes.push_back(recorte);
+    }
+    return n;
+}
+
+//Se crean los hilos del pool; el hilo principal cuenta como el hilo 0.
+void iniciarPool(int hilos) {
+    numHilos = hilos;
+    contadoresHilos.resize(numHilos);
+    for (int i = 1; i < numHilos; i++) {
+        pool.hilos.emplace_back(trabajadorPool, i);
+    }
+}
+
+//Bucle de cada hilo del pool: espera una tarea nueva, la ejecuta y avisa que terminó.
+void trabajadorPool(int hilo) {
+    long generacionVista = 0;
+
+    hiloActual = hilo;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(pool.mutex);
+            pool.hayTrabajo.wait(lock, [&] { return pool.terminar || pool.generacion != generacionVista; });
+            if (pool.terminar) {
+                return;
+            }
+            generacionVista = pool.generacion;
+        }
+
+        pool.tarea(hilo);
+
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if (--pool.pendientes == 0) {
+            pool.terminoTrabajo.notify_one();
+        }
+    }
+}
+
+//Se ejecuta "tarea" en todos los hilos del pool y se espera a que todos terminen.
+void ejecutarEnParalelo(const std::function<void(int)> &tarea) {
+    if (numHilos == 1) {
+        tarea(0);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.tarea = tarea;
+        pool.pendientes = numHilos - 1;
+        pool.generacion++;
+    }
+    pool.hayTrabajo.notify_all();
+
+    tarea(0);
+
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    pool.terminoTrabajo.wait(lock, [] { return pool.pendientes == 0; });
+}
+
+//Se terminan los hilos del pool.
+void detenerPool() {
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.terminar = true;
+    }
+    pool.hayTrabajo.notify_all();
+    for (std::thread &hilo : pool.hilos) {
+        hilo.join();
+    }
+    pool.hilos.clear();
+}
+
+//Se toma un vértice en coordenadas de mundo, una cámara y regresa el punto en coordenadas de dispositivo.
+//Basado en este tutorial: https://www.scratchapixel.com/lessons/3d-basic-rendering/computing-pixel-coordinates-of-3d-point/mathematics-computing-2d-coordinates-of-3d-points
+Eigen::Vector3f verticeADispositivo(Eigen::Vector4f vertice, Eigen::Matrix4f camara) {
+    Eigen::Vector4f verticeCamara;
+    Eigen::Vector2f verticePlanoProy;
+    Eigen::Vector2f verticeNDC;
+    Eigen::Vector3f verticeDispositivo;
+    
+    //Se obtiene el vértice en coordenadas de cámara.
+    verticeCamara = camara * vertice;
+    
+    //Se proyecta ese vértice en el plano de proyección.
+    verticePlanoProy.x() = planoCercano * verticeCamara.x() / -verticeCamara.z();
+    verticePlanoProy.y() = planoCercano * verticeCamara.y() / -verticeCamara.z();
+    
+    //Proyección a coordenadas de dispositivo normalizadas (NDC). En X se corrige por la proporción de la ventana.
+    verticeNDC.x() = 2 * verticePlanoProy.x() * destino.aspecto;
+    verticeNDC.y() = 2 * verticePlanoProy.y();
+    
+    //Obtención del vértice en coordenadas del dispositivo.
+    verticeDispositivo.x() = (verticeNDC.x() + 1) / 2 * destino.ancho;
+    verticeDispositivo.y() = (1 - verticeNDC.y()) / 2 * destino.alto;
+    verticeDispositivo.z() = -verticeCamara.z();
+
+    return verticeDispositivo;
+}
+
+//Se toma una cara, cámara, buffer de profundidad y coordenadas de la cara y se dibuja esa cara si es la más cercana.
+void dibujarMasCercano(const Malla &modelo, const TrianguloPantalla &cara, float *bufferProf, int xi, int yi, int xf, int yf) {
+    float w0, w1, w2;                   //Coordenadas baricéntricas de la cara.
+    Eigen::Vector3f centroPixel;        //Coordenadas del centro del pixel.
+    float z;                            //Valor de profundidad de la cara.
+    
+    //Precálculo del área de la cara.
+    float area = edgeFunction(cara.vertDisp[0], cara.vertDisp[1], cara.vertDisp[2]);
+    
+    //Rasterización de la cara. Se verifica cada pixel (punto) que está en la cara.
+    for (int y = yi; y <= yf; y++) {
+        for (int x = xi; x <= xf; x++) {
+            //Se obtiene el centro del pixel.
+            centroPixel = Eigen::Vector3f(x + 0.5, y + 0.5, 0);
+            
+            //Coordenadas baricéntricas del pixel actual.
+            w0 = edgeFunction(cara.vertDisp[1], cara.vertDisp[2], centroPixel);
+            w1 = edgeFunction(cara.vertDisp[2], cara.vertDisp[0], centroPixel);
+            w2 = edgeFunction(cara.vertDisp[0], cara.vertDisp[1], centroPixel);
+
+            //Si el pixel (coordenadas baricéntricas) está dentro de la cara, se verifica su profundidad.
+            if (w0 >= 0 && w1 >= 0 && w2 >= 0) {
+                //Normalización de las coordenadas baricéntricas para que sumen 1.
+                w0 /= area;
+                w1 /= area;
+                w2 /= area;
+
+                //Obtención de la profundidad de esta cara.
+                z = 1/(cara.vertDisp[0].z() * w0 + cara.vertDisp[1].z() * w1 + cara.vertDisp[2].z() * w2);
+                
+                //Si esta profundidad es menor a la que hay en el buffer actualmente, se dibuja el punto.
+                if (z < bufferProf[y * destino.paso + x]) {
+                    //Se actualizada el valor mínimo de profundidad en el buffer de profundidad.
+                    bufferProf[y * destino.paso + x] = z;
+                    CONTAR(CONTADOR_PROFUNDIDAD, 1);
+
+                    //Se calcula el color del punto y se dibuja.
+                    sombrearFragmento(modelo, cara, x, y, w0, w1, w2, z);
+                }
+            }
+        }
+    }
+}
+
+//Se calcula el color de un fragmento de la cara que pasó la prueba de profundidad y se dibuja en el pixel (x, y).
+//Recibe las coordenadas baricéntricas normalizadas del pixel y su profundidad.
+void sombrearFragmento(const Malla &modelo, const TrianguloPantalla &cara, int x, int y, float w0, float w1, float w2, float z) {
+    const uint32_t *indices = &modelo.indices[3 * cara.cara];   //Vértices de la cara en la malla.
+    Eigen::Vector4f pixelCam;           //Pixel en coordenadas de cámara.
+    Eigen::Vector4f normalInterp;       //Normal de la cara interpolada para este pixel.
+    Eigen::Vector2f coordTex[3];        //Coordenadas UV de los vértices.
+    Eigen::Vector2f uv0, uv1, uv2;      //Coordenadas UV en coordenadas de cámara..
+    Eigen::Vector2f uvInterp;           //Coordenadas UV interpoladas en el punto actual.
+    Color colorPixel;                   //Color final que tendrá este pixel.
+    float pxCam, pyCam;                 //Coordenadas del pixel en en coordenadas de cámara.
+    float nivelTextura = 0;             //Nivel de mipmap de la textura en este pixel.
+    const Eigen::Matrix4f &normales = vistaHilo != nullptr ? vistaHilo->transformacionNormales : transformacionNormales;
+
+    CONTAR(CONTADOR_SOMBREADOS, 1);
+
+    //Se obtienen este punto en coordenadas de cámara, interpolando los vértices ya proyectados.
+    pxCam = w0 * cara.vertProy[0].x() + w1 * cara.vertProy[1].x() + w2 * cara.vertProy[2].x();
+    pyCam = cara.vertProy[0].y() * w0 + cara.vertProy[1].y() * w1 + cara.vertProy[2].y() * w2;
+    pixelCam = Eigen::Vector4f(pxCam * z, pyCam * z, -z, 1);
+
+    //Se interpola la normal en este punto. Los vértices de los triángulos recortados tienen sus propios atributos.
+    if (cara.recorte < 0) {
+        normalInterp = (normales * (w0 * modelo.normal(indices[0]) + w1 * modelo.normal(indices[1]) + w2 * modelo.normal(indices[2]))).normalized();
+        coordTex[0] = modelo.coordTex(indices[0]);
+        coordTex[1] = modelo.coordTex(indices[1]);
+        coordTex[2] = modelo.coordTex(indices[2]);
+    }
+    else {
+        const VerticesRecortados &recorte = (vistaHilo != nullptr ? vistaHilo->recortes : recortes)[cara.recorte];
+        normalInterp = (normales * (w0 * recorte.normal[0] + w1 * recorte.normal[1] + w2 * recorte.normal[2])).normalized();
+        coordTex[0] = recorte.coordTex[0];
+        coordTex[1] = recorte.coordTex[1];
+        coordTex[2] = recorte.coordTex[2];
+    }
+    uv0 = coordTex[0] * cara.vertDisp[0].z();
+    uv1 = coordTex[1] * cara.vertDisp[0].z();
+    uv2 = coordTex[2] * cara.vertDisp[0].z();
+    
+    //Se interpola la coordenada UV para el punto actual.
+    uvInterp = (uv0 * w0 + uv1 * w1 + uv2 * w2) * z;  
+
+    //Con textura, las UVs se interpolan con el inverso de la profundidad de cada vértice y el nivel de mipmap se elige con
+    //sus derivadas en pantalla: la diferencia con las UVs de los pixeles vecinos en X y en Y, como en un cuadro de 2x2
+    //pixeles. Las coordenadas baricéntricas de los vecinos salen de las derivadas de las edge functions.
+    if (!textura.niveles.empty()) {
+        const Eigen::Vector3f *v = cara.vertDisp;
+        float area = edgeFunction(v[0], v[1], v[2]);
+        float dwx[3] = {(v[2].y() - v[1].y()) / area, (v[0].y() - v[2].y()) / area, (v[1].y() - v[0].y()) / area};
+        float dwy[3] = {(v[1].x() - v[2].x()) / area, (v[2].x() - v[0].x()) / area, (v[0].x() - v[1].x()) / area};
+        Eigen::Vector2f uvs[3] = {coordTex[0] * v[0].z(), coordTex[1] * v[1].z(), coordTex[2] * v[2].z()};
+        Eigen::Vector2f numerador = uvs[0] * w0 + uvs[1] * w1 + uvs[2] * w2;
+        Eigen::Vector2f numeradorX = numerador + uvs[0] * dwx[0] + uvs[1] * dwx[1] + uvs[2] * dwx[2];
+        Eigen::Vector2f numeradorY = numerador + uvs[0] * dwy[0] + uvs[1] * dwy[1] + uvs[2] * dwy[2];
+        float denominador = v[0].z() * w0 + v[1].z() * w1 + v[2].z() * w2;
+        float denominadorX = denominador + v[0].z() * dwx[0] + v[1].z() * dwx[1] + v[2].z() * dwx[2];
+        float denominadorY = denominador + v[0].z() * dwy[0] + v[1].z() * dwy[1] + v[2].z() * dwy[2];
+        uvInterp = numerador / denominador;
+        Eigen::Vector2f derivadaX = numeradorX / denominadorX - uvInterp, derivadaY = numeradorY / denominadorY - uvInterp;
+        Eigen::Vector2f escala(textura.niveles[0].ancho, textura.niveles[0].alto);
+        float rho = std::max(derivadaX.cwiseProduct(escala).norm(), derivadaY.cwiseProduct(escala).norm());
+        nivelTextura = rho > 1e-8f ? std::log2(rho) : 0.0f;
+    }
+
+    //Se obtiene el color del pixel a partir de los valores recién calculados.
+    colorPixel = sombreadorPixel(pixelCam, normalInterp, uvInterp, nivelTextura);
+
+    //Se dibuja el pixel actual con el color obtenido.
+    dibujarPuntoColor(x, y, colorPixel.R, colorPixel.G, colorPixel.B);
+}
+
+//Destino de los fragmentos que pasan la prueba de profundidad en los kernels: se sombrean de inmediato o,
+//en el modo diferido, sólo se anotan en el buffer de visibilidad para sombrearlos en la segunda pasada.
+inline void escribirFragmento(const Malla &modelo, const TrianguloPantalla &cara, int x, int y, float w0, float w1, float w2, float z) {
+    CONTAR(CONTADOR_PROFUNDIDAD, 1);
+    if (usarDiferido) {
+        bufferVisibilidad[y * destino.paso + x] = {&cara, w0, w1, w2, z};
+    }
+    else {
+        sombrearFragmento(modelo, cara, x, y, w0, w1, w2, z);
+    }
+}
+
+//Se elige el kernel de rasterización más ancho que soporte el procesador, sin pasar de "maxima".
+ISA seleccionarISA(ISA maxima) {
+    ISA isa = ISA_ESCALAR;
+#ifdef KERNEL_SIMD
+    __builtin_cpu_init();
+    if (maxima >= ISA_AVX2 && __builtin_cpu_supports("avx2")) {
+        isa = ISA_AVX2;
+    }
+    else if (maxima >= ISA_SSE && __builtin_cpu_supports("sse2")) {
+        isa = ISA_SSE;
+    }
+#endif
+    switch (isa) {
+        case ISA_AVX2:
+            rasterizarCara = rasterizarCaraAVX2;
+            break;
+        case ISA_SSE:
+            rasterizarCara = rasterizarCaraSSE;
+            break;
+        default:
+            rasterizarCara = rasterizarCaraEscalar;
+            break;
+    }
+    return isa;
+}
+
+//Kernels de rasterización. Igual que dibujarMasCercano, dibujan la cara en el cuadrilátero (xi, yi)-(xf, yf) si es la
+//más cercana, pero las edge functions se evalúan una vez por renglón y después se avanzan sumando su derivada en X.
+//Como el buffer de profundidad está guardado por renglones, los bloques de pixeles avanzan sobre X; los kernels SIMD
+//empiezan cada renglón en un múltiplo del ancho del bloque, así que sus lecturas del buffer quedan alineadas (el paso
+//del destino es múltiplo de 16 y los mosaicos de 32 pixeles, así que un bloque nunca se sale del mosaico ni del renglón).
+//Las edge functions de las aristas v1-v2, v2-v0 y v0-v1 corresponden a las coordenadas baricéntricas w0, w1 y w2.
+const int aristaInicio[3] = {1, 2, 0};
+const int aristaFin[3] = {2, 0, 1};
+
+//Kernel escalar: un pixel a la vez.
+void rasterizarCaraEscalar(const Malla &modelo, const TrianguloPantalla &cara, float *bufferProf, int xi, int yi, int xf, int yf) {
+    const Eigen::Vector3f *v = cara.vertDisp;
+    float area = edgeFunction(v[0], v[1], v[2]);
+    float e[3];     //Edge functions en el pixel actual.
+    float dx[3];    //Incremento de cada edge function al avanzar un pixel a la derecha.
+
+    //Las caras con área nula o negativa no cubren ningún pixel.
+    if (!(area > 0)) {
+        return;
+    }
+    float invArea = 1 / area;
+    for (int k = 0; k < 3; k++) {
+        dx[k] = v[aristaFin[k]].y() - v[aristaInicio[k]].y();
+    }
+
+    for (int y = yi; y <= yf; y++) {
+        Eigen::Vector3f centroPixel(xi + 0.5, y + 0.5, 0);
+        for (int k = 0; k < 3; k++) {
+            e[k] = edgeFunction(v[aristaInicio[k]], v[aristaFin[k]], centroPixel);
+        }
+        float *renglon = bufferProf + size_t(y) * destino.paso;
+        for (int x = xi; x <= xf; x++) {
+            if (e[0] >= 0 && e[1] >= 0 && e[2] >= 0) {
+                float w0 = e[0] * invArea, w1 = e[1] * invArea, w2 = e[2] * invArea;
+                float z = 1/(v[0].z() * w0 + v[1].z() * w1 + v[2].z() * w2);
+                if (z < renglon[x]) {
+                    renglon[x] = z;
+                    escribirFragmento(modelo, cara, x, y, w0, w1, w2, z);
+                }
+            }
+            e[0] += dx[0];
+            e[1] += dx[1];
+            e[2] += dx[2];
+        }
+    }
+}
+
+#ifdef KERNEL_SIMD
+//Kernel SSE: bloques alineados de 4 pixeles de un renglón. El bloque se lee y se escribe completo: los carriles que no
+//pasan la prueba conservan su profundidad.
+__attribute__((target("sse2")))
+void rasterizarCaraSSE(const Malla &modelo, const TrianguloPantalla &cara, float *bufferProf, int xi, int yi, int xf, int yf) {
+    const Eigen::Vector3f *v = cara.vertDisp;
+    float area = edgeFunction(v[0], v[1], v[2]);
+    __m128 e[3], pasoE[3], dxCarril[3];
+    alignas(16) float w[3][4], zs[4];
+
+    if (!(area > 0)) {
+        return;
+    }
+    const int x0 = xi & ~3;
+    const __m128 carril = _mm_setr_ps(0, 1, 2, 3);
+    const __m128i carrilEntero = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128 invArea = _mm_set1_ps(1 / area);
+    const __m128 uno = _mm_set1_ps(1.0f), cero = _mm_setzero_ps();
+    const __m128 z0 = _mm_set1_ps(v[0].z()), z1 = _mm_set1_ps(v[1].z()), z2 = _mm_set1_ps(v[2].z());
+    for (int k = 0; k < 3; k++) {
+        float dx = v[aristaFin[k]].y() - v[aristaInicio[k]].y();
+        dxCarril[k] = _mm_mul_ps(carril, _mm_set1_ps(dx));
+        pasoE[k] = _mm_set1_ps(4 * dx);
+    }
+
+    for (int y = yi; y <= yf; y++) {
+        Eigen::Vector3f centroPixel(x0 + 0.5, y + 0.5, 0);
+        for (int k = 0; k < 3; k++) {
+            e[k] = _mm_add_ps(_mm_set1_ps(edgeFunction(v[aristaInicio[k]], v[aristaFin[k]], centroPixel)), dxCarril[k]);
+        }
+        float *renglon = bufferProf + size_t(y) * destino.paso;
+        for (int x = x0; x <= xf; x += 4) {
+            //Máscara de carriles dentro de la cara y dentro del cuadrilátero.
+            __m128 dentro = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e[0], cero), _mm_cmpge_ps(e[1], cero)), _mm_cmpge_ps(e[2], cero));
+            __m128i enRango = _mm_and_si128(_mm_cmpgt_epi32(carrilEntero, _mm_set1_epi32(xi - x - 1)),
+                                            _mm_cmpgt_epi32(_mm_set1_epi32(xf - x + 1), carrilEntero));
+            dentro = _mm_and_ps(dentro, _mm_castsi128_ps(enRango));
+            if (_mm_movemask_ps(dentro)) {
+                __m128 w0 = _mm_mul_ps(e[0], invArea), w1 = _mm_mul_ps(e[1], invArea), w2 = _mm_mul_ps(e[2], invArea);
+                __m128 z = _mm_div_ps(uno, _mm_add_ps(_mm_add_ps(_mm_mul_ps(z0, w0), _mm_mul_ps(z1, w1)), _mm_mul_ps(z2, w2)));
+
+                //Prueba de profundidad de todo el bloque.
+                __m128 prof = _mm_load_ps(renglon + x);
+                __m128 pasa = _mm_and_ps(dentro, _mm_cmplt_ps(z, prof));
+                int pasan = _mm_movemask_ps(pasa);
+                if (pasan) {
+                    _mm_store_ps(renglon + x, _mm_or_ps(_mm_and_ps(pasa, z), _mm_andnot_ps(pasa, prof)));
+                    _mm_store_ps(w[0], w0);
+                    _mm_store_ps(w[1], w1);
+                    _mm_store_ps(w[2], w2);
+                    _mm_store_ps(zs, z);
+                    for (int i = 0; i < 4; i++) {
+                        if (pasan & (1 << i)) {
+                            escribirFragmento(modelo, cara, x + i, y, w[0][i], w[1][i], w[2][i], zs[i]);
+                        }
+                    }
+                }
+            }
+            for (int k = 0; k < 3; k++) {
+                e[k] = _mm_add_ps(e[k], pasoE[k]);
+            }
+        }
+    }
+}
+
+//Kernel AVX2: bloques alineados de 8 pixeles de un renglón, con escritura enmascarada del buffer de profundidad.
+__attribute__((target("avx2")))
+void rasterizarCaraAVX2(const Malla &modelo, const TrianguloPantalla &cara, float *bufferProf, int xi, int yi, int xf, int yf) {
+    const Eigen::Vector3f *v = cara.vertDisp;
+    float area = edgeFunction(v[0], v[1], v[2]);
+    __m256 e[3], pasoE[3], dxCarril[3];
+    alignas(32) float w[3][8], zs[8];
+
+    if (!(area > 0)) {
+        return;
+    }
+    const int x0 = xi & ~7;
+    const __m256 carril = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i carrilEntero = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 invArea = _mm256_set1_ps(1 / area);
+    const __m256 uno = _mm256_set1_ps(1.0f), cero = _mm256_setzero_ps();
+    const __m256 z0 = _mm256_set1_ps(v[0].z()), z1 = _mm256_set1_ps(v[1].z()), z2 = _mm256_set1_ps(v[2].z());
+    for (int k = 0; k < 3; k++) {
+        float dx = v[aristaFin[k]].y() - v[aristaInicio[k]].y();
+        dxCarril[k] = _mm256_mul_ps(carril, _mm256_set1_ps(dx));
+        pasoE[k] = _mm256_set1_ps(8 * dx);
+    }
+
+    for (int y = yi; y <= yf; y++) {
+        Eigen::Vector3f centroPixel(x0 + 0.5, y + 0.5, 0);
+        for (int k = 0; k < 3; k++) {
+            e[k] = _mm256_add_ps(_mm256_set1_ps(edgeFunction(v[aristaInicio[k]], v[aristaFin[k]], centroPixel)), dxCarril[k]);
+        }
+        float *renglon = bufferProf + size_t(y) * destino.paso;
+        for (int x = x0; x <= xf; x += 8) {
+            //Máscara de carriles dentro del cuadrilátero y, de ellos, los que están dentro de la cara.
+            __m256i enRango = _mm256_and_si256(_mm256_cmpgt_epi32(carrilEntero, _mm256_set1_epi32(xi - x - 1)),
+                                               _mm256_cmpgt_epi32(_mm256_set1_epi32(xf - x + 1), carrilEntero));
+            __m256 dentro = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(e[0], cero, _CMP_GE_OQ), _mm256_cmp_ps(e[1], cero, _CMP_GE_OQ)),
+                                          _mm256_cmp_ps(e[2], cero, _CMP_GE_OQ));
+            dentro = _mm256_and_ps(dentro, _mm256_castsi256_ps(enRango));
+            if (_mm256_movemask_ps(dentro)) {
+                __m256 w0 = _mm256_mul_ps(e[0], invArea), w1 = _mm256_mul_ps(e[1], invArea), w2 = _mm256_mul_ps(e[2], invArea);
+                __m256 z = _mm256_div_ps(uno, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(z0, w0), _mm256_mul_ps(z1, w1)), _mm256_mul_ps(z2, w2)));
+
+                //Prueba de profundidad de todo el bloque; se actualiza el buffer sólo en los carriles que pasan.
+                __m256 prof = _mm256_load_ps(renglon + x);
+                __m256 pasa = _mm256_and_ps(dentro, _mm256_cmp_ps(z, prof, _CMP_LT_OQ));
+                int pasan = _mm256_movemask_ps(pasa);
+                if (pasan) {
+                    _mm256_maskstore_ps(renglon + x, _mm256_castps_si256(pasa), z);
+                    _mm256_store_ps(w[0], w0);
+                    _mm256_store_ps(w[1], w1);
+                    _mm256_store_ps(w[2], w2);
+                    _mm256_store_ps(zs, z);
+                    for (int i = 0; i < 8; i++) {
+                        if (pasan & (1 << i)) {
+                            escribirFragmento(modelo, cara, x + i, y, w[0][i], w[1][i], w[2][i], zs[i]);
+                        }
+                    }
+                }
+            }
+            for (int k = 0; k < 3; k++) {
+                e[k] = _mm256_add_ps(e[k], pasoE[k]);
+            }
+        }
+    }
+}
+#else
+//Sin x86 sólo existe el kernel escalar.
+void rasterizarCaraSSE(const Malla &modelo, const TrianguloPantalla &cara, float *bufferProf, int xi, int yi, int xf, int yf) {
+    rasterizarCaraEscalar(modelo, cara, bufferProf, xi, yi, xf, yf);
+}
+void rasterizarCaraAVX2(const Malla &modelo, const TrianguloPantalla &cara, float *bufferProf, int xi, int yi, int xf, int yf) {
+    rasterizarCaraEscalar(modelo, cara, bufferProf, xi, yi, xf, yf);
+}
+#endif
+
+//Implementación de "Edge Function" de Juan Pineda. Regresa una coordenada baricéntrica a partir de tres vértices.
+float edgeFunction(Eigen::Vector3f a, Eigen::Vector3f b, Eigen::Vector3f c) { 
+    return (c[0] - a[0]) * (b[1] - a[1]) - (c[1] - a[1]) * (b[0] - a[0]); 
+}
+
+//Se empaquetan las luces por componente y se elige la variante de obtenerColorPixel del frame: por el número de luces
+//(1, 2 o cualquiera), por la componente especular, por si el modelo tiene textura y por el modelo especular. Así, el
+//ciclo de las luces se desenrolla y el sombreado no revisa nada de esto en cada fragmento.
+void prepararSombreado(const std::vector<Luz> &luces) {
+    LucesSombreado &soa = lucesSombreado;
+    bool conEspecular = false, exponentesEnteros = true;
+    static SombreadorPixel anterior = nullptr;
+
+    soa = LucesSombreado();
+    soa.num = luces.size();
+    soa.ambiental = Eigen::Vector3f::Zero();
+    for (const Luz &luz : luces) {
+        Eigen::Vector3f difuso = luz.Kd * luz.CDifuso, especular = luz.Ke * luz.CEspecular;
+        float brillantez = usarBlinn ? 4 * luz.brillantez : luz.brillantez;
+        soa.x.push_back(luz.posicion.x());
+        soa.y.push_back(luz.posicion.y());
+        soa.z.push_back(luz.posicion.z());
+        soa.w.push_back(luz.posicion.w());
+        soa.difusoR.push_back(difuso.x());
+        soa.difusoG.push_back(difuso.y());
+        soa.difusoB.push_back(difuso.z());
+        soa.especularR.push_back(especular.x());
+        soa.especularG.push_back(especular.y());
+        soa.especularB.push_back(especular.z());
+        soa.brillantez.push_back(brillantez);
+        soa.exponente.push_back(int(brillantez));
+        soa.ambiental += luz.Ka * luz.CAmbiental;
+        conEspecular |= !especular.isZero();
+        exponentesEnteros &= brillantez >= 0 && brillantez <= 64 && brillantez == std::floor(brillantez);
+    }
+
+    int especular = !conEspecular ? ESPECULAR_NINGUNO : exponentesEnteros ? ESPECULAR_ENTERO : ESPECULAR_REAL;
+    bool conTextura = !textura.niveles.empty();
+    sombreadorPixel = soa.num == 1 ? varianteSombreadoLuces<1>(especular, conTextura, usarBlinn) :
+                      soa.num == 2 ? varianteSombreadoLuces<2>(especular, conTextura, usarBlinn) :
+                                     varianteSombreadoLuces<0>(especular, conTextura, usarBlinn);
+    if (sombreadorPixel != anterior) {
+        const char *nombresEspecular[] = {"sin especular", "especular con exponente entero", "especular con std::pow"};
+        std::cout << "Sombreado: " << soa.num << " luz(ces), " << nombresEspecular[especular] << ", "
+                  << (conTextura ? "textura" : "checker") << " y " << (usarBlinn ? "Blinn-Phong" : "Phong") << ".\n";
+        anterior = sombreadorPixel;
+    }
+}
+
+//Se elige la variante del sombreado para NumLuces luces (0 si el número sólo se conoce al ejecutar).
+template <int NumLuces>
+SombreadorPixel varianteSombreadoLuces(int especular, bool conTextura, bool blinn) {
+    switch (especular) {
+        case ESPECULAR_NINGUNO:
+            return varianteSombreado<NumLuces, ESPECULAR_NINGUNO>(conTextura, blinn);
+        case ESPECULAR_ENTERO:
+            return varianteSombreado<NumLuces, ESPECULAR_ENTERO>(conTextura, blinn);
+        default:
+            return varianteSombreado<NumLuces, ESPECULAR_REAL>(conTextura, blinn);
+    }
+}
+
+template <int NumLuces, int Especular>
+SombreadorPixel varianteSombreado(bool conTextura, bool blinn) {
+    if (conTextura) {
+        return blinn ? obtenerColorPixel<NumLuces, Especular, true, true> : obtenerColorPixel<NumLuces, Especular, true, false>;
+    }
+    return blinn ? obtenerColorPixel<NumLuces, Especular, false, true> : obtenerColorPixel<NumLuces, Especular, false, false>;
+}
+
+//Se obtiene el color del pixel actual, considerando luz y textura tipo checker.
+//La iluminación se calcula con el modelo de Phong (o el de Blinn-Phong) y la textura se genera proceduralmente.
+//Si el modelo tiene textura, se usa ésta en lugar del checker, muestreada en el nivel de mipmap "nivelTextura".
+//Los parámetros de la plantilla fijan el número de luces (0: las que haya en lucesSombreado), cómo se calcula la
+//componente especular, si hay textura y si se usa Blinn-Phong; prepararSombreado elige la variante de cada frame.
+//Como antes, los vectores son de cuatro dimensiones: la normal conserva su coordenada homogénea y el vector hacia la
+//cámara se normaliza con la w del punto.
+//Función basada en esta implementación: http://www.cs.toronto.edu/~jacobson/phong-demo/
+template <int NumLuces, int Especular, bool ConTextura, bool Blinn>
+Color obtenerColorPixel(const Eigen::Vector4f &pixelCam, const Eigen::Vector4f &normalInterp, const Eigen::Vector2f &uv, float nivelTextura) {
+    const LucesSombreado &luces = lucesSombreado;
+    const int numLuces = NumLuces > 0 ? NumLuces : luces.num;
+    const float nx = normalInterp.x(), ny = normalInterp.y(), nz = normalInterp.z(), nw = normalInterp.w();
+    Eigen::Vector3f color = luces.ambiental;   //Color final
+    float cx = 0, cy = 0, cz = 0, cw = 0;      //Vector del punto a la cámara.
+    int tamChecker = 10;    //Valor de cada cuadro del checker (entre más grande, más pequeño el cuadro).
+    float checker;          //Valor generado por el checker en este punto.
+    float intensidadChecker;//Intensidad del checker en este punto.
+
+    if (Especular != ESPECULAR_NINGUNO) {
+        float norma = pixelCam.norm();
+        cx = -pixelCam.x() / norma;
+        cy = -pixelCam.y() / norma;
+        cz = -pixelCam.z() / norma;
+        cw = -pixelCam.w() / norma;
+    }
+
+    //Se hace el cálculo por cada luz.
+    for (int i = 0; i < numLuces; i++) {
+        //Se calcula la posición de la luz con respecto al punto deseado.
+        float lx = luces.x[i] - pixelCam.x(), ly = luces.y[i] - pixelCam.y(), lz = luces.z[i] - pixelCam.z(), lw = luces.w[i] - pixelCam.w();
+        float norma = std::sqrt(lx * lx + ly * ly + lz * lz + lw * lw);
+        lx /= norma;
+        ly /= norma;
+        lz /= norma;
+        lw /= norma;
+
+        //Se calcula el Lambertiano.
+        float productoNormal = nx * lx + ny * ly + nz * lz + nw * lw;
+        float lambertian = std::max(productoNormal, 0.0f);
+        float specular = 0.0f;
+
+        //Si el lambertiano es mayor a 0, se calcula la componente especular: con el ángulo entre el reflejo de la luz y
+        //la cámara (Phong) o entre la normal y el vector medio entre la luz y la cámara (Blinn-Phong).
+        if (Especular != ESPECULAR_NINGUNO && lambertian > 0.0f) {
+            float specAngle;
+            if (Blinn) {
+                float hx = lx + cx, hy = ly + cy, hz = lz + cz, hw = lw + cw;
+                float normaMedio = std::sqrt(hx * hx + hy * hy + hz * hz + hw * hw);
+                specAngle = std::max((nx * hx + ny * hy + nz * hz + nw * hw) / normaMedio, 0.0f);
+            }
+            else {
+                float rx = -lx + 2 * productoNormal * nx, ry = -ly + 2 * productoNormal * ny;
+                float rz = -lz + 2 * productoNormal * nz, rw = -lw + 2 * productoNormal * nw;
+                specAngle = std::max(rx * cx + ry * cy + rz * cz + rw * cw, 0.0f);
+            }
+            specular = Especular == ESPECULAR_ENTERO ? potenciaEntera(specAngle, luces.exponente[i]) : std::pow(specAngle, luces.brillantez[i]);
+        }
+
+        //Se acumula la componente de luz obtenida.
+        color += lambertian * Eigen::Vector3f(luces.difusoR[i], luces.difusoG[i], luces.difusoB[i]) +
+                 specular * Eigen::Vector3f(luces.especularR[i], luces.especularG[i], luces.especularB[i]);
+    }
+
+    if (ConTextura) {
+        color = color.cwiseProduct(muestrearTextura(uv, nivelTextura));
+        return Color{color[0], color[1], color[2]};
+    }
+
+    //Obtención del valor de la textura en este punto. La parte fraccionaria (con el signo de la coordenada) es exactamente
+    //la de fmod(a, 1.0), pero sin la llamada.
+    double a = uv.x() * tamChecker, b = uv.y() * tamChecker;
+    checker = (a - std::trunc(a) > 0.5) ^ (b - std::trunc(b) < 0.5);
+    intensidadChecker = 0.2 * (1 - checker) + 0.8 * checker;
+
+    //Se aplica el valor del checker al color obtenido en este punto.
+    color *= intensidadChecker;
+
+    return Color{color[0], color[1], color[2]};
+}
+
+//Se eleva "base" a un exponente entero no negativo elevando al cuadrado, con menos operaciones que std::pow.
+inline float potenciaEntera(float base, int exponente) {
+    float resultado = 1.0f;
+    while (exponente > 0) {
+        if (exponente & 1) {
+            resultado *= base;
+        }
+        base *= base;
+        exponente >>= 1;
+    }
+    return resultado;
+}
+
+//Se muestrea la textura en las coordenadas "uv" (que se repiten fuera de [0, 1]) con el filtro elegido: el texel más
+//cercano del nivel más cercano, bilineal en el nivel más cercano o trilineal entre los dos niveles que rodean a "nivel".
+Eigen::Vector3f muestrearTextura(Eigen::Vector2f uv, float nivel) {
+    int ultimo = int(textura.niveles.size()) - 1;
+    float s = uv.x(), t = 1 - uv.y();   //La v del OBJ crece hacia arriba y los renglones de la imagen hacia abajo.
+
+    nivel = std::min(std::max(nivel, 0.0f), float(ultimo));
+    if (filtroTextura == FILTRO_CERCANO) {
+        const NivelTextura &datos = textura.niveles[int(nivel + 0.5f)];
+        uint32_t texel = leerTexel(datos, int(std::floor(s * datos.ancho)), int(std::floor(t * datos.alto)));
+        return Eigen::Vector3f(texel & 0xFF, (texel >> 8) & 0xFF, (texel >> 16) & 0xFF) / 255.0f;
+    }
+    if (filtroTextura == FILTRO_BILINEAL || nivel == ultimo) {
+        return muestrearBilineal(textura.niveles[int(nivel + 0.5f)], s, t);
+    }
+    int fino = int(nivel);
+    float peso = nivel - fino;
+    return (1 - peso) * muestrearBilineal(textura.niveles[fino], s, t) + peso * muestrearBilineal(textura.niveles[fino + 1], s, t);
+}
+
+//Interpolación bilineal de los 2x2 texeles del nivel que rodean al punto (s, t) de la textura.
+Eigen::Vector3f muestrearBilineal(const NivelTextura &datos, float s, float t) {
+    float u = s * datos.ancho - 0.5f, v = t * datos.alto - 0.5f;
+    float x0 = std::floor(u), y0 = std::floor(v);
+    float fx = u - x0, fy = v - y0;
+    float pesos[4] = {(1 - fx) * (1 - fy), fx * (1 - fy), (1 - fx) * fy, fx * fy};
+    Eigen::Vector3f color = Eigen::Vector3f::Zero();
+
+    for (int k = 0; k < 4; k++) {
+        uint32_t texel = leerTexel(datos, int(x0) + k % 2, int(y0) + k / 2);
+        color += pesos[k] * Eigen::Vector3f(texel & 0xFF, (texel >> 8) & 0xFF, (texel >> 16) & 0xFF);
+    }
+    return color / 255.0f;
+}
+
+//Se lee el texel (x, y) del nivel; las coordenadas fuera del nivel se repiten.
+inline uint32_t leerTexel(const NivelTextura &datos, int x, int y) {
+    x %= datos.ancho;
+    y %= datos.alto;
+    x += x < 0 ? datos.ancho : 0;
+    y += y < 0 ? datos.alto : 0;
+    const uint32_t &texel = textura.texeles[direccionTexel(datos, x, y)];
+    CONTAR_TEXEL(&texel);
+    return texel;
+}
+
+//Posición del texel (x, y) del nivel en el arreglo de la textura: su mosaico y, dentro de él, el código de Morton de
+//sus coordenadas (los bits de x y y intercalados).
+inline size_t direccionTexel(const NivelTextura &datos, int x, int y) {
+    if (textura.lineal) {
+        return datos.inicio + size_t(y) * datos.ancho + x;
+    }
+    const int mascara = (1 << bitsMosaicoTextura) - 1;
+    size_t mosaico = size_t(y >> bitsMosaicoTextura) * datos.mosaicosX + (x >> bitsMosaicoTextura);
+    uint32_t morton = 0;
+    for (int bit = 0; bit < bitsMosaicoTextura; bit++) {
+        morton |= ((x & mascara) >> bit & 1) << (2 * bit) | ((y & mascara) >> bit & 1) << (2 * bit + 1);
+    }
+    return datos.inicio + (mosaico << (2 * bitsMosaicoTextura)) + morton;
+}
+
+//Se colorea un pixel con coordenadas X y Y con sus componentes R, G y B normalizadas.
+//El pixel se escribe en el buffer de color del destino de render (o en el de la vista del lote que dibuja el hilo); se
+//verá hasta que se despliegue el frame.
+void dibujarPuntoColor(int x, int y, float R, float G, float B) {
+    uint32_t r = uint32_t(std::min(std::max(R, 0.0f), 1.0f) * 255.0f + 0.5f);
+    uint32_t g = uint32_t(std::min(std::max(G, 0.0f), 1.0f) * 255.0f + 0.5f);
+    uint32_t b = uint32_t(std::min(std::max(B, 0.0f), 1.0f) * 255.0f + 0.5f);
+
+    uint32_t *pixeles = vistaHilo != nullptr ? vistaHilo->pixeles.data() : destino.color;
+    pixeles[y * destino.paso + x] = (r << despRojo) | (g << despVerde) | (b << despAzul);
+
+    return;
+}
+
+//Se pinta de negro todo el buffer de color del destino de render.
+void limpiarFramebuffer() {
+    memset(destino.color, 0, size_t(destino.paso) * destino.alto * sizeof(uint32_t));
+
+    return;
+}
+
+//Se reserva un buffer de "bytes" bytes alineado a 64 bytes (una línea de caché), para liberarse con free.
+void *reservarPlano(size_t bytes) {
+    void *plano = aligned_alloc(64, std::max<size_t>(64, (bytes + 63) & ~size_t(63)));
+    if (plano == NULL) {
+        std::cout << "No hay memoria suficiente para el destino de render." << std::endl;
+        exit(-1);
+    }
+    return plano;
+}
+
+//Se ajusta el destino de render al tamaño actual de la ventana con la escala de resolución "escala". Los buffers sólo
+//se vuelven a reservar si no caben en los que ya hay, así que la resolución dinámica no reserva memoria en cada frame.
+void ajustarDestino(float escala) {
+    destino.escala = std::min(1.0f, std::max(escalaMinima, escala));
+    destino.ancho = std::max(1, int(std::lround(anchoVen * destino.escala)));
+    destino.alto = std::max(1, int(std::lround(altoVen * destino.escala)));
+    destino.paso = (destino.ancho + 15) & ~15;
+    destino.aspecto = float(altoVen) / anchoVen;
+    size_t pixeles = size_t(destino.paso) * destino.alto;
+    if (pixeles > destino.capacidad) {
+        liberarDestino();
+        destino.profundidad = (float *) reservarPlano(pixeles * sizeof(float));
+        destino.color = (uint32_t *) reservarPlano(pixeles * sizeof(uint32_t));
+        destino.capacidad = pixeles;
+    }
+}
+
+//Se liberan los buffers del destino de render.
+void liberarDestino() {
+    free(destino.profundidad);
+    free(destino.color);
+    destino.profundidad = nullptr;
+    destino.color = nullptr;
+    destino.capacidad = 0;
+}
+
+//Se pasa el buffer de color del destino de render al framebuffer trasero, del tamaño de la ventana.
+void resolverDestino() {
+    escalarImagen(destino.color, destino.ancho, destino.alto, destino.paso, framebuffers[frameTrasero].pixeles, anchoVen, altoVen);
+}
+
+//Se copia la imagen "origen" (ancho x alto, con "paso" pixeles por renglón) a "salida" (anchoSalida x altoSalida, sin
+//relleno). Si los tamaños son distintos, cada pixel de la salida toma el del origen en el que cae su centro.
+void escalarImagen(const uint32_t *origen, int ancho, int alto, int paso, uint32_t *salida, int anchoSalida, int altoSalida) {
+    std::vector<int> columnas(anchoSalida);     //Columna del origen de cada columna de la salida.
+    for (int x = 0; x < anchoSalida; x++) {
+        columnas[x] = std::min(ancho - 1, int((2 * int64_t(x) + 1) * ancho / (2 * int64_t(anchoSalida))));
+    }
+    ejecutarEnParalelo([&](int hilo) {
+        for (int y = altoSalida * hilo / numHilos; y < altoSalida * (hilo + 1) / numHilos; y++) {
+            const uint32_t *renglon = origen + size_t(paso) * std::min(alto - 1, int((2 * int64_t(y) + 1) * alto / (2 * int64_t(altoSalida))));
+            uint32_t *renglonSalida = salida + size_t(y) * anchoSalida;
+            if (ancho == anchoSalida) {
+                memcpy(renglonSalida, renglon, anchoSalida * sizeof(uint32_t));
+                continue;
+            }
+            for (int x = 0; x < anchoSalida; x++) {
+                renglonSalida[x] = renglon[columnas[x]];
+            }
+        }
+    });
+}
+
+#ifndef SIN_X11
+//Se despliega el framebuffer trasero en la ventana con una sola petición y se intercambian los framebuffers.
+void presentarFrame() {
+    Framebuffer &fb = framebuffers[frameTrasero];
+
+    if (usarShm) {
+        XShmPutImage(display, win, gc, fb.imagen, 0, 0, 0, 0, anchoVen, altoVen, False);
+    }
+    else {
+        XPutImage(display, win, gc, fb.imagen, 0, 0, 0, 0, anchoVen, altoVen);
+    }
+    //Se espera a que el servidor termine de copiar la imagen antes de volver a escribir en ella.
+    XSync(display, False);
+
+    frameTrasero = 1 - frameTrasero;
+
+    return;
+}
+
+//Se aplica un cambio de la cámara o del modelo al estado objetivo de la vista. Si se estaba renderizando un frame, se
+//cancela: el hilo de renderizado empieza de nuevo con el estado que combina todas las entradas recibidas.
+//Los cambios que no son "entrada" (el tamaño de la ventana o la escala) no cuentan en la latencia ni hacen burdo el frame.
+void pedirCambio(const std::function<void(EstadoVista &)> &cambio, bool entrada) {
+    std::lock_guard<std::mutex> lock(estadoVista.mutex);
+    cambio(estadoVista);
+    estadoVista.version++;
+    if (!entrada) {
+        cancelarFrame = true;
+        estadoVista.cambio.notify_one();
+        return;
+    }
+    estadoVista.entradas++;
+    if (!estadoVista.entradaPendiente) {
+        estadoVista.entradaPendiente = true;
+        estadoVista.primeraEntrada = std::chrono::steady_clock::now();
+    }
+    cancelarFrame = true;
+    estadoVista.cambio.notify_one();
+}
+
+//Bucle del hilo de renderizado: espera a que cambie el estado objetivo de la vista, lo renderiza y despliega el frame
+//si nadie lo canceló. Reporta la latencia desde la entrada más antigua que muestra cada frame y los frames descartados.
+//Si "carga" no es nula, el modelo todavía se está leyendo: mientras tanto se dibujan las caras que ya llegaron y, al
+//terminar la carga, el hilo guarda el modelo completo en "modelo".
+//Con la resolución dinámica, la escala de los frames en movimiento se ajusta después de cada uno para acercar su tiempo
+//a objetivoFrame; el frame que se dibuja al detenerse vuelve a la escala pedida.
+void hiloRenderizado(Malla &modelo, const std::vector<Luz> &luces, CargaProgresiva *carga) {
+    using reloj = std::chrono::steady_clock;
+    long versionDibujada = 0;       //Versión del estado que se ve en la ventana.
+    long entradasVistas = 0;        //Entradas que ya se incluyeron en algún frame empezado.
+    long entradasFrame = 0;         //Entradas que se combinaron en el frame actual (incluidas las de frames descartados).
+    long descartados = 0, descartadosFrame = 0, presentados = 0;
+    bool hayPendiente = false;      //Hay una entrada que todavía no se ve en la ventana.
+    reloj::time_point entradaPendiente;    //Momento de la entrada más antigua que todavía no se ve.
+    double latenciaTotal = 0, latenciaMaxima = 0;
+    bool detalleCompleto = true;    //El frame desplegado se renderizó con la malla completa.
+    bool cargando = carga != nullptr;   //El OBJ todavía se está leyendo.
+    Malla parcial;                  //Caras leídas hasta el último frame parcial.
+    size_t carasNuevas = 0;         //Caras que se tomaron de la cola y todavía no están en la malla parcial.
+    reloj::time_point siguienteParcial = reloj::now();  //Antes de este momento no se arma otra malla parcial.
+    float escalaMovimiento = 0;     //Escala de los frames en movimiento con la resolución dinámica (0: la pedida).
+
+    for (;;) {
+        Eigen::Matrix4f camara, transformacion;
+        long version;
+        int anchoPedido, altoPedido;
+        float escalaPedida;
+        bool dinamica;
+        bool enMovimiento = false;  //El frame responde a una entrada: se renderiza con un nivel de detalle burdo.
+        {
+            //Si el frame desplegado es burdo y no llegan entradas en esperaDetalle ms, se renderiza con todo el detalle.
+            std::unique_lock<std::mutex> lock(estadoVista.mutex);
+            auto hayCambio = [&] {
+                return estadoVista.terminar || estadoVista.redesplegar || estadoVista.version != versionDibujada;
+            };
+            //Durante la carga, la espera se interrumpe cada intervaloCarga ms para revisar la cola de lotes.
+            bool refinar = false, revisarCarga = false;
+            if (cargando) {
+                revisarCarga = !estadoVista.cambio.wait_for(lock, std::chrono::milliseconds(intervaloCarga), hayCambio);
+            }
+            else if (detalleCompleto) {
+                estadoVista.cambio.wait(lock, hayCambio);
+            }
+            else {
+                refinar = !estadoVista.cambio.wait_for(lock, std::chrono::milliseconds(esperaDetalle), hayCambio);
+            }
+            if (estadoVista.terminar) {
+                break;
+            }
+            if (revisarCarga) {
+                lock.unlock();
+                carasNuevas += tomarLotes(*carga);
+                //Sólo se dibuja otro frame parcial si llegaron caras y ya pasó la espera; al terminar la carga, siempre.
+                if (!carga->todoTomado && (carasNuevas == 0 || reloj::now() < siguienteParcial)) {
+                    continue;
+                }
+                lock.lock();
+            }
+            else if (!refinar && estadoVista.version == versionDibujada) {
+                estadoVista.redesplegar = false;
+                lock.unlock();
+                frameTrasero = 1 - frameTrasero;
+                presentarFrame();
+                continue;
+            }
+            camara = estadoVista.camara;
+            transformacion = estadoVista.transformacion;
+            version = estadoVista.version;
+            anchoPedido = estadoVista.anchoVentana;
+            altoPedido = estadoVista.altoVentana;
+            escalaPedida = estadoVista.escala;
+            dinamica = estadoVista.resolucionDinamica;
+            enMovimiento = estadoVista.entradaPendiente || hayPendiente;
+            entradasFrame += estadoVista.entradas - entradasVistas;
+            entradasVistas = estadoVista.entradas;
+            if (estadoVista.entradaPendiente && !hayPendiente) {
+                hayPendiente = true;
+                entradaPendiente = estadoVista.primeraEntrada;
+            }
+            estadoVista.entradaPendiente = false;
+            estadoVista.redesplegar = false;
+            cancelarFrame = false;
+        }
+
+        //Durante la carga se arma la malla parcial con las caras nuevas. Cuando ya se tomó el último lote, se termina el
+        //modelo (con las UVs corregidas) y desde este frame se dibuja el modelo completo.
+        reloj::time_point inicioFrame = reloj::now();
+        if (cargando) {
+            carasNuevas += tomarLotes(*carga);
+            if (carga->todoTomado) {
+                modelo = terminarCargaProgresiva(*carga);
+                if (carga->usarDetalle) {
+                    iniciarNivelesDetalle(modelo);
+                }
+                parcial = Malla();
+                cargando = false;
+            }
+            else if (carasNuevas > 0) {
+                parcial = mallaParcial(*carga);
+                carasNuevas = 0;
+                std::cout << "Carga progresiva: " << parcial.numCaras() << " caras leídas (" << int(carga->fraccion * 100) << "% del archivo).\n";
+            }
+            if (cargando && parcial.numCaras() == 0) {
+                versionDibujada = version;
+                continue;
+            }
+        }
+
+        //Si cambió el tamaño de la ventana, se vuelven a crear los framebuffers; el destino de render se ajusta al tamaño y
+        //a la escala de este frame.
+        if (anchoPedido != anchoVen || altoPedido != altoVen) {
+            destruirFramebuffers();
+            anchoVen = anchoPedido;
+            altoVen = altoPedido;
+            crearFramebuffers();
+            std::cout << "La ventana ahora es de " << anchoVen << "x" << altoVen << " pixeles.\n";
+        }
+        if (!dinamica || escalaMovimiento == 0 || escalaMovimiento > escalaPedida) {
+            escalaMovimiento = escalaPedida;
+        }
+        ajustarDestino(dinamica && enMovimiento ? escalaMovimiento : escalaPedida);
+
+        std::cout << "La cámara está en la posición (" << -camara(0, 3) << ", " << -camara(1, 3) << ", " << -camara(2, 3)<< ").\n";
+        limpiarFramebuffer();                               //Se pinta el framebuffer de negro.
+        std::shared_ptr<const NivelDetalle> nivel;
+        const Malla &malla = elegirNivelDetalle(cargando ? parcial : modelo, camara * transformacion, enMovimiento ? -1 : 0, nivel);
+        reloj::time_point inicioRender = reloj::now();
+        if (!renderizar(malla, luces, camara, transformacion, destino.profundidad)) {
+            std::cout << "Se descartó el frame: llegó una entrada nueva.\n";
+            descartados++;
+            descartadosFrame++;
+            continue;
+        }
+        double tiempoRender = std::chrono::duration<double, std::milli>(reloj::now() - inicioRender).count();
+        presentarFrame();                                   //Se despliega el frame terminado.
+        versionDibujada = version;
+        detalleCompleto = &malla == &modelo && destino.escala == escalaPedida;
+        //La escala cambia a lo más un 25% por frame, proporcional a la raíz del tiempo (los pixeles van con su cuadrado).
+        if (dinamica && enMovimiento) {
+            float factor = std::min(1.25f, std::max(0.75f, float(std::sqrt(objetivoFrame / std::max(tiempoRender, 0.1)))));
+            escalaMovimiento = std::min(escalaPedida, std::max(escalaMinima, escalaMovimiento * factor));
+            std::cout << "Resolución dinámica: " << destino.ancho << "x" << destino.alto << " en " << tiempoRender
+                      << " ms; el siguiente frame en movimiento usa la escala " << escalaMovimiento << ".\n";
+        }
+        presentados++;
+        //Armar y dibujar la malla parcial no debe ocupar más de un tercio del tiempo de la carga.
+        if (cargando) {
+            siguienteParcial = reloj::now() + std::max(reloj::duration(std::chrono::milliseconds(esperaParcial)), 2 * (reloj::now() - inicioFrame));
+        }
+
+        if (hayPendiente) {
+            double latencia = std::chrono::duration<double, std::milli>(reloj::now() - entradaPendiente).count();
+            latenciaTotal += latencia;
+            latenciaMaxima = std::max(latenciaMaxima, latencia);
+            hayPendiente = false;
+            std::cout << "Latencia: " << latencia << " ms desde la entrada; " << entradasFrame << " entrada(s) combinada(s) y "
+                      << descartadosFrame << " frame(s) descartado(s) en este frame.\n";
+        }
+        entradasFrame = 0;
+        descartadosFrame = 0;
+    }
+
+    if (presentados > 1) {
+        std::cout << "Se desplegaron " << presentados << " frames y se descartaron " << descartados << "; latencia promedio de "
+                  << latenciaTotal / (presentados - 1) << " ms (máxima de " << latenciaMaxima << " ms).\n";
+    }
+}
+#endif
+
+//Se regresa la matriz de rotación de "grados" grados sobre el eje 'x' o 'y'.
+Eigen::Matrix4f matrizRotacion(char eje, float grados) {
+    Eigen::Matrix4f rotacion = Eigen::Matrix4f::Identity();
+    float angulo = grados * (M_PI/180);
+
+    if (eje == 'x') {
+        rotacion(1, 1) = cos(angulo);
+        rotacion(1, 2) = sin(angulo); 
+        rotacion(2, 1) = -sin(angulo);
+        rotacion(2, 2) = cos(angulo);
+    }
+    else {
+        rotacion(0, 0) = cos(angulo);
+        rotacion(0, 2) = sin(angulo); 
+        rotacion(2, 0) = -sin(angulo);
+        rotacion(2, 2) = cos(angulo);
+    }
+    return rotacion;
+}
+
+//Se renderizan sin ventana los frames descritos en el archivo "guion" y se guardan como imágenes. Con "lote", los frames
+//sólo se anotan como vistas y al terminar el guion se renderizan todas juntas con renderizarVistas.
+//Regresa 0 si todo el guion se ejecutó correctamente.
+int ejecutarGuion(Malla &modelo, const std::vector<Luz> &luces, Eigen::Matrix4f camara, const std::string &guion,
+                  const std::string &prefijo, const std::string &formato, bool lote) {
+    std::ifstream archivo(guion);   //Archivo con el guion.
+    std::string linea;              //Línea leída del guion.
+    std::string comando;            //Comando de la línea.
+    int numLinea = 0;               //Número de línea (para reportar errores).
+    int numFrames = 0;              //Frames renderizados.
+    Eigen::Matrix4f transformacion = Eigen::Matrix4f::Identity();  //Matriz del modelo con las rotaciones del guion.
+    int nivelDetalle = 0;           //Nivel de detalle de los frames (0 es la malla completa y -1 el de movimiento).
+    double segundos = 0;            //Tiempo total de renderizado.
+    std::vector<VistaLote> vistas;  //Vistas anotadas en el modo de lote.
+
+    if (!archivo.is_open()) {
+        std::cout << "No se pudo abrir el guion '" << guion << "'." << std::endl;
+        return -1;
+    }
+
+    //El único framebuffer vive en memoria; no se crea ninguna imagen de X11.
+    framebuffers[0].pixeles = new uint32_t[anchoVen * altoVen];
+    frameTrasero = 0;
+
+    while (std::getline(archivo, linea)) {
+        numLinea++;
+        linea = linea.substr(0, linea.find('#'));   //Se ignoran los comentarios.
+        std::istringstream tokens(linea);
+        if (!(tokens >> comando)) {
+            continue;
+        }
+
+        if (comando == "camara" || comando == "mover") {
+            float x, y, z;
+            if (!(tokens >> x >> y >> z)) {
+                std::cout << guion << ":" << numLinea << ": se esperaban tres coordenadas.\n";
+                delete [] framebuffers[0].pixeles;
+                return -1;
+            }
+            //La matriz de la cámara guarda la traslación inversa de su posición.
+            if (comando == "camara") {
+                camara(0, 3) = -x;
+                camara(1, 3) = -y;
+                camara(2, 3) = -z;
+            }
+            else {
+                camara(0, 3) -= x;
+                camara(1, 3) -= y;
+                camara(2, 3) -= z;
+            }
+        }
+        else if (comando == "rotar") {
+            char eje;
+            float grados;
+            if (!(tokens >> eje >> grados) || (eje != 'x' && eje != 'y')) {
+                std::cout << guion << ":" << numLinea << ": se esperaba 'rotar x|y grados'.\n";
+                delete [] framebuffers[0].pixeles;
+                return -1;
+            }
+            transformacion = matrizRotacion(eje, grados) * transformacion;
+        }
+        else if (comando == "detalle") {
+            std::string modo;
+            if (!(tokens >> modo) || (modo != "completo" && modo != "auto" && atoi(modo.c_str()) <= 0)) {
+                std::cout << guion << ":" << numLinea << ": se esperaba 'detalle completo|auto|N'.\n";
+                delete [] framebuffers[0].pixeles;
+                return -1;
+            }
+            if (lote && modo != "completo") {
+                std::cout << guion << ":" << numLinea << ": en el modo de lote todas las vistas usan la malla completa.\n";
+                delete [] framebuffers[0].pixeles;
+                return -1;
+            }
+            nivelDetalle = modo == "completo" ? 0 : modo == "auto" ? -1 : atoi(modo.c_str());
+            if (nivelDetalle != 0) {
+                //Sin ventana, los niveles se construyen hasta que se piden y se espera a que estén listos.
+                iniciarNivelesDetalle(modelo);
+                esperarNivelesDetalle(modelo);
+            }
+        }
+        else if (comando == "frame" || comando == "giro") {
+            //Un giro son N frames con el modelo rotado 360 / N grados más sobre el eje y en cada uno.
+            std::string archivoFrame;
+            int numGiro = 1;
+            if (comando == "giro" && (!(tokens >> numGiro) || numGiro <= 0)) {
+                std::cout << guion << ":" << numLinea << ": se esperaba 'giro N'.\n";
+                delete [] framebuffers[0].pixeles;
+                return -1;
+            }
+            if (comando == "frame") {
+                tokens >> archivoFrame;
+            }
+
+            for (int k = 0; k < numGiro; k++) {
+                Eigen::Matrix4f transformacionFrame = matrizRotacion('y', 360.0f * k / numGiro) * transformacion;
+                std::string nombre = archivoFrame;
+                if (nombre.empty()) {
+                    char numero[16];
+                    snprintf(numero, sizeof(numero), "_%04d.", numFrames);
+                    nombre = prefijo + numero + formato;
+                }
+                numFrames++;
+                if (lote) {
+                    vistas.emplace_back();
+                    vistas.back().modeloVista = camara * transformacionFrame;
+                    vistas.back().nombre = nombre;
+                    continue;
+                }
+
+                auto inicio = std::chrono::steady_clock::now();
+                limpiarFramebuffer();
+                std::shared_ptr<const NivelDetalle> nivel;
+                renderizar(elegirNivelDetalle(modelo, camara * transformacionFrame, nivelDetalle, nivel), luces, camara, transformacionFrame, destino.profundidad);
+                segundos += std::chrono::duration<double>(std::chrono::steady_clock::now() - inicio).count();
+
+                if (!guardarImagen(nombre, nombre.substr(nombre.find_last_of('.') + 1))) {
+                    std::cout << "No se pudo escribir la imagen '" << nombre << "'." << std::endl;
+                    delete [] framebuffers[0].pixeles;
+                    return -1;
+                }
+            }
+        }
+        else {
+            std::cout << guion << ":" << numLinea << ": comando desconocido '" << comando << "'.\n";
+            delete [] framebuffers[0].pixeles;
+            return -1;
+        }
+    }
+
+    //En el modo de lote, todas las vistas se renderizan juntas y después se guardan.
+    if (lote) {
+        auto inicio = std::chrono::steady_clock::now();
+        renderizarVistas(modelo, luces, vistas);
+        segundos = std::chrono::duration<double>(std::chrono::steady_clock::now() - inicio).count();
+        for (const VistaLote &vista : vistas) {
+            escalarImagen(vista.pixeles.data(), destino.ancho, destino.alto, destino.paso, framebuffers[0].pixeles, anchoVen, altoVen);
+            if (!guardarImagen(vista.nombre, vista.nombre.substr(vista.nombre.find_last_of('.') + 1))) {
+                std::cout << "No se pudo escribir la imagen '" << vista.nombre << "'." << std::endl;
+                delete [] framebuffers[0].pixeles;
+                return -1;
+            }
+        }
+    }
+
+    std::cout << "Se renderizaron " << numFrames << (lote ? " vistas" : " frames") << " en " << segundos << " s";
+    if (numFrames > 0) {
+        std::cout << " (" << numFrames / segundos << (lote ? " vistas" : " frames") << " por segundo)";
+    }
+    std::cout << ".\n";
+
+    delete [] framebuffers[0].pixeles;
+    return 0;
+}
+
+//Se calcula el CRC-32 de un bloque de bytes (usado por los bloques de PNG).
+uint32_t crc32(const uint8_t *datos, size_t n, uint32_t crc = 0) {
+    static uint32_t tabla[256];
+    static bool tablaLista = false;
+    if (!tablaLista) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            tabla[i] = c;
+        }
+        tablaLista = true;
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++) {
+        crc = tabla[(crc ^ datos[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+//Se escribe un bloque (chunk) de PNG con su longitud, tipo, datos y CRC.
+void escribirBloquePNG(std::ofstream &archivo, const char *tipo, const std::vector<uint8_t> &datos) {
+    uint8_t encabezado[8] = {uint8_t(datos.size() >> 24), uint8_t(datos.size() >> 16), uint8_t(datos.size() >> 8), uint8_t(datos.size()),
+                             uint8_t(tipo[0]), uint8_t(tipo[1]), uint8_t(tipo[2]), uint8_t(tipo[3])};
+    uint32_t crc = crc32(encabezado + 4, 4);
+    crc = crc32(datos.data(), datos.size(), crc);
+    uint8_t cola[4] = {uint8_t(crc >> 24), uint8_t(crc >> 16), uint8_t(crc >> 8), uint8_t(crc)};
+
+    archivo.write((const char *) encabezado, 8);
+    archivo.write((const char *) datos.data(), datos.size());
+    archivo.write((const char *) cola, 4);
+}
+
+//Se guarda el framebuffer trasero (o la imagen "pixeles", con el tamaño de la ventana) en el archivo "nombre" con
+//formato "ppm" o "png". El PNG se escribe sin compresión (bloques "stored" de zlib) para no depender de bibliotecas externas.
+bool guardarImagen(const std::string &nombre, const std::string &formato, const uint32_t *pixeles) {
+    if (pixeles == nullptr) {
+        pixeles = framebuffers[frameTrasero].pixeles;
+    }
+    std::vector<uint8_t> rgb;   //Pixeles desempaquetados, fila por fila.
+    std::ofstream archivo(nombre, std::ios::binary);
+
+    if (!archivo.is_open()) {
+        return false;
+    }
+    
+    //En PNG cada fila inicia con el tipo de filtro (0 = ninguno).
+    for (int y = 0; y < altoVen; y++) {
+        if (formato == "png") {
+            rgb.push_back(0);
+        }
+        for (int x = 0; x < anchoVen; x++) {
+            uint32_t pixel = pixeles[y * anchoVen + x];
+            rgb.push_back(uint8_t(pixel >> despRojo));
+            rgb.push_back(uint8_t(pixel >> despVerde));
+            rgb.push_back(uint8_t(pixel >> despAzul));
+        }
+    }
+
+    if (formato == "ppm") {
+        archivo << "P6\n" << anchoVen << " " << altoVen << "\n255\n";
+        archivo.write((const char *) rgb.data(), rgb.size());
+        return archivo.good();
+    }
+    if (formato != "png") {
+        return false;
+    }
+
+    //Encabezado: ancho, alto, 8 bits por canal, color RGB, sin entrelazado.
+    const uint8_t firma[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    std::vector<uint8_t> ihdr = {uint8_t(anchoVen >> 24), uint8_t(anchoVen >> 16), uint8_t(anchoVen >> 8), uint8_t(anchoVen),
+                                 uint8_t(altoVen >> 24), uint8_t(altoVen >> 16), uint8_t(altoVen >> 8), uint8_t(altoVen),
+                                 8, 2, 0, 0, 0};
+    
+    //Flujo zlib con bloques sin comprimir de a lo más 65535 bytes y suma Adler-32 al final.
+    std::vector<uint8_t> zlib = {0x78, 0x01};
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < rgb.size(); i += 65535) {
+        uint16_t n = uint16_t(std::min<size_t>(65535, rgb.size() - i));
+        zlib.push_back(i + n == rgb.size());
+        zlib.push_back(n & 0xFF);
+        zlib.push_back(n >> 8);
+        zlib.push_back(~n & 0xFF);
+        zlib.push_back((~n >> 8) & 0xFF);
+        zlib.insert(zlib.end(), rgb.begin() + i, rgb.begin() + i + n);
+    }
+    for (uint8_t byte : rgb) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    uint32_t adler = (b << 16) | a;
+    zlib.push_back(adler >> 24);
+    zlib.push_back(adler >> 16);
+    zlib.push_back(adler >> 8);
+    zlib.push_back(adler);
 
-    //Obtención del colormap.
-    cm = DefaultColormap(display, DefaultScreen(display));
+    archivo.write((const char *) firma, 8);
+    escribirBloquePNG(archivo, "IHDR", ihdr);
+    escribirBloquePNG(archivo, "IDAT", zlib);
+    escribirBloquePNG(archivo, "IEND", {});
+    return archivo.good();
+}
 
-    //Crear el contexto gráfico con valores por defecto (0, 0).
-    gc = XCreateGC(display, win, 0, 0);
+//Se busca la textura difusa del modelo: se leen las líneas del OBJ hasta su primera cara buscando los archivos de
+//materiales ("mtllib") y el primer material que se usa ("usemtl"), y se toma el map_Kd de ese material (o el primero
+//que haya en los archivos). La imagen se decodifica y se prepara su cadena de mipmaps en "textura". Toda la malla usa
+//esa textura. Regresa falso si el modelo no tiene textura o no se pudo leer.
+bool cargarTexturaModelo(const std::string &nombre_archivo, bool lineal) {
+    std::string directorio = nombre_archivo.substr(0, nombre_archivo.find_last_of('/') + 1);
+    std::ifstream obj(nombre_archivo);
+    std::vector<std::string> bibliotecas;   //Archivos de materiales del OBJ.
+    std::string material;                   //Primer material que se usa en el OBJ.
+    std::string linea, comando;
 
-    //Se espera el evento MapNotify para poder empezar el dibujo.
-    for(;;) {
-        XEvent e;
-	    XNextEvent(display, &e);
-	    if (e.type == MapNotify)
-		    break;
+    while (std::getline(obj, linea) && linea.compare(0, 2, "f ") != 0) {
+        std::istringstream tokens(linea);
+        tokens >> comando;
+        if (comando == "mtllib") {
+            std::string biblioteca;
+            while (tokens >> biblioteca) {
+                bibliotecas.push_back(biblioteca);
+            }
+        }
+        else if (comando == "usemtl" && material.empty()) {
+            tokens >> material;
+        }
     }
 
-    //Se indica que se va a dibujar siempre puntos blancos.
-    XSetForeground(display, gc, WhitePixel(display, DefaultScreen(display)));
+    std::string imagen, primeraImagen, materialImagen;
+    for (const std::string &biblioteca : bibliotecas) {
+        std::ifstream mtl(directorio + biblioteca);
+        std::string actual;
+        while (std::getline(mtl, linea)) {
+            std::istringstream tokens(linea);
+            if (!(tokens >> comando)) {
+                continue;
+            }
+            if (comando == "newmtl") {
+                tokens >> actual;
+            }
+            else if (comando == "map_Kd") {
+                //Las opciones (-s, -o, -bm, etc.) van antes del nombre del archivo, que es el último token.
+                std::string token, archivo;
+                while (tokens >> token) {
+                    archivo = token;
+                }
+                std::replace(archivo.begin(), archivo.end(), '\\', '/');
+                if (primeraImagen.empty()) {
+                    primeraImagen = archivo;
+                    materialImagen = actual;
+                }
+                if (actual == material && imagen.empty()) {
+                    imagen = archivo;
+                }
+            }
+        }
+    }
+    if (imagen.empty()) {
+        imagen = primeraImagen;
+        material = materialImagen;
+    }
+    if (imagen.empty()) {
+        return false;
+    }
 
-    return;
+    int ancho, alto;
+    std::vector<uint32_t> rgba;
+    auto inicio = std::chrono::steady_clock::now();
+    if (!decodificarImagen(directorio + imagen, ancho, alto, rgba)) {
+        std::cout << "No se pudo leer la textura '" << directorio + imagen << "' del material " << material
+                  << " (sólo se leen PNG y PPM); se usa el checker.\n";
+        return false;
+    }
+    construirMipmaps(rgba, ancho, alto, lineal);
+    std::cout << "Textura '" << imagen << "' del material " << material << ": " << ancho << "x" << alto << ", "
+              << textura.niveles.size() << " niveles de mipmap (" << textura.texeles.size() * sizeof(uint32_t) / 1e6 << " MB, "
+              << (lineal ? "por renglones" : "en mosaicos de 8x8 en orden de Morton") << "), leída en "
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - inicio).count() << " s.\n";
+    return true;
 }
 
-//Se aplica la matriz "transformacion" al vector de caras "modelo" pasados como argumento.
-void transformarModelo(std::vector<Cara> &modelo, Eigen::Matrix4f transformacion) {
-    //Por cada cara en el modelo, se aplica la transformación a cada vértice y normal.
-    Eigen::Vector4f uv;
-    Eigen::Vector4f uvRot;
-    for (int i = 0; i < modelo.size(); i++) {
-        modelo[i].vertice[0] = transformacion * modelo[i].vertice[0];
-        modelo[i].vertice[1] = transformacion * modelo[i].vertice[1];
-        modelo[i].vertice[2] = transformacion * modelo[i].vertice[2];
-        modelo[i].normal[0] = transformacion * modelo[i].normal[0];
-        modelo[i].normal[1] = transformacion * modelo[i].normal[1];
-        modelo[i].normal[2] = transformacion * modelo[i].normal[2];
+//Se lee la imagen "nombre" (PNG o PPM binario) como texeles RGBA por renglones, de arriba hacia abajo.
+bool decodificarImagen(const std::string &nombre, int &ancho, int &alto, std::vector<uint32_t> &rgba) {
+    std::ifstream archivo(nombre, std::ios::binary);
+    std::vector<uint8_t> datos((std::istreambuf_iterator<char>(archivo)), std::istreambuf_iterator<char>());
+
+    if (datos.size() >= 8 && datos[0] == 0x89 && datos[1] == 'P' && datos[2] == 'N' && datos[3] == 'G') {
+        return decodificarPNG(datos, ancho, alto, rgba);
+    }
+    if (datos.size() >= 2 && datos[0] == 'P' && datos[1] == '6') {
+        std::istringstream encabezado(std::string(datos.begin(), datos.begin() + std::min<size_t>(datos.size(), 64)));
+        std::string formato;
+        int maximo;
+        if (!(encabezado >> formato >> ancho >> alto >> maximo) || maximo != 255 || !dimensionesTextura(ancho, alto)) {
+            return false;
+        }
+        size_t inicio = size_t(encabezado.tellg()) + 1;
+        if (datos.size() < inicio + size_t(3) * ancho * alto) {
+            return false;
+        }
+        rgba.resize(size_t(ancho) * alto);
+        for (size_t i = 0; i < rgba.size(); i++) {
+            const uint8_t *texel = &datos[inicio + 3 * i];
+            rgba[i] = texel[0] | (texel[1] << 8) | (texel[2] << 16) | 0xFF000000u;
+        }
+        return true;
     }
+    return false;
 }
 
-//Se toma el modelo, las luces, la cámara, el buffer de proyección y se realiza el proceso de renderizado.
-void renderizar(const std::vector<Cara> &modelo, const std::vector<Luz> &luces, Eigen::Matrix4f camara, float **bufferProf) {
-    float xmin, ymin, xmax, ymax;
-    int xi, yi, xf, yf;
+//Se revisa que una textura de ancho x alto tenga lados de 1 a ladoMaximoTextura pixeles y que sus texeles RGBA quepan
+//en memoria; así, una cabecera corrupta no pide gigabytes antes de leer los datos.
+bool dimensionesTextura(int ancho, int alto) {
+    if (ancho <= 0 || alto <= 0 || ancho > ladoMaximoTextura || alto > ladoMaximoTextura) {
+        return false;
+    }
+    size_t pixeles = size_t(ancho) * size_t(alto);
+    return pixeles <= SIZE_MAX / (4 * sizeof(uint32_t));
+}
 
-    //Se rellena el buffer de profundidad con el valor del plano lejano.
-    for (int i = 0; i < altoVen; i++) {
-        for (int j = 0; j < anchoVen; j++)
-        bufferProf[i][j] = planoLejano;
+//Se decodifica un PNG no entrelazado de cualquier tipo de color (gris, RGB, paleta, con o sin alfa) y profundidad.
+//Las muestras de 16 bits se reducen a 8 y las de 1, 2 y 4 bits de gris se escalan a 8.
+bool decodificarPNG(const std::vector<uint8_t> &archivo, int &ancho, int &alto, std::vector<uint32_t> &rgba) {
+    std::vector<uint8_t> comprimido, paleta, crudo;
+    int profundidad = 0, tipoColor = -1, entrelazado = 0;
+    auto leer32 = [&](size_t i) { return uint32_t(archivo[i]) << 24 | uint32_t(archivo[i + 1]) << 16 | uint32_t(archivo[i + 2]) << 8 | archivo[i + 3]; };
+
+    for (size_t i = 8; i + 12 <= archivo.size();) {
+        uint32_t longitud = leer32(i);
+        if (longitud > archivo.size() - i - 12) {
+            return false;
+        }
+        const uint8_t *datos = &archivo[i + 8];
+        std::string tipo((const char *) &archivo[i + 4], 4);
+        if (tipo == "IHDR" && longitud >= 13) {
+            ancho = int(leer32(i + 8));
+            alto = int(leer32(i + 12));
+            profundidad = datos[8];
+            tipoColor = datos[9];
+            entrelazado = datos[12];
+        }
+        else if (tipo == "PLTE") {
+            paleta.assign(datos, datos + longitud);
+        }
+        else if (tipo == "IDAT") {
+            comprimido.insert(comprimido.end(), datos, datos + longitud);
+        }
+        else if (tipo == "IEND") {
+            break;
+        }
+        i += 12 + longitud;
     }
 
-    //Se analiza cada una de las caras del modelo.
-    for (int i = 0; i < modelo.size(); ++i) {
-        std::cout << "Renderizando. " << int((i+1) / float(modelo.size())*100) << "% completo.\r";
-        Cara cara = modelo[i];
-
-        //Se obtienen los vértices de la cara en coordenadas de dispositivo.
-        cara.vertDisp[0] = verticeADispositivo(cara.vertice[0], camara);
-        cara.vertDisp[1] = verticeADispositivo(cara.vertice[1], camara);
-        cara.vertDisp[2] = verticeADispositivo(cara.vertice[2], camara);
-
-        //Se guarda el valor invertido de la coordenada Z para saber la profundidad de la cara.
-        cara.vertDisp[0].z() = 1 / cara.vertDisp[0].z();
-        cara.vertDisp[1].z() = 1 / cara.vertDisp[1].z();
-        cara.vertDisp[2].z() = 1 / cara.vertDisp[2].z();
-
-        //Se obtienen las coordenadas X y Y más lejanas de los vértices.
-        xmin = std::min(cara.vertDisp[0].x(), std::min(cara.vertDisp[1].x(), cara.vertDisp[2].x()));
-        ymin = std::min(cara.vertDisp[0].y(), std::min(cara.vertDisp[1].y(), cara.vertDisp[2].y()));
-        xmax = std::max(cara.vertDisp[0].x(), std::max(cara.vertDisp[1].x(), cara.vertDisp[2].x()));
-        ymax = std::max(cara.vertDisp[0].y(), std::max(cara.vertDisp[1].y(), cara.vertDisp[2].y()));
-        
-        //Se verifica si la cara entra en la ventana (si se va a dibujar o no)
-        if (xmin > anchoVen - 1 || ymin > altoVen - 1 || xmax < 0  || ymax < 0) {
-            continue;
+    const int canalesTipo[7] = {1, 0, 3, 1, 2, 0, 4};
+    int canales = tipoColor >= 0 && tipoColor <= 6 ? canalesTipo[tipoColor] : 0;
+    bool profundidadValida = tipoColor == 0 ? (profundidad == 1 || profundidad == 2 || profundidad == 4 || profundidad == 8 || profundidad == 16) :
+                             tipoColor == 3 ? (profundidad == 1 || profundidad == 2 || profundidad == 4 || profundidad == 8) :
+                                              (profundidad == 8 || profundidad == 16);
+    if (canales == 0 || !profundidadValida || entrelazado != 0 || !dimensionesTextura(ancho, alto) || (tipoColor == 3 && paleta.empty())) {
+        return false;
+    }
+
+    int bitsPixel = canales * profundidad;
+    size_t bytesRenglon = (size_t(ancho) * bitsPixel + 7) / 8;
+    size_t bytesPixel = std::max(1, bitsPixel / 8);
+    size_t bytesImagen = size_t(alto) * (bytesRenglon + 1);
+    //DEFLATE comprime a lo más unas 1032 veces, así que no se reserva más de lo que pueden dar los IDAT.
+    crudo.reserve(std::min(bytesImagen, comprimido.size() * 1032));
+    if (!inflar(comprimido.data(), comprimido.size(), crudo, bytesImagen) || crudo.size() < bytesImagen) {
+        return false;
+    }
+
+    //Se quitan los filtros de cada renglón; cada uno predice los bytes a partir del anterior, el de arriba o ambos.
+    for (int y = 0; y < alto; y++) {
+        uint8_t *renglon = &crudo[y * (bytesRenglon + 1) + 1];
+        const uint8_t *arriba = y > 0 ? renglon - (bytesRenglon + 1) : nullptr;
+        int filtro = renglon[-1];
+        for (size_t i = 0; i < bytesRenglon; i++) {
+            int a = i >= bytesPixel ? renglon[i - bytesPixel] : 0;
+            int b = arriba != nullptr ? arriba[i] : 0;
+            int c = arriba != nullptr && i >= bytesPixel ? arriba[i - bytesPixel] : 0;
+            switch (filtro) {
+                case 0:
+                    break;
+                case 1:
+                    renglon[i] += a;
+                    break;
+                case 2:
+                    renglon[i] += b;
+                    break;
+                case 3:
+                    renglon[i] += (a + b) / 2;
+                    break;
+                case 4: {
+                    int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+                    renglon[i] += pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+                    break;
+                }
+                default:
+                    return false;
+            }
         }
-        else {
-            //Se obtienen las esquinas de un cuadrilátero que engloba la cara.
-            xi = std::max(0, int(std::floor(xmin)));
-            yi = std::max(0, int(std::floor(ymin)));
-            xf = std::min(anchoVen-1, int(std::floor(xmax)));
-            yf = std::min(altoVen-1, int(std::floor(ymax)));
-            //Se manda a dibujar la cara con las coordenadas recién obtenidas.
-            dibujarMasCercano(cara, luces, camara, bufferProf, xi, yi, xf, yf);
+    }
+
+    //Se leen las muestras de cada pixel: de 16 bits se toma el byte más significativo, y las de menos de 8 bits van
+    //empaquetadas del bit más significativo al menos significativo.
+    rgba.resize(size_t(ancho) * alto);
+    for (int y = 0; y < alto; y++) {
+        const uint8_t *renglon = &crudo[y * (bytesRenglon + 1) + 1];
+        for (int x = 0; x < ancho; x++) {
+            uint32_t muestras[4] = {0, 0, 0, 0};
+            for (int canal = 0; canal < canales; canal++) {
+                size_t bit = (size_t(x) * canales + canal) * profundidad;
+                muestras[canal] = profundidad >= 8 ? renglon[bit / 8] : (renglon[bit / 8] >> (8 - profundidad - bit % 8)) & ((1 << profundidad) - 1);
+            }
+            uint32_t r, g, b, alfa = 255;
+            if (tipoColor == 3) {
+                if (3 * muestras[0] + 2 >= paleta.size()) {
+                    return false;
+                }
+                r = paleta[3 * muestras[0]];
+                g = paleta[3 * muestras[0] + 1];
+                b = paleta[3 * muestras[0] + 2];
+            }
+            else if (canales <= 2) {
+                r = g = b = profundidad < 8 ? muestras[0] * 255 / ((1 << profundidad) - 1) : muestras[0];
+                alfa = canales == 2 ? muestras[1] : 255;
+            }
+            else {
+                r = muestras[0];
+                g = muestras[1];
+                b = muestras[2];
+                alfa = canales == 4 ? muestras[3] : 255;
+            }
+            rgba[size_t(y) * ancho + x] = r | (g << 8) | (b << 16) | (alfa << 24);
         }
     }
-    std::cout << std::endl;
+    return true;
 }
 
-//Se toma un vértice en coordenadas de mundo, una cámara y regresa el punto en coordenadas de dispositivo.
-//Basado en este tutorial: https://www.scratchapixel.com/lessons/3d-basic-rendering/computing-pixel-coordinates-of-3d-point/mathematics-computing-2d-coordinates-of-3d-points
-Eigen::Vector3f verticeADispositivo(Eigen::Vector4f vertice, Eigen::Matrix4f camara) {
-    Eigen::Vector4f verticeCamara;
-    Eigen::Vector2f verticePlanoProy;
-    Eigen::Vector2f verticeNDC;
-    Eigen::Vector3f verticeDispositivo;
-    
-    //Se obtiene el vértice en coordenadas de cámara.
-    verticeCamara = camara * vertice;
-    
-    //Se proyecta ese vértice en el plano de proyección.
-    verticePlanoProy.x() = planoCercano * verticeCamara.x() / -verticeCamara.z();
-    verticePlanoProy.y() = planoCercano * verticeCamara.y() / -verticeCamara.z();
-    
-    //Proyección a coordenadas de dispositivo normalizadas (NDC).
-    verticeNDC.x() = 2 * verticePlanoProy.x();
-    verticeNDC.y() = 2 * verticePlanoProy.y();
-    
-    //Obtención del vértice en coordenadas del dispositivo.
-    verticeDispositivo.x() = (verticeNDC.x() + 1) / 2 * anchoVen;
-    verticeDispositivo.y() = (1 - verticeNDC.y()) / 2 * altoVen;
-    verticeDispositivo.z() = -verticeCamara.z();
+//Se descomprime un flujo zlib (DEFLATE, RFC 1950 y 1951) y se agregan los bytes a "salida". No se verifica la suma
+//Adler-32 del final. Regresa falso si el flujo no es válido, está truncado o da más de "limite" bytes.
+bool inflar(const uint8_t *datos, size_t n, std::vector<uint8_t> &salida, size_t limite) {
+    static const uint16_t baseLongitud[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99,
+                                              115, 131, 163, 195, 227, 258};
+    static const uint8_t extraLongitud[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const uint16_t baseDistancia[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025,
+                                               1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    static const uint8_t extraDistancia[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12,
+                                               12, 13, 13};
+    static const uint8_t ordenLongitudes[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    HuffmanInflado literales, distancias, codigos;
+    bool ultimo;
 
-    return verticeDispositivo;
+    //Cabecera de zlib: método 8 (DEFLATE), suma de verificación correcta y sin diccionario.
+    if (n < 2 || (datos[0] & 0x0F) != 8 || ((datos[0] << 8) | datos[1]) % 31 != 0 || (datos[1] & 0x20)) {
+        return false;
+    }
+    LectorBits lector(datos + 2, n - 2);
+    do {
+        ultimo = lector.tomar(1);
+        int tipo = lector.tomar(2);
+        if (tipo == 0) {
+            //Bloque sin comprimir: empieza en el siguiente byte, con su longitud y el complemento de ésta.
+            lector.consumir(lector.disponibles % 8);
+            uint32_t longitud = lector.tomar(16);
+            if ((longitud ^ 0xFFFF) != lector.tomar(16) || longitud > limite - salida.size()) {
+                return false;
+            }
+            for (uint32_t i = 0; i < longitud && !lector.agotado; i++) {
+                salida.push_back(lector.tomar(8));
+            }
+        }
+        else if (tipo == 1 || tipo == 2) {
+            uint8_t longitudes[288 + 32];
+            int numLiterales = 288, numDistancias = 30;
+            if (tipo == 1) {
+                //Códigos fijos.
+                std::fill(longitudes, longitudes + 144, 8);
+                std::fill(longitudes + 144, longitudes + 256, 9);
+                std::fill(longitudes + 256, longitudes + 280, 7);
+                std::fill(longitudes + 280, longitudes + 288, 8);
+                std::fill(longitudes + 288, longitudes + 288 + 30, 5);
+            }
+            else {
+                //Códigos dinámicos: las longitudes de los códigos vienen codificadas con otro código de Huffman.
+                numLiterales = lector.tomar(5) + 257;
+                numDistancias = lector.tomar(5) + 1;
+                int numCodigos = lector.tomar(4) + 4;
+                uint8_t longitudesCodigos[19] = {};
+                for (int i = 0; i < numCodigos; i++) {
+                    longitudesCodigos[ordenLongitudes[i]] = lector.tomar(3);
+                }
+                if (numLiterales > 286 || numDistancias > 30 || !construirHuffman(codigos, longitudesCodigos, 19)) {
+                    return false;
+                }
+                for (int i = 0; i < numLiterales + numDistancias;) {
+                    int simbolo = lector.decodificar(codigos);
+                    if (simbolo < 0) {
+                        return false;
+                    }
+                    if (simbolo < 16) {
+                        longitudes[i++] = simbolo;
+                        continue;
+                    }
+                    int repetir, valor = 0;
+                    if (simbolo == 16) {
+                        if (i == 0) {
+                            return false;
+                        }
+                        valor = longitudes[i - 1];
+                        repetir = 3 + lector.tomar(2);
+                    }
+                    else if (simbolo == 17) {
+                        repetir = 3 + lector.tomar(3);
+                    }
+                    else {
+                        repetir = 11 + lector.tomar(7);
+                    }
+                    if (i + repetir > numLiterales + numDistancias) {
+                        return false;
+                    }
+                    std::fill(longitudes + i, longitudes + i + repetir, valor);
+                    i += repetir;
+                }
+            }
+            if (!construirHuffman(literales, longitudes, numLiterales) || !construirHuffman(distancias, longitudes + numLiterales, numDistancias)) {
+                return false;
+            }
+
+            //Literales y copias de hasta 258 bytes de los últimos 32 KB, hasta el símbolo de fin de bloque.
+            for (;;) {
+                int simbolo = lector.decodificar(literales);
+                if (simbolo < 0 || lector.agotado) {
+                    return false;
+                }
+                if (simbolo < 256) {
+                    if (salida.size() == limite) {
+                        return false;
+                    }
+                    salida.push_back(simbolo);
+                    continue;
+                }
+                if (simbolo == 256) {
+                    break;
+                }
+                simbolo -= 257;
+                if (simbolo >= 29) {
+                    return false;
+                }
+                size_t longitud = baseLongitud[simbolo] + lector.tomar(extraLongitud[simbolo]);
+                int codigo = lector.decodificar(distancias);
+                if (codigo < 0 || codigo >= 30) {
+                    return false;
+                }
+                size_t distancia = baseDistancia[codigo] + lector.tomar(extraDistancia[codigo]);
+                if (distancia > salida.size() || longitud > limite - salida.size()) {
+                    return false;
+                }
+                size_t inicio = salida.size() - distancia;
+                for (size_t k = 0; k < longitud; k++) {
+                    salida.push_back(salida[inicio + k]);
+                }
+            }
+        }
+        else {
+            return false;
+        }
+        if (lector.agotado) {
+            return false;
+        }
+    } while (!ultimo);
+    return true;
 }
 
-//Se toma una cara, luces, cámara, buffer de profundidad y coordenadas de la cara y se dibuja esa cara si es la más cercana.
-void dibujarMasCercano(Cara cara, const std::vector<Luz> &luces, Eigen::Matrix4f camara, float **bufferProf, int xi, int yi, int xf, int yf) {
-    float w0, w1, w2;                   //Coordenadas baricéntricas de la cara.
-    Eigen::Vector3f centroPixel;        //Coordenadas del centro del pixel.
-    Eigen::Vector4f v0Cam, v1Cam, v2Cam;//Vértices de la cara en coordenadas de cámara.
-    Eigen::Vector4f pixelCam;           //Pixel en coordenadas de cámara.
-    Eigen::Vector4f normalInterp;       //Normal de la cara interpolada para este pixel.
-    Eigen::Vector2f uv0, uv1, uv2;      //Coordenadas UV en coordenadas de cámara..
-    Eigen::Vector2f uvInterp;           //Coordenadas UV interpoladas en el punto actual.
-    Color colorPixel;                   //Color final que tendrá este pixel.
-    float pxCam, pyCam;                 //Coordenadas del pixel en en coordenadas de cámara.
-    float z;                            //Valor de profundidad de la cara.
-    
-    //Precálculo del área de la cara.
-    float area = edgeFunction(cara.vertDisp[0], cara.vertDisp[1], cara.vertDisp[2]);
-    
-    //Rasterización de la cara. Se verifica cada pixel (punto) que está en la cara.
-    for (int y = yi; y <= yf; y++) {
-        for (int x = xi; x <= xf; x++) {
-            //Se obtiene el centro del pixel.
-            centroPixel = Eigen::Vector3f(x + 0.5, y + 0.5, 0);
-            
-            //Coordenadas baricéntricas del pixel actual.
-            w0 = edgeFunction(cara.vertDisp[1], cara.vertDisp[2], centroPixel);
-            w1 = edgeFunction(cara.vertDisp[2], cara.vertDisp[0], centroPixel);
-            w2 = edgeFunction(cara.vertDisp[0], cara.vertDisp[1], centroPixel);
+//Se arma el código de Huffman canónico de "n" símbolos con las longitudes dadas (0 si el símbolo no tiene código).
+//Regresa falso si las longitudes piden más códigos de los que caben; los códigos incompletos sí se permiten.
+bool construirHuffman(HuffmanInflado &huffman, const uint8_t *longitudes, int n) {
+    uint16_t desplazamiento[16];
+    int sobrantes = 1;
 
-            //Si el pixel (coordenadas baricéntricas) está dentro de la cara, se verifica su profundidad.
-            if (w0 >= 0 && w1 >= 0 && w2 >= 0) {
-                //Normalización de las coordenadas baricéntricas para que sumen 1.
-                w0 /= area;
-                w1 /= area;
-                w2 /= area;
+    memset(huffman.conteo, 0, sizeof(huffman.conteo));
+    memset(huffman.rapida, 0, sizeof(huffman.rapida));
+    for (int i = 0; i < n; i++) {
+        huffman.conteo[longitudes[i]]++;
+    }
+    huffman.conteo[0] = 0;
+    for (int longitud = 1; longitud < 16; longitud++) {
+        sobrantes = (sobrantes << 1) - huffman.conteo[longitud];
+        if (sobrantes < 0) {
+            return false;
+        }
+    }
+    desplazamiento[1] = 0;
+    for (int longitud = 1; longitud < 15; longitud++) {
+        desplazamiento[longitud + 1] = desplazamiento[longitud] + huffman.conteo[longitud];
+    }
+    for (int i = 0; i < n; i++) {
+        if (longitudes[i] != 0) {
+            huffman.simbolos[desplazamiento[longitudes[i]]++] = i;
+        }
+    }
 
-                //Obtención de la profundidad de esta cara.
-                z = 1/(cara.vertDisp[0].z() * w0 + cara.vertDisp[1].z() * w1 + cara.vertDisp[2].z() * w2);
-                
-                //Si esta profundidad es menor a la que hay en el buffer actualmente, se dibuja el punto.
-                if (z < bufferProf[x][y]) {
-                    //Se actualizada el valor mínimo de profundidad en el buffer de profundidad.
-                    bufferProf[x][y] = z;                
+    //Los códigos de DEFLATE se leen del bit más significativo al menos significativo, así que en la tabla directa van
+    //invertidos, repetidos para todos los valores de los bits que siguen al código.
+    int codigo = 0, indice = 0;
+    for (int longitud = 1; longitud <= bitsTablaInflado; longitud++) {
+        for (int k = 0; k < huffman.conteo[longitud]; k++, codigo++, indice++) {
+            int invertido = 0;
+            for (int bit = 0; bit < longitud; bit++) {
+                invertido |= ((codigo >> bit) & 1) << (longitud - 1 - bit);
+            }
+            for (int r = invertido; r < (1 << bitsTablaInflado); r += 1 << longitud) {
+                huffman.rapida[r] = uint16_t(huffman.simbolos[indice] << 4 | longitud);
+            }
+        }
+        codigo <<= 1;
+    }
+    return true;
+}
+
+//Se lee un símbolo con el código "huffman": los códigos cortos con la tabla directa y los largos bit por bit.
+//Regresa -1 si los bits no corresponden a ningún código.
+int LectorBits::decodificar(const HuffmanInflado &huffman) {
+    llenar();
+    uint16_t entrada = huffman.rapida[bits & ((1 << bitsTablaInflado) - 1)];
+    if (entrada != 0) {
+        consumir(entrada & 15);
+        return entrada >> 4;
+    }
+    int codigo = 0, primero = 0, indice = 0;
+    for (int longitud = 1; longitud < 16; longitud++) {
+        codigo |= (bits >> (longitud - 1)) & 1;
+        int cuenta = huffman.conteo[longitud];
+        if (codigo - cuenta < primero) {
+            consumir(longitud);
+            return huffman.simbolos[indice + codigo - primero];
+        }
+        indice += cuenta;
+        primero = (primero + cuenta) << 1;
+        codigo <<= 1;
+    }
+    return -1;
+}
+
+//Se construye la cadena de mipmaps de la imagen RGBA de ancho x alto: cada nivel promedia bloques de 2x2 texeles del
+//anterior hasta llegar a 1x1. Los niveles se guardan uno tras otro en mosaicos (o por renglones si "lineal").
+void construirMipmaps(const std::vector<uint32_t> &rgba, int ancho, int alto, bool lineal) {
+    const int ladoMosaico = 1 << bitsMosaicoTextura;
+    std::vector<uint32_t> nivel = rgba, siguiente;
 
-                    //Se obtienen este punto en coordenadas de cámara.
-                    v0Cam = camara * cara.vertice[0]; 
-                    v1Cam = camara * cara.vertice[1]; 
-                    v2Cam = camara * cara.vertice[2];
-                    pxCam = w0 * (v0Cam.x()/-v0Cam.z()) + w1 * (v1Cam.x()/-v1Cam.z()) + w2 * (v2Cam.x()/-v2Cam.z());
-                    pyCam = (v0Cam.y()/-v0Cam.z()) * w0 + (v1Cam.y()/-v1Cam.z()) * w1 + (v2Cam.y()/-v2Cam.z()) * w2;
-                    pixelCam = Eigen::Vector4f(pxCam * z, pyCam * z, -z, 1);
+    textura = Textura();
+    textura.lineal = lineal;
+    for (;;) {
+        NivelTextura datos{ancho, alto, (ancho + ladoMosaico - 1) / ladoMosaico, textura.texeles.size()};
+        int mosaicosY = (alto + ladoMosaico - 1) / ladoMosaico;
+        textura.niveles.push_back(datos);
+        textura.texeles.resize(datos.inicio + (lineal ? size_t(ancho) * alto : size_t(datos.mosaicosX) * mosaicosY * ladoMosaico * ladoMosaico));
+        for (int y = 0; y < alto; y++) {
+            for (int x = 0; x < ancho; x++) {
+                textura.texeles[direccionTexel(datos, x, y)] = nivel[size_t(y) * ancho + x];
+            }
+        }
+        if (ancho == 1 && alto == 1) {
+            break;
+        }
 
-                    //Se interpola la normal en este punto.
-                    normalInterp = (w0 * cara.normal[0] + w1 * cara.normal[1] + w2 * cara.normal[2]).normalized();
-                    
-                    //Se interpola la coordenada UV para el punto actual.
-                    uv0 = cara.coord_tex[0] * cara.vertDisp[0].z();
-                    uv1 = cara.coord_tex[1] * cara.vertDisp[0].z();
-                    uv2 = cara.coord_tex[2] * cara.vertDisp[0].z(); 
-                    uvInterp = (uv0 * w0 + uv1 * w1 + uv2 * w2) * z;  
+        //En los lados de tamaño impar, el último renglón o columna se pierde en el promedio.
+        int anchoSiguiente = std::max(1, ancho / 2), altoSiguiente = std::max(1, alto / 2);
+        siguiente.assign(size_t(anchoSiguiente) * altoSiguiente, 0);
+        for (int y = 0; y < altoSiguiente; y++) {
+            for (int x = 0; x < anchoSiguiente; x++) {
+                uint32_t suma[4] = {2, 2, 2, 2};    //Con redondeo.
+                for (int k = 0; k < 4; k++) {
+                    uint32_t texel = nivel[size_t(std::min(2 * y + k / 2, alto - 1)) * ancho + std::min(2 * x + k % 2, ancho - 1)];
+                    for (int canal = 0; canal < 4; canal++) {
+                        suma[canal] += (texel >> (8 * canal)) & 0xFF;
+                    }
+                }
+                siguiente[size_t(y) * anchoSiguiente + x] = suma[0] / 4 | (suma[1] / 4) << 8 | (suma[2] / 4) << 16 | (suma[3] / 4) << 24;
+            }
+        }
+        nivel.swap(siguiente);
+        ancho = anchoSiguiente;
+        alto = altoSiguiente;
+    }
+}
 
-                    //Se obtiene el color del pixel a partir de los valores recién calculados.
-                    colorPixel = obtenerColorPixel(cara, luces, pixelCam, normalInterp, uvInterp);
+//Se genera el texto de un OBJ sintético de 12 * lado * lado triángulos, a partir de un cubo con cada cara dividida en una
+//rejilla de lado x lado cuadros: "cubo" es el cubo mismo (con la normal de cada cara), "esfera" proyecta la rejilla a
+//la esfera unitaria (con normales exactas) y "ruidosa" desplaza el radio de la esfera con ruidoSuperficie, con normales
+//promediadas de las caras de cada rejilla, para tener una superficie irregular como la de un modelo escaneado.
+std::string generarOBJSintetico(const std::string &tipo, int lado) {
+    //Normal y ejes de la rejilla de cada cara del cubo (u x v = normal, para que las caras queden en sentido antihorario).
+    const Eigen::Vector3f ejes[6][3] = {{Eigen::Vector3f::UnitX(), Eigen::Vector3f::UnitY(), Eigen::Vector3f::UnitZ()},
+                                        {-Eigen::Vector3f::UnitX(), Eigen::Vector3f::UnitZ(), Eigen::Vector3f::UnitY()},
+                                        {Eigen::Vector3f::UnitY(), Eigen::Vector3f::UnitZ(), Eigen::Vector3f::UnitX()},
+                                        {-Eigen::Vector3f::UnitY(), Eigen::Vector3f::UnitX(), Eigen::Vector3f::UnitZ()},
+                                        {Eigen::Vector3f::UnitZ(), Eigen::Vector3f::UnitX(), Eigen::Vector3f::UnitY()},
+                                        {-Eigen::Vector3f::UnitZ(), Eigen::Vector3f::UnitY(), Eigen::Vector3f::UnitX()}};
+    size_t porCara = size_t(lado + 1) * (lado + 1);     //Vértices de la rejilla de cada cara.
+    std::vector<Eigen::Vector3f> posiciones(porCara), normales(porCara);
+    std::string texto;
+    char linea[128];
 
-                    //Se dibuja el pixel actual con el color obtenido.
-                    dibujarPuntoColor(x, y, colorPixel.R, colorPixel.G, colorPixel.B);
+    texto.reserve(6 * porCara * 70 + size_t(12) * lado * lado * 45);
+    for (int c = 0; c < 6; c++) {
+        const Eigen::Vector3f &n = ejes[c][0], &u = ejes[c][1], &v = ejes[c][2];
+        for (int j = 0; j <= lado; j++) {
+            for (int i = 0; i <= lado; i++) {
+                Eigen::Vector3f p = n + (2.0f * i / lado - 1) * u + (2.0f * j / lado - 1) * v;
+                if (tipo != "cubo") {
+                    p.normalize();
+                    normales[j * (lado + 1) + i] = p;
                 }
+                if (tipo == "ruidosa") {
+                    p *= 1 + ruidoSuperficie(p);
+                }
+                posiciones[j * (lado + 1) + i] = p;
+            }
+        }
+        if (tipo == "ruidosa") {
+            std::fill(normales.begin(), normales.end(), Eigen::Vector3f::Zero());
+            for (int j = 0; j < lado; j++) {
+                for (int i = 0; i < lado; i++) {
+                    size_t a = j * (lado + 1) + i, b = a + 1, d = a + lado + 1, e = d + 1;
+                    Eigen::Vector3f normal1 = (posiciones[b] - posiciones[a]).cross(posiciones[e] - posiciones[a]);
+                    Eigen::Vector3f normal2 = (posiciones[e] - posiciones[a]).cross(posiciones[d] - posiciones[a]);
+                    normales[a] += normal1 + normal2;
+                    normales[b] += normal1;
+                    normales[e] += normal1 + normal2;
+                    normales[d] += normal2;
+                }
+            }
+        }
+
+        for (const Eigen::Vector3f &p : posiciones) {
+            texto.append(linea, snprintf(linea, sizeof(linea), "v %.6f %.6f %.6f\n", p.x(), p.y(), p.z()));
+        }
+        if (tipo == "cubo") {
+            texto.append(linea, snprintf(linea, sizeof(linea), "vn %g %g %g\n", n.x(), n.y(), n.z()));
+        }
+        else {
+            for (const Eigen::Vector3f &normal : normales) {
+                Eigen::Vector3f unitaria = normal.normalized();
+                texto.append(linea, snprintf(linea, sizeof(linea), "vn %.5f %.5f %.5f\n", unitaria.x(), unitaria.y(), unitaria.z()));
+            }
+        }
+
+        //Dos triángulos por cuadro de la rejilla, con índices del OBJ (base 1).
+        size_t base = c * porCara + 1, baseNormal = tipo == "cubo" ? c + 1 : base;
+        for (int j = 0; j < lado; j++) {
+            for (int i = 0; i < lado; i++) {
+                size_t a = j * (lado + 1) + i, b = a + 1, d = a + lado + 1, e = d + 1;
+                size_t na = tipo == "cubo" ? 0 : a, nb = tipo == "cubo" ? 0 : b, nd = tipo == "cubo" ? 0 : d, ne = tipo == "cubo" ? 0 : e;
+                texto.append(linea, snprintf(linea, sizeof(linea), "f %zu//%zu %zu//%zu %zu//%zu\n", base + a, baseNormal + na,
+                                             base + b, baseNormal + nb, base + e, baseNormal + ne));
+                texto.append(linea, snprintf(linea, sizeof(linea), "f %zu//%zu %zu//%zu %zu//%zu\n", base + a, baseNormal + na,
+                                             base + e, baseNormal + ne, base + d, baseNormal + nd));
             }
         }
     }
+    return texto;
 }
 
-//Implementación de "Edge Function" de Juan Pineda. Regresa una coordenada baricéntrica a partir de tres vértices.
-float edgeFunction(Eigen::Vector3f a, Eigen::Vector3f b, Eigen::Vector3f c) { 
-    return (c[0] - a[0]) * (b[1] - a[1]) - (c[1] - a[1]) * (b[0] - a[0]); 
+//Desplazamiento del radio de la esfera en la dirección unitaria "p": suma de ondas de varias frecuencias.
+float ruidoSuperficie(const Eigen::Vector3f &p) {
+    return 0.08f * std::sin(3 * p.x() + 1) * std::sin(4 * p.y() + 2) * std::sin(5 * p.z() + 3) +
+           0.03f * std::sin(11 * p.x() + 4) * std::sin(13 * p.y() + 5) * std::sin(12 * p.z() + 6) +
+           0.01f * std::sin(37 * p.x() + 7) * std::sin(41 * p.y() + 8) * std::sin(39 * p.z() + 9) +
+           0.004f * std::sin(97 * p.x()) * std::sin(89 * p.y()) * std::sin(101 * p.z());
 }
 
-//Se obtiene el color del pixel actual, considerando luz y textura tipo checker. 
-//La iluminación se calcula con el modelo de Phong y la textura se genera proceduralmente.
-//Función basada en esta implementación: http://www.cs.toronto.edu/~jacobson/phong-demo/
-Color obtenerColorPixel(Cara cara, const std::vector<Luz> &luces, Eigen::Vector4f pixelCam, Eigen::Vector4f normalInterp, Eigen::Vector2f uv) {
-    Eigen::Vector4f posRelLuz;      //Posición de la luz con respecto al punto.
-    Eigen::Vector4f vecReflexion;   //Vector de reflexión de la luz.
-    Eigen::Vector4f vecCamara;      //Vector del punto a la cámara.
-    Eigen::Vector3f color;          //Color final
-    float lambertian;       //Lambertiano calculado.
-    float specular;         //Componente especular calculada.
-    float specAngle;        //Ángulo de la componente especular.
-    int tamChecker = 10;    //Valor de cada cuadro del checker (entre más grande, más pequeño el cuadro).
-    float checker;          //Valor generado por el checker en este punto. 
-    float intensidadChecker;//Intensidad del checker en este punto.       
+//Se mide la etapa "ejecutar" sobre una malla del benchmark: se ejecuta una vez para calentar los cachés y después se
+//repite hasta juntar al menos repeticionesBenchmark repeticiones y tiempoBenchmark segundos. "preparar" (si no es nulo)
+//se ejecuta antes de cada repetición, fuera de la medición. Lo que escriban en la consola las funciones medidas se descarta.
+void medirEtapa(std::vector<ResultadoBenchmark> &resultados, const std::string &etapa, const std::string &malla, size_t caras,
+                double elementos, const std::string &unidad, const std::function<void()> &preparar, const std::function<void()> &ejecutar) {
+    ResultadoBenchmark resultado{etapa, malla, unidad, caras, elementos, {}};
+    double total = 0;
 
-    //Se hace el cálculo por cada luz.
-    for (int i = 0; i < luces.size(); i++) {
-        //Se calcula la posición de la luz con respecto al punto deseado.
-        posRelLuz = (luces[i].posicion - pixelCam).normalized();
+    std::streambuf *consola = std::cout.rdbuf(nullptr);
+    for (int r = -1; r < 10 * repeticionesBenchmark && (r < repeticionesBenchmark || total < tiempoBenchmark); r++) {
+        if (preparar) {
+            preparar();
+        }
+        auto inicio = std::chrono::steady_clock::now();
+        ejecutar();
+        double segundos = std::chrono::duration<double>(std::chrono::steady_clock::now() - inicio).count();
+        if (r >= 0) {
+            resultado.tiempos.push_back(segundos);
+            total += segundos;
+        }
+    }
+    std::cout.rdbuf(consola);
+    std::cout.clear();
 
-        //Se calcula el Lambertiano.
-        lambertian = std::max(normalInterp.dot(posRelLuz), 0.0f);
-        specular = 0.0f;
+    std::vector<double> tiempos = resultado.tiempos;
+    std::sort(tiempos.begin(), tiempos.end());
+    double mediana = tiempos[tiempos.size() / 2];
+    std::cout << "  " << etapa << ": " << mediana * 1e3 << " ms (" << elementos / mediana / 1e6 << " millones de " << unidad
+              << " por segundo, " << tiempos.size() << " repeticiones).\n";
+    resultados.push_back(resultado);
+}
+
+//Modo benchmark: se generan mallas sintéticas (esfera, cubo y superficie ruidosa) de 10 mil caras hasta carasMaximas,
+//multiplicando por 10, y se mide cada etapa del programa sobre ellas: lectura del OBJ, UVs, meshlets, etapa de vértices,
+//funciones de transformación, edge functions y sombreado por separado, frames completos con las opciones de
+//renderizado elegidas y el reordenamiento para el caché de vértices (con un frame de la malla reordenada). Los resultados se escriben en formato JSON en el archivo "salida".
+int ejecutarBenchmark(const std::vector<Luz> &luces, Eigen::Matrix4f camara, const std::string &salida,
+                      size_t carasMaximas, const std::string &isa) {
+    std::vector<ResultadoBenchmark> resultados;
+    std::string temporal = salida + ".obj";     //OBJ sintético que lee OBJaModelo.
+    Eigen::Matrix4f transformacion = matrizRotacion('y', 30) * matrizRotacion('x', 20);
+    Eigen::Matrix4f modeloVista = camara * transformacion;
+    volatile float sumidero;    //Evita que el compilador elimine los cálculos de las pruebas de funciones sueltas.
+
+    framebuffers[0].pixeles = new uint32_t[anchoVen * altoVen];
+    frameTrasero = 0;
+    for (size_t carasObjetivo = 10000; carasObjetivo <= carasMaximas; carasObjetivo *= 10) {
+        int lado = std::max(1, int(std::lround(std::sqrt(carasObjetivo / 12.0))));
+        size_t numCaras = size_t(12) * lado * lado;
+        for (const std::string tipo : {"esfera", "cubo", "ruidosa"}) {
+            std::string texto = generarOBJSintetico(tipo, lado);
+            std::ofstream archivo(temporal, std::ios::binary);
+            archivo.write(texto.data(), texto.size());
+            archivo.close();
+            if (!archivo) {
+                std::cout << "No se pudo escribir el archivo temporal '" << temporal << "'." << std::endl;
+                delete [] framebuffers[0].pixeles;
+                return -1;
+            }
+            std::cout << "Malla " << tipo << " de " << numCaras << " caras (" << texto.size() / 1e6 << " MB de OBJ):\n";
+
+            MallaOBJ mallaOBJ;
+            medirEtapa(resultados, "OBJaModelo", tipo, numCaras, texto.size(), "bytes", nullptr, [&] { mallaOBJ = OBJaModelo(temporal); });
+            remove(temporal.c_str());
+            std::string().swap(texto);
+
+            Malla malla = empaquetarMalla(mallaOBJ), copia;
+            Eigen::Vector4f centro = centroideCaras(malla);
+            size_t numVertices = malla.numVertices();
+            medirEtapa(resultados, "generarUVs", tipo, numCaras, numVertices, "vértices", nullptr, [&] { generarUVs(malla, centro); });
+            medirEtapa(resultados, "construirMeshlets", tipo, numCaras, numCaras, "caras", [&] { copia = empaquetarMalla(mallaOBJ); },
+                       [&] { construirMeshlets(copia); });
+            construirMeshlets(malla);
+            copia = Malla();
+            mallaOBJ = MallaOBJ();
+
+            VerticesTransformados vertices;
+            medirEtapa(resultados, "procesarVertices", tipo, numCaras, numVertices, "vértices", nullptr,
+                       [&] { procesarVertices(malla, modeloVista, vertices); });
+            medirEtapa(resultados, "verticeADispositivo", tipo, numCaras, numVertices, "vértices", nullptr, [&] {
+                float suma = 0;
+                for (uint32_t i = 0; i < numVertices; i++) {
+                    suma += verticeADispositivo(malla.posicion(i), modeloVista).x();
+                }
+                sumidero = suma;
+            });
+            medirEtapa(resultados, "edgeFunction", tipo, numCaras, numCaras, "caras", nullptr, [&] {
+                float suma = 0;
+                for (size_t i = 0; i < 3 * numCaras; i += 3) {
+                    Eigen::Vector3f a(vertices.xDisp[malla.indices[i]], vertices.yDisp[malla.indices[i]], 0);
+                    Eigen::Vector3f b(vertices.xDisp[malla.indices[i + 1]], vertices.yDisp[malla.indices[i + 1]], 0);
+                    Eigen::Vector3f c(vertices.xDisp[malla.indices[i + 2]], vertices.yDisp[malla.indices[i + 2]], 0);
+                    suma += edgeFunction(a, b, c);
+                }
+                sumidero = suma;
+            });
+            prepararSombreado(luces);
+            medirEtapa(resultados, "obtenerColorPixel", tipo, numCaras, numVertices, "pixeles", nullptr, [&] {
+                float suma = 0;
+                for (uint32_t i = 0; i < numVertices; i++) {
+                    Color color = sombreadorPixel(modeloVista * malla.posicion(i), malla.normal(i), malla.coordTex(i), 0);
+                    suma += color.R + color.G + color.B;
+                }
+                sumidero = suma;
+            });
+            medirEtapa(resultados, "frame", tipo, numCaras, numCaras, "caras", nullptr, [&] {
+                limpiarFramebuffer();
+                renderizar(malla, luces, camara, transformacion, destino.profundidad);
+            });
 
-        //Si el lambertiano es mayor a 0.
-        if(lambertian > 0.0f) {
-            vecReflexion = -posRelLuz -2.0 * normalInterp.dot(-posRelLuz) * normalInterp;   //Se calcula el vector de reflexión.
-            vecCamara = -pixelCam.normalized();                     //Se calcula el vector del punto a la cámara.
-            specAngle = std::max(vecReflexion.dot(vecCamara), 0.0f);//Se calcula el ángulo de la componente especular.
-            specular = std::pow(specAngle, luces[i].brillantez);    //Se calcula la componente especular.
+            //Reordenamiento para el caché de vértices sobre copias de la malla ya dividida en meshlets, y frame con la
+            //malla reordenada para compararlo con el anterior.
+            Malla reordenada;
+            auto copiarMalla = [&] {
+                reordenada = malla;
+                reordenada.bloque = std::shared_ptr<void>(aligned_alloc(64, malla.tamanoBloque), free);
+                memcpy(reordenada.bloque.get(), malla.bloque.get(), malla.tamanoBloque);
+                asignarArreglos(reordenada);
+            };
+            medirEtapa(resultados, "reordenarMalla", tipo, numCaras, numCaras, "caras", copiarMalla, [&] { reordenarMalla(reordenada); });
+            medirEtapa(resultados, "frameReordenado", tipo, numCaras, numCaras, "caras", nullptr, [&] {
+                limpiarFramebuffer();
+                renderizar(reordenada, luces, camara, transformacion, destino.profundidad);
+            });
+            MedicionCacheVertices antes = medirCacheVertices(malla), despues = medirCacheVertices(reordenada);
+            std::cout << "  Caché de vértices: ACMR " << antes.acmr << " -> " << despues.acmr << ", líneas de 64 bytes por cara "
+                      << antes.lineasPorCara << " -> " << despues.lineasPorCara << ".\n";
         }
+    }
+    delete [] framebuffers[0].pixeles;
+
+    if (!escribirResultados(salida, resultados, isa)) {
+        std::cout << "No se pudo escribir el archivo de resultados '" << salida << "'." << std::endl;
+        return -1;
+    }
+    std::cout << "Se escribieron " << resultados.size() << " resultados en '" << salida << "'.\n";
+    return 0;
+}
+
+//Se escriben los resultados del benchmark en formato JSON, junto con la configuración con la que se midieron. Los
+//tiempos están en milisegundos y "elementos_por_s" es el rendimiento según la mediana.
+bool escribirResultados(const std::string &nombre, const std::vector<ResultadoBenchmark> &resultados, const std::string &isa) {
+    std::ofstream archivo(nombre);
+    char fecha[32];
+    time_t ahora = time(nullptr);
 
-        //Si es la primera luz, se guarda la componente de luz obtenida.
-        if (i == 0) {
-            color= (luces[i].Ka * luces[i].CAmbiental +
-                    luces[i].Kd * lambertian * luces[i].CDifuso +
-                    luces[i].Ke * specular * luces[i].CEspecular);
+    strftime(fecha, sizeof(fecha), "%Y-%m-%dT%H:%M:%S", localtime(&ahora));
+    archivo << "{\n  \"fecha\": \"" << fecha << "\",\n  \"compilador\": \"" << __VERSION__ << "\",\n  \"hilos\": " << numHilos
+            << ",\n  \"isa\": \"" << isa << "\",\n  \"ventana\": [" << anchoVen << ", " << altoVen << "],\n  \"escala\": " << destino.escala
+            << ",\n  \"opciones\": {\"referencia\": "
+            << (usarReferencia ? "true" : "false") << ", \"diferido\": " << (usarDiferido ? "true" : "false") << ", \"hiz\": "
+            << (usarHiZ ? "true" : "false") << ", \"frente_atras\": " << (ordenarFrenteAtras ? "true" : "false") << "},\n  \"resultados\": [\n";
+    archivo.precision(6);
+    for (size_t i = 0; i < resultados.size(); i++) {
+        const ResultadoBenchmark &resultado = resultados[i];
+        std::vector<double> tiempos = resultado.tiempos;
+        std::sort(tiempos.begin(), tiempos.end());
+        double media = 0;
+        for (double segundos : tiempos) {
+            media += segundos / tiempos.size();
         }
-        //Si no, se acumula la componente de luz obtenida.
-        else {
-            color+=(luces[i].Ka * luces[i].CAmbiental +
-                    luces[i].Kd * lambertian * luces[i].CDifuso +
-                    luces[i].Ke * specular * luces[i].CEspecular);
+        double mediana = tiempos[tiempos.size() / 2];
+        archivo << "    {\"etapa\": \"" << resultado.etapa << "\", \"malla\": \"" << resultado.malla << "\", \"caras\": " << resultado.caras
+                << ", \"unidad\": \"" << resultado.unidad << "\", \"elementos\": " << size_t(resultado.elementos) << ", \"repeticiones\": "
+                << tiempos.size() << ", \"min_ms\": " << tiempos.front() * 1e3 << ", \"mediana_ms\": " << mediana * 1e3
+                << ", \"media_ms\": " << media * 1e3 << ", \"max_ms\": " << tiempos.back() * 1e3 << ", \"elementos_por_s\": "
+                << resultado.elementos / mediana << "}" << (i + 1 < resultados.size() ? "," : "") << "\n";
+    }
+    archivo << "  ]\n}\n";
+    return archivo.good();
+}
+
+//Modo de verificación: se renderizan mallas sintéticas (esfera, cubo y superficie ruidosa) en varias poses con el
+//renderizador de referencia y con cada variante del renderizador por mosaicos (cada kernel hasta isaMaxima, diferido,
+//sin Hi-Z, de frente hacia atrás, fuera de núcleo y en lote), y se compara cada imagen con la de referencia. Un pixel falla si
+//algún canal difiere en más de "tolerancia"; una comparación falla si fallan más de pixelesMaximos pixeles, y entonces
+//se guardan en "directorio" la imagen de la variante y una imagen de diferencias. Las imágenes de referencia se guardan
+//en "directorio" la primera vez y en las siguientes se comparan contra esas, para detectar también cambios en el
+//renderizador de referencia. Regresa 0 si todas las comparaciones pasaron.
+int ejecutarVerificacion(const std::vector<Luz> &luces, Eigen::Matrix4f camara, const std::string &directorio,
+                         int tolerancia, long pixelesMaximos, ISA isaMaxima) {
+    //Posición de la cámara y rotaciones del modelo (grados sobre Y y luego sobre X) de cada pose. Ninguna pose cruza el
+    //plano cercano, que el renderizador de referencia no recorta.
+    const float poses[][5] = {{0, 0, 5, 0, 0}, {-0.3f, -0.2f, 4, 40, 0}, {0.9f, 0.6f, 3, 40, 20}};
+    const size_t numPoses = sizeof(poses) / sizeof(poses[0]);
+    auto camaraPose = [=](size_t p) {
+        Eigen::Matrix4f camaraP = camara;
+        camaraP(0, 3) = -poses[p][0];
+        camaraP(1, 3) = -poses[p][1];
+        camaraP(2, 3) = -poses[p][2];
+        return camaraP;
+    };
+    auto transformacionPose = [=](size_t p) { return Eigen::Matrix4f(matrizRotacion('x', poses[p][4]) * matrizRotacion('y', poses[p][3])); };
+    const int ladoVerificacion = 64;    //Rejilla de las mallas: 12 * 64 * 64 = 49152 caras, dos ladrillos.
+    std::string temporal = directorio + "/verificacion.obj";
+    size_t numPixeles = size_t(anchoVen) * altoVen;
+    std::vector<uint32_t> referencia(numPixeles), diferencias(numPixeles), dorada;
+    bool referenciaOriginal = usarReferencia, diferidoOriginal = usarDiferido, hiZOriginal = usarHiZ, frenteOriginal = ordenarFrenteAtras;
+    int comparaciones = 0, fallidas = 0;
+
+    mkdir(directorio.c_str(), 0755);
+
+    //Un kernel por cada conjunto de instrucciones disponible y las demás opciones con el kernel más ancho.
+    std::vector<VarianteVerificacion> variantes;
+    for (int i = ISA_ESCALAR; i <= isaMaxima; i++) {
+        if (seleccionarISA(ISA(i)) == i) {
+            variantes.push_back({std::string("mosaicos-") + nombresISA[i], ISA(i), false, true, false, false, false});
         }
     }
-    
-    //Obtención del valor de la textura en este punto.
-    checker = (fmod(uv.x() * tamChecker, 1.0) > 0.5) ^ (fmod(uv.y() * tamChecker, 1.0) < 0.5);
-    intensidadChecker = 0.2 * (1 - checker) + 0.8 * checker;
+    ISA isa = seleccionarISA(isaMaxima);
+    variantes.push_back({"diferido", isa, true, true, false, false, false});
+    variantes.push_back({"sin-hiz", isa, false, false, false, false, false});
+    variantes.push_back({"frente-atras", isa, false, true, true, false, false});
+    variantes.push_back({"fuera-nucleo", isa, false, true, false, true, false});
+    variantes.push_back({"lote", isa, false, true, false, false, true});
 
-    //Se aplica el valor del checker al color obtenido en este punto.
-    color *= intensidadChecker;
+    framebuffers[0].pixeles = new uint32_t[numPixeles];
+    frameTrasero = 0;
+    for (const std::string tipo : {"esfera", "cubo", "ruidosa"}) {
+        std::string texto = generarOBJSintetico(tipo, ladoVerificacion);
+        std::ofstream archivo(temporal, std::ios::binary);
+        archivo.write(texto.data(), texto.size());
+        archivo.close();
+        if (!archivo) {
+            std::cout << "No se pudo escribir el archivo temporal '" << temporal << "'." << std::endl;
+            delete [] framebuffers[0].pixeles;
+            return -1;
+        }
 
-    return Color{color[0], color[1], color[2]};
-}
+        //Lo que escriben la carga y el renderizador en la consola se descarta.
+        std::streambuf *consola = std::cout.rdbuf(nullptr);
+        Malla malla = cargarModelo(temporal, false, false);
+        std::cout.rdbuf(consola);
+        std::cout.clear();
 
-//Se colorea un pixel con coordenadas X y Y con sus componentes R, G y B normalizadas.
-void dibujarPuntoColor(int x, int y, float R, float G, float B) {
-    char colorString[26];
-    XColor color;
+        //La variante de lote dibuja de una vez todas las poses de la malla, como un guion con --lote.
+        std::vector<VistaLote> vistas(numPoses);
+        for (size_t p = 0; p < numPoses; p++) {
+            vistas[p].modeloVista = camaraPose(p) * transformacionPose(p);
+        }
+        consola = std::cout.rdbuf(nullptr);
+        seleccionarISA(isa);
+        usarDiferido = false;
+        usarHiZ = true;
+        ordenarFrenteAtras = false;
+        renderizarVistas(malla, luces, vistas);
+        std::cout.rdbuf(consola);
+        std::cout.clear();
 
-    //Se obtiene el color en el formato de X11.
-    sprintf(colorString, "RGBi:%6.4f/%6.4f/%6.4f", R, G, B);
-    XAllocNamedColor(display, cm, colorString, &color, &color);
+        for (size_t p = 0; p < numPoses; p++) {
+            std::string nombre = directorio + "/" + tipo + "_" + std::to_string(p);
+            camara = camaraPose(p);
+            Eigen::Matrix4f transformacion = transformacionPose(p);
 
-    //Se dibuja el pixel con el color obtenido.
-    XSetForeground(display, gc, color.pixel);
-    XDrawPoint(display, win, gc, x, y);
+            consola = std::cout.rdbuf(nullptr);
+            usarReferencia = true;
+            limpiarFramebuffer();
+            renderizar(malla, luces, camara, transformacion, destino.profundidad);
+            usarReferencia = false;
+            std::cout.rdbuf(consola);
+            std::cout.clear();
+            std::copy(framebuffers[0].pixeles, framebuffers[0].pixeles + numPixeles, referencia.begin());
 
-    return;
+            //La imagen de referencia se compara con la guardada (la dorada) o se guarda si todavía no existe.
+            if (leerPPM(nombre + ".ppm", dorada)) {
+                int maxima = 0;
+                long distintos = compararImagenes(dorada.data(), referencia.data(), tolerancia, maxima, diferencias.data());
+                comparaciones++;
+                if (distintos > pixelesMaximos) {
+                    fallidas++;
+                    std::cout << "FALLA " << tipo << ", pose " << p << ", referencia contra " << nombre << ".ppm: " << distintos
+                              << " pixeles distintos (diferencia máxima de " << maxima << ").\n";
+                    guardarImagen(nombre + "_referencia.ppm", "ppm", referencia.data());
+                    guardarImagen(nombre + "_referencia_diferencias.ppm", "ppm", diferencias.data());
+                }
+            }
+            else if (!guardarImagen(nombre + ".ppm", "ppm", referencia.data())) {
+                std::cout << "No se pudo escribir la imagen '" << nombre << ".ppm'." << std::endl;
+                delete [] framebuffers[0].pixeles;
+                remove(temporal.c_str());
+                return -1;
+            }
+            else {
+                std::cout << "Se guardó la imagen de referencia '" << nombre << ".ppm'.\n";
+            }
+
+            for (const VarianteVerificacion &variante : variantes) {
+                consola = std::cout.rdbuf(nullptr);
+                seleccionarISA(variante.isa);
+                usarDiferido = variante.diferido;
+                usarHiZ = variante.hiZ;
+                ordenarFrenteAtras = variante.frenteAtras;
+                if (variante.fueraNucleo) {
+                    ladrillos = abrirLadrillos(temporal, false, size_t(64) << 20);
+                }
+                if (variante.lote) {
+                    escalarImagen(vistas[p].pixeles.data(), destino.ancho, destino.alto, destino.paso, framebuffers[0].pixeles, anchoVen, altoVen);
+                }
+                else {
+                    limpiarFramebuffer();
+                    renderizar(malla, luces, camara, transformacion, destino.profundidad);
+                }
+                if (variante.fueraNucleo) {
+                    cerrarLadrillos(ladrillos);
+                    ladrillos = nullptr;
+                }
+                std::cout.rdbuf(consola);
+                std::cout.clear();
+
+                int maxima = 0;
+                long distintos = compararImagenes(referencia.data(), framebuffers[0].pixeles, tolerancia, maxima, diferencias.data());
+                comparaciones++;
+                if (distintos > pixelesMaximos) {
+                    fallidas++;
+                    std::cout << "FALLA " << tipo << ", pose " << p << ", " << variante.nombre << ": " << distintos
+                              << " pixeles distintos (diferencia máxima de " << maxima << ").\n";
+                    guardarImagen(nombre + "_" + variante.nombre + ".ppm", "ppm");
+                    guardarImagen(nombre + "_" + variante.nombre + "_diferencias.ppm", "ppm", diferencias.data());
+                }
+            }
+        }
+        remove((temporal + ".ladrillos").c_str());
+    }
+    remove(temporal.c_str());
+    delete [] framebuffers[0].pixeles;
+
+    usarReferencia = referenciaOriginal;
+    usarDiferido = diferidoOriginal;
+    usarHiZ = hiZOriginal;
+    ordenarFrenteAtras = frenteOriginal;
+    seleccionarISA(isaMaxima);
+
+    std::cout << "Verificación: " << comparaciones - fallidas << " de " << comparaciones << " comparaciones dentro de la tolerancia ("
+              << variantes.size() << " variantes del renderizador por mosaicos).\n";
+    return fallidas > 0 ? 1 : 0;
 }
 
-//Se pinta toda la ventana de negro.
-void limpiarVentana() {
-    XSetForeground(display, gc, BlackPixel(display, DefaultScreen(display)));
-    
-    for (int x = 0; x <= anchoVen; x++)
-        for (int y = 0; y <= altoVen; y++)
-            XDrawPoint(display, win, gc, x, y);
-    
-    XSetForeground(display, gc, WhitePixel(display, DefaultScreen(display)));
+//Se lee una imagen PPM binaria (P6) del tamaño de la ventana y se empaqueta como los pixeles del framebuffer.
+//Regresa falso si no existe o tiene otro tamaño.
+bool leerPPM(const std::string &nombre, std::vector<uint32_t> &pixeles) {
+    std::ifstream archivo(nombre, std::ios::binary);
+    std::string formato;
+    int ancho, alto, maximo;
 
-    return;
-}
\ No newline at end of file
+    if (!(archivo >> formato >> ancho >> alto >> maximo) || formato != "P6" || ancho != anchoVen || alto != altoVen || maximo != 255) {
+        return false;
+    }
+    archivo.get();
+    std::vector<uint8_t> rgb(size_t(3) * ancho * alto);
+    if (!archivo.read((char *) rgb.data(), rgb.size())) {
+        return false;
+    }
+    pixeles.resize(size_t(ancho) * alto);
+    for (size_t i = 0; i < pixeles.size(); i++) {
+        pixeles[i] = (uint32_t(rgb[3 * i]) << despRojo) | (uint32_t(rgb[3 * i + 1]) << despVerde) | (uint32_t(rgb[3 * i + 2]) << despAzul);
+    }
+    return true;
+}
+
+//Se comparan dos imágenes del tamaño de la ventana y se regresa cuántos pixeles tienen algún canal que difiere en más
+//de "tolerancia"; en "maxima" queda la mayor diferencia de un canal. En "diferencias" se dibujan esos pixeles en rojo
+//sobre la imagen "a" oscurecida, para ver dónde están.
+long compararImagenes(const uint32_t *a, const uint32_t *b, int tolerancia, int &maxima, uint32_t *diferencias) {
+    long distintos = 0;
+
+    maxima = 0;
+    for (int i = 0; i < anchoVen * altoVen; i++) {
+        int diferencia = 0;
+        for (int desplazamiento : {despRojo, despVerde, despAzul}) {
+            diferencia = std::max(diferencia, std::abs(int((a[i] >> desplazamiento) & 0xFF) - int((b[i] >> desplazamiento) & 0xFF)));
+        }
+        maxima = std::max(maxima, diferencia);
+        if (diferencia > tolerancia) {
+            distintos++;
+            diferencias[i] = 0xFFu << despRojo;
+        }
+        else {
+            diferencias[i] = (((a[i] >> despRojo) & 0xFF) / 4 << despRojo) | (((a[i] >> despVerde) & 0xFF) / 4 << despVerde) |
+                             (((a[i] >> despAzul) & 0xFF) / 4 << despAzul);
+        }
+    }
+    return distintos;
+}